@@ -26,11 +26,13 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "resources.h"
 #include "feeds.h"
 #include "mimehooks.h"
+#include "contentcache.h"
 #include "gmcerts.h"
 #include "gmdocument.h"
 #include "gmutil.h"
 #include "history.h"
 #include "ipc.h"
+#include "media.h"
 #include "periodic.h"
 #include "sitespec.h"
 #include "updater.h"
@@ -47,6 +49,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "ui/text.h"
 #include "ui/util.h"
 #include "ui/window.h"
+#include "searchindex.h"
 #include "visited.h"
 
 #include <the_Foundation/commandline.h>
@@ -115,6 +118,8 @@ struct Impl_App {
     iMimeHooks * mimehooks;
     iGmCerts *   certs;
     iVisited *   visited;
+    iContentCache *contentCache;
+    iSearchIndex *searchIndex;
     iBookmarks * bookmarks;    
     iMainWindow *window;
     iPtrArray    popupWindows;
@@ -130,6 +135,7 @@ struct Impl_App {
     int          sleepTimer;
 #endif
     iAtomicInt   pendingRefresh;
+    iAtomicInt   pendingFullRefresh; /* otherwise only damaged window areas are redrawn */
     iBool        isLoadingPrefs;
     iStringList *launchCommands;
     iBool        isFinishedLaunching;
@@ -146,6 +152,8 @@ struct Impl_App {
 
 static iApp app_;
 
+static iBool updateFeedsProgress_App_(iAnyObject *, const char *);
+
 /*----------------------------------------------------------------------------------------------*/
 
 iDeclareType(Ticker)
@@ -538,6 +546,15 @@ static iBool loadState_App_(iApp *d) {
         iForIndices(i, current) {
             postCommandf_Root(NULL, "tabs.switch page:%p", current[i]);
         }
+        /* The visible tabs are loaded right away. Switching to a tab that is already
+           current does not notify it, so "tabs.changed" can't be relied on here. */
+        iForIndices(i, d->window->base.roots) {
+            iRoot *root = d->window->base.roots[i];
+            if (root) {
+                setCurrent_Root(root);
+                loadRestored_DocumentWidget(current[i] ? current[i] : document_Root(root));
+            }
+        }
         setCurrent_Root(NULL);
         return iTrue;
     }
@@ -547,6 +564,7 @@ static iBool loadState_App_(iApp *d) {
 static void saveState_App_(const iApp *d) {
     iUnused(d);
     trimCache_App();
+    save_ContentCache(d->contentCache);
     iMainWindow *win = d->window;
     /* UI state is saved in binary because it is quite complex (e.g.,
        navigation history, cached content) and depends closely on the widget
@@ -697,15 +715,7 @@ static iBool hasCommandLineOpenableScheme_(const iRangecc uri) {
     return iFalse;
 }
 
-static void init_App_(iApp *d, int argc, char **argv) {
-#if defined (iPlatformLinux)
-    d->isRunningUnderWindowSystem = !iCmpStr(SDL_GetCurrentVideoDriver(), "x11") ||
-                                    !iCmpStr(SDL_GetCurrentVideoDriver(), "wayland");
-#else
-    d->isRunningUnderWindowSystem = iTrue;
-#endif
-    d->isDarkSystemTheme = iTrue; /* will be updated by system later on, if supported */
-    init_CommandLine(&d->args, argc, argv);
+static void loadResources_App_(iApp *d) {
     /* Where was the app started from? We ask SDL first because the command line alone 
        cannot be relied on (behavior differs depending on OS). */ {
         char *exec = SDL_GetBasePath();
@@ -744,6 +754,18 @@ static void init_App_(iApp *d, int argc, char **argv) {
             exit(-1);
         }
     }
+}
+
+static void init_App_(iApp *d, int argc, char **argv) {
+#if defined (iPlatformLinux)
+    d->isRunningUnderWindowSystem = !iCmpStr(SDL_GetCurrentVideoDriver(), "x11") ||
+                                    !iCmpStr(SDL_GetCurrentVideoDriver(), "wayland");
+#else
+    d->isRunningUnderWindowSystem = iTrue;
+#endif
+    d->isDarkSystemTheme = iTrue; /* will be updated by system later on, if supported */
+    init_CommandLine(&d->args, argc, argv);
+    loadResources_App_(d);
     init_Lang();
     /* Configure the valid command line options. */ {
         defineValues_CommandLine(&d->args, "close-tab", 0);
@@ -855,11 +877,14 @@ static void init_App_(iApp *d, int argc, char **argv) {
     init_SiteSpec(dataDir_App_());
     setCStr_String(&d->prefs.strings[downloadDir_PrefsString], downloadDir_App_());
     set_Atomic(&d->pendingRefresh, iFalse);
+    set_Atomic(&d->pendingFullRefresh, iTrue);
     d->isRunning = iFalse;
     d->window    = NULL;
     d->mimehooks = new_MimeHooks();
     d->certs     = new_GmCerts(dataDir_App_());
+    d->searchIndex = new_SearchIndex();
     d->visited   = new_Visited();
+    d->contentCache = new_ContentCache();
     d->bookmarks = new_Bookmarks();
     init_Periodic(&d->periodic);
 #if defined (iPlatformAppleDesktop)
@@ -887,7 +912,10 @@ static void init_App_(iApp *d, int argc, char **argv) {
     }
     init_PtrArray(&d->popupWindows);
     d->window = new_MainWindow(d->initialWindowRect);
+    subscribe_Command("feeds.update.started", d, updateFeedsProgress_App_);
+    subscribe_Command("feeds.update.progress", d, updateFeedsProgress_App_);
     load_Visited(d->visited, dataDir_App_());
+    load_ContentCache(d->contentCache, dataDir_App_());
     load_Bookmarks(d->bookmarks, dataDir_App_());
     load_MimeHooks(d->mimehooks, dataDir_App_());
     if (isFirstRun) {
@@ -951,6 +979,7 @@ static void deinit_App(iApp *d) {
     savePrefs_App_(d);
     delete_MainWindow(d->window);
     d->window = NULL;
+    deinit_ImageDecoder();
     deinit_Feeds();
     save_Keys(dataDir_App_());
     deinit_Keys();
@@ -961,6 +990,8 @@ static void deinit_App(iApp *d) {
     delete_Bookmarks(d->bookmarks);
     save_Visited(d->visited, dataDir_App_());
     delete_Visited(d->visited);
+    delete_ContentCache(d->contentCache); /* index saved with state */
+    delete_SearchIndex(d->searchIndex);
     delete_GmCerts(d->certs);
     save_MimeHooks(d->mimehooks);
     delete_MimeHooks(d->mimehooks);
@@ -1060,6 +1091,9 @@ const iString *debugInfo_App(void) {
             total.memorySize += usage.memorySize;
         }
         appendFormat_String(msg, "Total cache: %.3f MB\n", total.cacheSize / 1.0e6f);
+        appendFormat_String(msg, "Disk cache: %.3f MB (%zu entries)\n",
+                            size_ContentCache(d->contentCache) / 1.0e6f,
+                            numEntries_ContentCache(d->contentCache));
         appendFormat_String(msg, "Total memory: %.3f MB\n", total.memorySize / 1.0e6f);
     }
     appendFormat_String(msg, "## Documents\n");
@@ -1090,6 +1124,7 @@ const iString *debugInfo_App(void) {
 }
 
 static void clearCache_App_(void) {
+    /* Note: The disk cache is kept, only the copies held in memory are released. */
     iForEach(ObjectList, i, iClob(listDocuments_App(NULL))) {
         clearCache_History(history_DocumentWidget(i.object));
     }
@@ -1097,29 +1132,7 @@ static void clearCache_App_(void) {
 
 void trimCache_App(void) {
     iApp *d = &app_;
-    size_t cacheSize = 0;
-    const size_t limit = d->prefs.maxCacheSize * 1000000;
-    iObjectList *docs = listDocuments_App(NULL);
-    iForEach(ObjectList, i, docs) {
-        cacheSize += cacheSize_History(history_DocumentWidget(i.object));
-    }
-    init_ObjectListIterator(&i, docs);
-    iBool wasPruned = iFalse;
-    while (cacheSize > limit) {
-        iDocumentWidget *doc = i.object;
-        const size_t pruned = pruneLeastImportant_History(history_DocumentWidget(doc));
-        if (pruned) {
-            cacheSize -= pruned;
-            wasPruned = iTrue;
-        }
-        next_ObjectListIterator(&i);
-        if (!i.value) {
-            if (!wasPruned) break;
-            wasPruned = iFalse;
-            init_ObjectListIterator(&i, docs);
-        }
-    }
-    iRelease(docs);
+    trim_ContentCache(d->contentCache, (size_t) d->prefs.maxCacheSize * 1000000);
 }
 
 void trimMemory_App(void) {
@@ -1370,16 +1383,25 @@ void processEvents_App(enum iAppEventMode eventMode) {
 #endif
                 /* Per-window processing. */
                 iBool wasUsed = iFalse;
-                listWindows_App_(d, &windows);
-                iConstForEach(PtrArray, iter, &windows) {
-                    iWindow *window = iter.ptr;
-                    setCurrent_Window(window);
-                    window->lastHover = window->hover;
-                    wasUsed = processEvent_Window(window, &ev);
-                    if (ev.type == SDL_MOUSEMOTION || ev.type == SDL_MOUSEBUTTONDOWN) {
-                        break;
+                const iBool isCommand =
+                    (ev.type == SDL_USEREVENT && ev.user.code == command_UserEventCode);
+                if (isCommand) {
+                    beginDispatch_Command(ev.user.data1);
+                    /* Commands with subscribers skip the widget tree. */
+                    wasUsed = route_Command(ev.user.data1);
+                }
+                if (!wasUsed) {
+                    listWindows_App_(d, &windows);
+                    iConstForEach(PtrArray, iter, &windows) {
+                        iWindow *window = iter.ptr;
+                        setCurrent_Window(window);
+                        window->lastHover = window->hover;
+                        wasUsed = processEvent_Window(window, &ev);
+                        if (ev.type == SDL_MOUSEMOTION || ev.type == SDL_MOUSEBUTTONDOWN) {
+                            break;
+                        }
+                        if (wasUsed) break;
                     }
-                    if (wasUsed) break;
                 }
                 setCurrent_Window(d->window);
                 if (!wasUsed) {
@@ -1396,7 +1418,7 @@ void processEvents_App(enum iAppEventMode eventMode) {
                         wasUsed = iTrue;
                     }
                 }
-                if (ev.type == SDL_USEREVENT && ev.user.code == command_UserEventCode) {
+                if (isCommand) {
 #if defined (iPlatformAppleDesktop)
                     handleCommand_MacOS(command_UserEvent(&ev));
 #endif
@@ -1420,6 +1442,7 @@ void processEvents_App(enum iAppEventMode eventMode) {
                         setCurrent_Window(d->window);
                         handleCommand_App(ev.user.data1);
                     }
+                    endDispatch_Command();
                     /* Allocated by postCommand_Apps(). */
                     free(ev.user.data1);
                 }
@@ -1542,10 +1565,14 @@ void refresh_App(void) {
     }
     /* TODO: `pendingRefresh` should be window-specific. */
     if (exchange_Atomic(&d->pendingRefresh, iFalse)) {
+        const iBool isFull = exchange_Atomic(&d->pendingFullRefresh, iFalse);
         /* Draw each window. */
         iConstForEach(PtrArray, j, &windows) {
             iWindow *win = j.ptr;
             setCurrent_Window(win);
+            if (isFull) {
+                damageAll_Window(win);
+            }
             switch (win->type) {
                 case main_WindowType:
     //                iTime draw;
@@ -1624,7 +1651,58 @@ int run_App(int argc, char **argv) {
     return rc;
 }
 
+void initHeadless_App(int argc, char **argv) {
+    /* Only the state needed for loading and laying out documents is set up. There is no
+       user interface, and the runtime files in the data directory are not touched. */
+    iApp *d = &app_;
+    d->isRunningUnderWindowSystem = iFalse;
+    d->isDarkSystemTheme          = iTrue;
+    init_CommandLine(&d->args, argc, argv);
+    loadResources_App_(d);
+    init_Lang();
+    d->isFinishedLaunching  = iFalse;
+    d->launchCommands       = new_StringList();
+    d->forceSoftwareRender  = iTrue;
+    d->window               = NULL;
+    init_SortedArray(&d->tickers, sizeof(iTicker), cmp_Ticker_);
+    init_PtrArray(&d->popupWindows);
+    init_Prefs(&d->prefs);
+    set_Atomic(&d->pendingRefresh, iFalse);
+    set_Atomic(&d->pendingFullRefresh, iTrue);
+    d->mimehooks   = new_MimeHooks();
+    d->searchIndex = new_SearchIndex();
+    d->visited     = new_Visited();
+    d->bookmarks   = new_Bookmarks();
+    init_Fonts(dataDir_App_());
+    loadPalette_Color(dataDir_App_());
+    setThemePalette_Color(d->prefs.theme);
+    updateActive_Fonts();
+}
+
+void deinitHeadless_App(void) {
+    iApp *d = &app_;
+    deinit_ImageDecoder();
+    deinit_Fonts();
+    delete_Bookmarks(d->bookmarks);
+    delete_Visited(d->visited);
+    delete_SearchIndex(d->searchIndex);
+    delete_MimeHooks(d->mimehooks);
+    deinit_Prefs(&d->prefs);
+    deinit_PtrArray(&d->popupWindows);
+    deinit_SortedArray(&d->tickers);
+    iRelease(d->launchCommands);
+    deinit_CommandLine(&d->args);
+    delete_String(d->execPath);
+    deinit_Lang();
+    iRecycle();
+}
+
 void postRefresh_App(void) {
+    set_Atomic(&app_.pendingFullRefresh, iTrue);
+    postPartialRefresh_App();
+}
+
+void postPartialRefresh_App(void) {
     iApp *d = &app_;
 #if defined (LAGRANGE_ENABLE_IDLE_SLEEP)
     d->isIdling = iFalse;
@@ -1776,6 +1854,14 @@ iVisited *visited_App(void) {
     return app_.visited;
 }
 
+iContentCache *contentCache_App(void) {
+    return app_.contentCache;
+}
+
+iSearchIndex *searchIndex_App(void) {
+    return app_.searchIndex;
+}
+
 iBookmarks *bookmarks_App(void) {
     return app_.bookmarks;
 }
@@ -2151,6 +2237,28 @@ static void invalidateCachedDocuments_App_(void) {
     }
 }
 
+static iBool updateFeedsProgress_App_(iAnyObject *context, const char *cmd) {
+    /* Routed here directly; progress updates are frequent during a refresh. */
+    iUnused(context);
+    iRoot *oldRoot = current_Root();
+    setCurrent_Window(app_.window);
+    setCurrent_Root(get_Window()->roots[0]);
+    const iWidget *navBar = findChild_Widget(get_Window()->roots[0]->widget, "navbar");
+    iAnyObject *prog = findChild_Widget(navBar, "feeds.progress");
+    const int num   = arg_Command(cmd);
+    const int total = argLabel_Command(cmd, "total");
+    updateTextAndResizeWidthCStr_LabelWidget(prog,
+                                             flags_Widget(navBar) & tight_WidgetFlag ||
+                                                     deviceType_App() == phone_AppDeviceType
+                                                 ? star_Icon
+                                                 : star_Icon " ${status.feeds}");
+    showCollapsed_Widget(prog, iTrue);
+    setFixedSize_Widget(findChild_Widget(prog, "feeds.progressbar"),
+                        init_I2(total ? width_Widget(prog) * num / total : 0, -1));
+    setCurrent_Root(oldRoot);
+    return iTrue;
+}
+
 iBool handleCommand_App(const char *cmd) {
     iApp *d = &app_;
     const iBool isFrozen = !d->window || d->window->isDrawFrozen;
@@ -2590,6 +2698,7 @@ iBool handleCommand_App(const char *cmd) {
         if (d->prefs.maxCacheSize <= 0) {
             d->prefs.maxCacheSize = 0;
         }
+        trimCache_App();
         return iTrue;
     }
     else if (equal_Command(cmd, "memorysize.set")) {
@@ -3076,28 +3185,11 @@ iBool handleCommand_App(const char *cmd) {
         refresh_Feeds();
         return iTrue;
     }
-    else if (startsWith_CStr(cmd, "feeds.update.")) {
+    else if (equal_Command(cmd, "feeds.update.finished")) {
         const iWidget *navBar = findChild_Widget(get_Window()->roots[0]->widget, "navbar");
-        iAnyObject *prog = findChild_Widget(navBar, "feeds.progress");
-        if (equal_Command(cmd, "feeds.update.started") ||
-            equal_Command(cmd, "feeds.update.progress")) {
-            const int num   = arg_Command(cmd);
-            const int total = argLabel_Command(cmd, "total");
-            updateTextAndResizeWidthCStr_LabelWidget(prog,
-                                                     flags_Widget(navBar) & tight_WidgetFlag ||
-                                                             deviceType_App() == phone_AppDeviceType
-                                                         ? star_Icon
-                                                         : star_Icon " ${status.feeds}");
-            showCollapsed_Widget(prog, iTrue);
-            setFixedSize_Widget(findChild_Widget(prog, "feeds.progressbar"),
-                                init_I2(total ? width_Widget(prog) * num / total : 0, -1));
-        }
-        else if (equal_Command(cmd, "feeds.update.finished")) {
-            showCollapsed_Widget(prog, iFalse);
-            refreshFinished_Feeds();
-            refresh_Widget(findWidget_App("url"));
-            return iFalse;
-        }
+        showCollapsed_Widget(findChild_Widget(navBar, "feeds.progress"), iFalse);
+        refreshFinished_Feeds();
+        refresh_Widget(findWidget_App("url"));
         return iFalse;
     }
     else if (equal_Command(cmd, "visited.changed")) {
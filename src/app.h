@@ -31,12 +31,14 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "ui/color.h"
 
 iDeclareType(Bookmarks)
+iDeclareType(ContentCache)
 iDeclareType(DocumentWidget)
 iDeclareType(GmCerts)
 iDeclareType(MainWindow)
 iDeclareType(MimeHooks)
 iDeclareType(Periodic)
 iDeclareType(Root)
+iDeclareType(SearchIndex)
 iDeclareType(Visited)
 iDeclareType(Window)
 
@@ -74,6 +76,8 @@ const iString *downloadDir_App  (void);
 const iString *debugInfo_App    (void);
 
 int         run_App                     (int argc, char **argv);
+void        initHeadless_App            (int argc, char **argv); /* no UI; see bench.c */
+void        deinitHeadless_App          (void);
 void        rootOrder_App               (iRoot *roots[2]); /* TODO: max roots? */
 void        processEvents_App           (enum iAppEventMode mode);
 iBool       handleCommand_App           (const char *cmd);
@@ -90,6 +94,8 @@ iBool               isRunningUnderWindowSystem_App  (void);
 
 iGmCerts *          certs_App           (void);
 iVisited *          visited_App         (void);
+iContentCache *     contentCache_App    (void);
+iSearchIndex *      searchIndex_App     (void);
 iBookmarks *        bookmarks_App       (void);
 iMimeHooks *        mimeHooks_App       (void);
 iPeriodic *         periodic_App        (void);
@@ -121,6 +127,7 @@ void        removeTicker_App    (iTickerFunc ticker, iAny *context);
 void        addPopup_App        (iWindow *popup);
 void        removePopup_App     (iWindow *popup);
 void        postRefresh_App     (void);
+void        postPartialRefresh_App  (void); /* redraw only damaged areas of windows */
 void        postCommand_Root    (iRoot *, const char *command);
 void        postCommandf_Root   (iRoot *, const char *command, ...);
 void        postCommandf_App    (const char *command, ...);
@@ -0,0 +1,272 @@
+/* Copyright 2022 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+/* Headless benchmark of document parsing and layout. Documents are laid out with the
+   same code as in the app, but the window is never shown: SDL's dummy video driver and
+   the software renderer are used, so a display or a GPU is not required.
+
+   Usage: lagrange-bench [--width PX] [--iterations N] FILE|DIR...
+
+   The source format is chosen by file extension: .gmi/.gemini (Gemtext), .md (Markdown),
+   .gophermap/.gopher (Gopher menu), and anything else as plain text. */
+
+#include "app.h"
+#include "gmdocument.h"
+#include "gmutil.h"
+#include "gopher.h"
+#include "ui/root.h"
+#include "ui/text.h"
+#include "ui/util.h"
+#include "ui/widget.h"
+#include "ui/window.h"
+
+#include <the_Foundation/commandline.h>
+#include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
+#include <the_Foundation/path.h>
+#include <the_Foundation/ptrarray.h>
+#include <SDL.h>
+#include <stdio.h>
+
+enum iBenchFormat {
+    gemtext_BenchFormat,
+    plainText_BenchFormat,
+    markdown_BenchFormat,
+    gopher_BenchFormat,
+    max_BenchFormat
+};
+
+static const char *formatNames_[max_BenchFormat] = { "gemtext", "text", "markdown", "gopher" };
+
+iDeclareType(BenchResult)
+
+struct Impl_BenchResult {
+    uint64_t parse;     /* μs, format conversion to Gemtext */
+    uint64_t normalize; /* μs, setting the source without the layout */
+    uint64_t layout;    /* μs */
+    uint64_t render;    /* μs, walking all runs */
+    size_t   numRuns;
+    size_t   memory;    /* bytes */
+};
+
+static enum iBenchFormat format_Bench_(const iString *path) {
+    if (endsWithCase_String(path, ".gmi") || endsWithCase_String(path, ".gemini")) {
+        return gemtext_BenchFormat;
+    }
+    if (endsWithCase_String(path, ".md") || endsWithCase_String(path, ".markdown")) {
+        return markdown_BenchFormat;
+    }
+    if (endsWithCase_String(path, ".gophermap") || endsWithCase_String(path, ".gopher")) {
+        return gopher_BenchFormat;
+    }
+    return plainText_BenchFormat;
+}
+
+static iString *gemtextFromGopher_Bench_(const iBlock *menu) {
+    iGopher gopher;
+    init_Gopher(&gopher);
+    gopher.type   = '1';
+    gopher.output = new_Block(0);
+    processResponse_Gopher(&gopher, menu);
+    if (!isEmpty_Block(menu) && constData_Block(menu)[size_Block(menu) - 1] != '\n') {
+        processResponse_Gopher(&gopher, collect_Block(newCStr_Block("\n")));
+    }
+    if (gopher.isPre) {
+        appendCStr_Block(gopher.output, "```\n");
+    }
+    iString *gemtext = newBlock_String(gopher.output);
+    delete_Block(gopher.output);
+    deinit_Gopher(&gopher);
+    return gemtext;
+}
+
+static void countRun_Bench_(void *context, const iGmRun *run) {
+    iUnused(run);
+    (*(size_t *) context)++;
+}
+
+static void run_Bench_(const iString *path, enum iBenchFormat format, const iBlock *data,
+                       int width, int iterations, iBenchResult *best) {
+    /* Markdown is only converted to Gemtext for local files. */
+    const iString *url = collect_String(makeFileUrl_String(path));
+    for (int iter = 0; iter < iterations; iter++) {
+        iBenchResult result;
+        iZap(result);
+        iPerfTimer timer;
+        iGmDocument *doc = new_GmDocument();
+        setUrl_GmDocument(doc, url);
+        setFormat_GmDocument(doc,
+                             format == plainText_BenchFormat ? plainText_SourceFormat
+                             : format == markdown_BenchFormat ? markdown_SourceFormat
+                                                              : gemini_SourceFormat);
+        setThemeSeed_GmDocument(doc, collect_Block(new_Block(0)));
+        init_PerfTimer(&timer);
+        const iString *source = format == gopher_BenchFormat
+                                    ? collect_String(gemtextFromGopher_Bench_(data))
+                                    : collect_String(newBlock_String(data));
+        result.parse = elapsedMicroseconds_PerfTimer(&timer);
+        /* Without a width, setting the source does not lay it out. */
+        init_PerfTimer(&timer);
+        setSource_GmDocument(doc, source, 0, 0, final_GmDocumentUpdate);
+        result.normalize = elapsedMicroseconds_PerfTimer(&timer);
+        /* Shaped runs from previous iterations would make the layout look faster than when
+           a page is first opened. */
+        clearShapeCache_Text();
+        init_PerfTimer(&timer);
+        setWidth_GmDocument(doc, width, width);
+        result.layout = elapsedMicroseconds_PerfTimer(&timer);
+        init_PerfTimer(&timer);
+        render_GmDocument(doc, (iRangei){ 0, size_GmDocument(doc).y }, countRun_Bench_,
+                          &result.numRuns);
+        result.render = elapsedMicroseconds_PerfTimer(&timer);
+        result.memory = memorySize_GmDocument(doc);
+        iRelease(doc);
+        if (iter == 0) {
+            *best = result;
+        }
+        else {
+            best->parse     = iMin(best->parse, result.parse);
+            best->normalize = iMin(best->normalize, result.normalize);
+            best->layout    = iMin(best->layout, result.layout);
+            best->render    = iMin(best->render, result.render);
+        }
+        recycle_Garbage();
+    }
+}
+
+static void addPath_Bench_(iPtrArray *paths, const iString *path) {
+    if (fileExists_FileInfo(path) && !isDirectory_FileInfo(iClob(new_FileInfo(path)))) {
+        pushBack_PtrArray(paths, copy_String(path));
+        return;
+    }
+    iForEach(DirFileInfo, i, iClob(directoryContents_FileInfo(iClob(new_FileInfo(path))))) {
+        addPath_Bench_(paths, path_FileInfo(i.value));
+    }
+}
+
+int main(int argc, char **argv) {
+    init_Foundation();
+    /* No display is needed. */
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+    if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER)) {
+        fprintf(stderr, "[SDL] init failed: %s\n", SDL_GetError());
+        return -1;
+    }
+    iCommandLine args;
+    init_CommandLine(&args, argc, argv);
+    defineValues_CommandLine(&args, "width;w", 1);
+    defineValues_CommandLine(&args, "iterations;n", 1);
+    int width      = 800;
+    int iterations = 10;
+    iPtrArray *paths = new_PtrArray();
+    iConstForEach(CommandLine, i, &args) {
+        if (i.argType == value_CommandLineArgType) {
+            addPath_Bench_(paths, collectNewRange_String(i.entry));
+        }
+        else if (equal_CommandLineConstIterator(&i, "width;w")) {
+            const iCommandLineArg *arg = iClob(argument_CommandLineConstIterator(&i));
+            width = iMax(100, toInt_String(value_CommandLineArg(arg, 0)));
+        }
+        else if (equal_CommandLineConstIterator(&i, "iterations;n")) {
+            const iCommandLineArg *arg = iClob(argument_CommandLineConstIterator(&i));
+            iterations = iMax(1, toInt_String(value_CommandLineArg(arg, 0)));
+        }
+    }
+    if (isEmpty_PtrArray(paths)) {
+        fprintf(stderr, "Usage: %s [--width PX] [--iterations N] FILE|DIR...\n", argv[0]);
+        return 1;
+    }
+    initHeadless_App(argc, argv);
+    /* Documents are laid out in a hidden window with a bare root widget. */
+    iWindow *win  = new_Window(main_WindowType, init_Rect(0, 0, width, 600), 0);
+    iRoot   *root = new_Root();
+    root->window  = win;
+    win->roots[0] = root;
+    win->keyRoot  = root;
+    setCurrent_Window(win);
+    root->widget = new_Widget();
+    root->widget->rect = (iRect){ zero_I2(), win->size };
+    /* Timings are the best of all iterations, in microseconds. */
+    iBenchResult totals[max_BenchFormat];
+    size_t       counts[max_BenchFormat];
+    iZap(totals);
+    iZap(counts);
+    printf("%-8s %10s %8s %9s %8s %8s %8s %10s  %s\n",
+           "format", "bytes", "parse", "normalize", "layout", "render", "runs", "memory", "file");
+    iConstForEach(PtrArray, i, paths) {
+        const iString *path = i.ptr;
+        iFile *f = iClob(new_File(path));
+        if (!open_File(f, readOnly_FileMode)) {
+            fprintf(stderr, "%s: cannot open\n", cstr_String(path));
+            continue;
+        }
+        const iBlock *data = collect_Block(readAll_File(f));
+        close_File(f);
+        const enum iBenchFormat format = format_Bench_(path);
+        iBenchResult result;
+        run_Bench_(path, format, data, width, iterations, &result);
+        printf("%-8s %10zu %8llu %9llu %8llu %8llu %8zu %10zu  %s\n",
+               formatNames_[format],
+               size_Block(data),
+               (unsigned long long) result.parse,
+               (unsigned long long) result.normalize,
+               (unsigned long long) result.layout,
+               (unsigned long long) result.render,
+               result.numRuns,
+               result.memory,
+               cstr_String(path));
+        iBenchResult *total = &totals[format];
+        total->parse     += result.parse;
+        total->normalize += result.normalize;
+        total->layout    += result.layout;
+        total->render    += result.render;
+        total->numRuns   += result.numRuns;
+        total->memory    += result.memory;
+        counts[format]++;
+    }
+    printf("\n%-8s %10s %8s %9s %8s %8s %8s %10s\n",
+           "format", "files", "parse", "normalize", "layout", "render", "runs", "memory");
+    for (int i = 0; i < max_BenchFormat; i++) {
+        if (counts[i]) {
+            printf("%-8s %10zu %8llu %9llu %8llu %8llu %8zu %10zu\n",
+                   formatNames_[i],
+                   counts[i],
+                   (unsigned long long) totals[i].parse,
+                   (unsigned long long) totals[i].normalize,
+                   (unsigned long long) totals[i].layout,
+                   (unsigned long long) totals[i].render,
+                   totals[i].numRuns,
+                   totals[i].memory);
+        }
+    }
+    iForEach(PtrArray, j, paths) {
+        delete_String(j.ptr);
+    }
+    delete_PtrArray(paths);
+    delete_Window(win); /* deletes the root */
+    setCurrent_Window(NULL);
+    deinitHeadless_App();
+    deinit_CommandLine(&args);
+    SDL_Quit();
+    deinit_Foundation();
+    return 0;
+}
@@ -24,6 +24,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "visited.h"
 #include "gmrequest.h"
 #include "app.h"
+#include "searchindex.h"
 
 #include <the_Foundation/file.h>
 #include <the_Foundation/hash.h>
@@ -130,6 +131,27 @@ void clear_Bookmarks(iBookmarks *d) {
     clear_Hash(&d->bookmarks);
     d->idEnum = 0;
     unlock_Mutex(d->mtx);
+    clear_SearchIndex(searchIndex_App(), bookmark_SearchIndexType);
+}
+
+static const iString *indexKey_Bookmark_(uint32_t id) {
+    return collectNewFormat_String("%x", id);
+}
+
+static void index_Bookmark_(const iBookmark *d) {
+    if (isFolder_Bookmark(d)) {
+        return; /* not looked up */
+    }
+    iString *text = new_String();
+    format_String(text, "%s %s %s", cstr_String(&d->title), cstr_String(&d->url),
+                  cstr_String(&d->tags));
+    set_SearchIndex(searchIndex_App(), bookmark_SearchIndexType, indexKey_Bookmark_(id_Bookmark(d)),
+                    range_String(text));
+    delete_String(text);
+}
+
+static void unindex_Bookmark_(const iBookmark *d) {
+    remove_SearchIndex(searchIndex_App(), bookmark_SearchIndexType, indexKey_Bookmark_(id_Bookmark(d)));
 }
 
 static void insertId_Bookmarks_(iBookmarks *d, iBookmark *bookmark, int id) {
@@ -141,6 +163,7 @@ static void insert_Bookmarks_(iBookmarks *d, iBookmark *bookmark) {
     lock_Mutex(d->mtx);
     insertId_Bookmarks_(d, bookmark, ++d->idEnum);
     unlock_Mutex(d->mtx);
+    index_Bookmark_(bookmark);
 }
 
 static void loadOldFormat_Bookmarks(iBookmarks *d, const char *dirPath) {
@@ -202,6 +225,9 @@ static void handleTable_BookmarkLoader_(void *context, const iString *table, iBo
         insertId_Bookmarks_(d->bookmarks, d->bm, id);
     }
     else {
+        if (d->bm) {
+            index_Bookmark_(d->bm); /* all values have been read */
+        }
         d->bm = NULL;
     }
 }
@@ -383,14 +409,24 @@ iBool remove_Bookmarks(iBookmarks *d, uint32_t id) {
     if (bm) {
         /* Remove all the contained bookmarks as well. */
         iConstForEach(PtrArray, i, list_Bookmarks(d, NULL, filterInsideFolder_Bookmark, bm)) {
+            unindex_Bookmark_(i.ptr);
             delete_Bookmark((iBookmark *) remove_Hash(&d->bookmarks, id_Bookmark(i.ptr)));
         }
+        unindex_Bookmark_(bm);
         delete_Bookmark(bm);
     }
     unlock_Mutex(d->mtx);
     return bm != NULL;
 }
 
+void reindex_Bookmarks(iBookmarks *d, uint32_t id) {
+    const iBookmark *bm = get_Bookmarks(d, id);
+    if (bm) {
+        unindex_Bookmark_(bm); /* may have become a folder */
+        index_Bookmark_(bm);
+    }
+}
+
 iBool updateBookmarkIcon_Bookmarks(iBookmarks *d, const iString *url, iChar icon) {
     iBool changed = iFalse;
     lock_Mutex(d->mtx);
@@ -692,6 +728,7 @@ void fetchRemote_Bookmarks(iBookmarks *d) {
             iBookmark *bm = (iBookmark *) i.value;
             if (hasTag_Bookmark(bm, remote_BookmarkTag)) {
                 remove_HashIterator(&i);
+                unindex_Bookmark_(bm);
                 delete_Bookmark(bm);
                 numRemoved++;
             }
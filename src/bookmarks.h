@@ -98,6 +98,7 @@ uint32_t    add_Bookmarks               (iBookmarks *, const iString *url, const
                                          const iString *tags, iChar icon);
 iBool       remove_Bookmarks            (iBookmarks *, uint32_t id);
 iBookmark * get_Bookmarks               (iBookmarks *, uint32_t id);
+void        reindex_Bookmarks           (iBookmarks *, uint32_t id); /* after editing */
 void        reorder_Bookmarks           (iBookmarks *, uint32_t id, int newOrder);
 iBool       updateBookmarkIcon_Bookmarks(iBookmarks *, const iString *url, iChar icon);
 void        setRecentFolder_Bookmarks   (iBookmarks *, uint32_t folderId);
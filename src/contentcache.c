@@ -0,0 +1,629 @@
+/* Copyright 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "contentcache.h"
+#include "app.h"
+#include "defs.h"
+#include "searchindex.h"
+
+#include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
+#include <the_Foundation/garbage.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/path.h>
+#include <the_Foundation/ptrarray.h>
+#include <the_Foundation/sortedarray.h>
+#include <the_Foundation/stringlist.h>
+#include <the_Foundation/thread.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+static const char *dirName_ContentCache_       = "cache";
+static const char *indexFileName_ContentCache_ = "index.txt";
+
+iDeclareType(CachedContent)
+iDeclareType(CacheJob)
+
+struct Impl_CachedContent {
+    iString  url;
+    uint64_t fileId;   /* hash of the URL; the next free one if another URL has it */
+    uint64_t lastUsed; /* seconds */
+    size_t   size;
+};
+
+static int cmpUrl_CachedContent_(const void *a, const void *b) {
+    return cmpString_String(&((const iCachedContent *) a)->url,
+                            &((const iCachedContent *) b)->url);
+}
+
+static int cmpUint64_(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *) a;
+    const uint64_t y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static uint64_t urlHash_(const iString *url) {
+    /* FNV-1a */
+    uint64_t hash = 0xcbf29ce484222325ull;
+    for (const char *ch = constBegin_String(url); ch != constEnd_String(url); ch++) {
+        hash ^= (uint8_t) *ch;
+        hash *= 0x100000001b3ull;
+    }
+    return hash;
+}
+
+static uint64_t now_(void) {
+    iTime now;
+    initCurrent_Time(&now);
+    return integralSeconds_Time(&now);
+}
+
+/* Files are written and their contents indexed on a worker thread, so storing a response
+   only costs a copy on the calling thread. */
+
+struct Impl_CacheJob {
+    iString      url;
+    uint64_t     fileId;
+    iGmResponse *resp; /* to be written; NULL if the existing file only needs indexing */
+};
+
+static iCacheJob *new_CacheJob_(const iString *url, uint64_t fileId, iGmResponse *resp) {
+    iCacheJob *d = iMalloc(CacheJob);
+    initCopy_String(&d->url, url);
+    d->fileId = fileId;
+    d->resp   = resp;
+    return d;
+}
+
+static void delete_CacheJob_(iCacheJob *d) {
+    deinit_String(&d->url);
+    if (d->resp) {
+        delete_GmResponse(d->resp);
+    }
+    free(d);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+struct Impl_ContentCache {
+    iMutex *     mtx;
+    iString      dir;       /* empty if not loaded */
+    iSortedArray entries;   /* sorted by URL */
+    iSortedArray fileIds;   /* uint64_t; files owned by entries */
+    size_t       totalSize;
+    iCondition   jobsAvailable;
+    iPtrArray    jobs;
+    iCacheJob *  currentJob; /* being processed by the writer */
+    iThread *    writer;
+    iBool        isWriterQuitting;
+};
+
+iDefineTypeConstruction(ContentCache)
+
+void init_ContentCache(iContentCache *d) {
+    d->mtx = new_Mutex();
+    init_String(&d->dir);
+    init_SortedArray(&d->entries, sizeof(iCachedContent), cmpUrl_CachedContent_);
+    init_SortedArray(&d->fileIds, sizeof(uint64_t), cmpUint64_);
+    d->totalSize = 0;
+    init_Condition(&d->jobsAvailable);
+    init_PtrArray(&d->jobs);
+    d->currentJob       = NULL;
+    d->writer           = NULL;
+    d->isWriterQuitting = iFalse;
+}
+
+static void stopWriter_ContentCache_(iContentCache *d) {
+    if (d->writer) {
+        iGuardMutex(d->mtx, {
+            /* Pending writes are finished, but indexing can be redone next time. */
+            for (size_t i = 0; i < size_PtrArray(&d->jobs); ) {
+                iCacheJob *job = at_PtrArray(&d->jobs, i);
+                if (!job->resp) {
+                    remove_Array(&d->jobs, i);
+                    delete_CacheJob_(job);
+                }
+                else i++;
+            }
+            d->isWriterQuitting = iTrue;
+            signal_Condition(&d->jobsAvailable);
+        });
+        join_Thread(d->writer);
+        iReleasePtr(&d->writer);
+        d->isWriterQuitting = iFalse;
+    }
+}
+
+static void clearEntries_ContentCache_(iContentCache *d) {
+    iForEach(Array, i, &d->entries.values) {
+        deinit_String(&((iCachedContent *) i.value)->url);
+    }
+    clear_SortedArray(&d->entries);
+    clear_SortedArray(&d->fileIds);
+    d->totalSize = 0;
+}
+
+void deinit_ContentCache(iContentCache *d) {
+    stopWriter_ContentCache_(d);
+    iGuardMutex(d->mtx, {
+        clearEntries_ContentCache_(d);
+        deinit_SortedArray(&d->fileIds);
+        deinit_SortedArray(&d->entries);
+    });
+    iAssert(isEmpty_PtrArray(&d->jobs));
+    deinit_PtrArray(&d->jobs);
+    deinit_Condition(&d->jobsAvailable);
+    deinit_String(&d->dir);
+    delete_Mutex(d->mtx);
+}
+
+static const char *entryFileName_(uint64_t fileId) {
+    return format_CStr("%016llx.lgr", (unsigned long long) fileId);
+}
+
+static const char *entryPath_ContentCache_(const iContentCache *d, uint64_t fileId) {
+    return concatPath_CStr(cstr_String(&d->dir), entryFileName_(fileId));
+}
+
+static size_t find_ContentCache_(const iContentCache *d, const iString *url) {
+    size_t pos;
+    if (locate_SortedArray(&d->entries, &(iCachedContent){ .url = *url }, &pos)) {
+        return pos;
+    }
+    return iInvalidPos;
+}
+
+static iBool isUsedFileId_ContentCache_(const iContentCache *d, uint64_t fileId) {
+    size_t pos;
+    return locate_SortedArray(&d->fileIds, &fileId, &pos);
+}
+
+static uint64_t newFileId_ContentCache_(const iContentCache *d, const iString *url) {
+    /* Colliding hashes are resolved by probing forward. */
+    uint64_t fileId = urlHash_(url);
+    while (isUsedFileId_ContentCache_(d, fileId)) {
+        fileId++;
+    }
+    return fileId;
+}
+
+static iCacheJob *findJob_ContentCache_(const iContentCache *d, const iString *url,
+                                         size_t *pos_out) {
+    /* Returns the latest pending write of the URL. */
+    for (size_t i = size_PtrArray(&d->jobs); i-- > 0; ) {
+        iCacheJob *job = (iCacheJob *) constAt_PtrArray(&d->jobs, i);
+        if (job->resp && equal_String(&job->url, url)) {
+            if (pos_out) *pos_out = i;
+            return job;
+        }
+    }
+    if (pos_out) *pos_out = iInvalidPos;
+    if (d->currentJob && d->currentJob->resp && equal_String(&d->currentJob->url, url)) {
+        return d->currentJob;
+    }
+    return NULL;
+}
+
+static void removeJobs_ContentCache_(iContentCache *d, const iString *url) {
+    for (size_t i = 0; i < size_PtrArray(&d->jobs); ) {
+        iCacheJob *job = at_PtrArray(&d->jobs, i);
+        if (equal_String(&job->url, url)) {
+            remove_Array(&d->jobs, i);
+            delete_CacheJob_(job);
+        }
+        else i++;
+    }
+}
+
+static void removeAt_ContentCache_(iContentCache *d, size_t pos, iBool removeFile) {
+    iCachedContent *entry = at_SortedArray(&d->entries, pos);
+    /* If the writer is busy with this entry, it removes the file when done. */
+    removeJobs_ContentCache_(d, &entry->url);
+    if (removeFile) {
+        remove(entryPath_ContentCache_(d, entry->fileId));
+    }
+    d->totalSize -= entry->size;
+    remove_SortedArray(&d->fileIds, &entry->fileId);
+    remove_SearchIndex(searchIndex_App(), content_SearchIndexType, &entry->url);
+    deinit_String(&entry->url);
+    remove_Array(&d->entries.values, pos);
+}
+
+static void index_ContentCache_(const iString *url, const iGmResponse *resp) {
+    /* Page contents are found via the search index. */
+    if (category_GmStatusCode(resp->statusCode) == categorySuccess_GmStatusCode &&
+        indexOfCStrSc_String(&resp->meta, "text/", &iCaseInsensitive) != iInvalidPos) {
+        set_SearchIndex(searchIndex_App(), content_SearchIndexType, url, range_Block(&resp->body));
+    }
+    else {
+        remove_SearchIndex(searchIndex_App(), content_SearchIndexType, url);
+    }
+}
+
+static iBool readHeader_ContentCache_(iFile *f, iString *url_out) {
+    setVersion_Stream(stream_File(f), readU32_File(f));
+    deserialize_String(url_out, stream_File(f));
+    return !atEnd_File(f) && !isEmpty_String(url_out);
+}
+
+static iGmResponse *readFile_ContentCache_(const iContentCache *d, uint64_t fileId,
+                                           const iString *url) {
+    /* Returns NULL if the file is missing or belongs to another URL. */
+    iGmResponse *resp = NULL;
+    iFile *f = newCStr_File(entryPath_ContentCache_(d, fileId));
+    if (open_File(f, readOnly_FileMode)) {
+        iString *storedUrl = new_String();
+        if (readHeader_ContentCache_(f, storedUrl) && equal_String(storedUrl, url)) {
+            resp = new_GmResponse();
+            deserialize_GmResponse(resp, stream_File(f));
+        }
+        delete_String(storedUrl);
+    }
+    iRelease(f);
+    return resp;
+}
+
+static iBool writeFile_ContentCache_(const iContentCache *d, uint64_t fileId,
+                                     const iString *url, const iGmResponse *resp) {
+    /* Renamed when complete, so a crash cannot leave a partial entry behind. */
+    iBool ok = iFalse;
+    const iString *path = collectNewCStr_String(entryPath_ContentCache_(d, fileId));
+    const iString *temp = collectNewFormat_String("%s.tmp", cstr_String(path));
+    iFile *f = new_File(temp);
+    if (open_File(f, writeOnly_FileMode)) {
+        writeU32_File(f, latest_FileVersion);
+        serialize_String(url, stream_File(f));
+        serialize_GmResponse(resp, stream_File(f));
+        close_File(f);
+        ok = (rename(cstr_String(temp), cstr_String(path)) == 0);
+    }
+    iRelease(f);
+    if (!ok) {
+        remove(cstr_String(temp));
+    }
+    return ok;
+}
+
+static iThreadResult writer_ContentCache_(iThread *thread) {
+    iContentCache *d = userData_Thread(thread);
+    lock_Mutex(d->mtx);
+    while (!d->isWriterQuitting || !isEmpty_PtrArray(&d->jobs)) {
+        if (isEmpty_PtrArray(&d->jobs)) {
+            wait_Condition(&d->jobsAvailable, d->mtx);
+            continue;
+        }
+        iCacheJob *job;
+        take_PtrArray(&d->jobs, 0, (void **) &job);
+        d->currentJob = job;
+        unlock_Mutex(d->mtx);
+        iBool ok = iTrue;
+        if (job->resp) {
+            ok = writeFile_ContentCache_(d, job->fileId, &job->url, job->resp);
+            if (ok) {
+                index_ContentCache_(&job->url, job->resp);
+            }
+        }
+        else {
+            iGmResponse *resp = readFile_ContentCache_(d, job->fileId, &job->url);
+            if (resp) {
+                index_ContentCache_(&job->url, resp);
+                delete_GmResponse(resp);
+            }
+        }
+        lock_Mutex(d->mtx);
+        d->currentJob = NULL;
+        /* The entry may have been removed in the meantime. */
+        const size_t pos = find_ContentCache_(d, &job->url);
+        const iCachedContent *entry = (pos != iInvalidPos ? at_SortedArray(&d->entries, pos)
+                                                            : NULL);
+        if (!entry || entry->fileId != job->fileId) {
+            if (job->resp) {
+                remove(entryPath_ContentCache_(d, job->fileId));
+            }
+            if (!entry) {
+                remove_SearchIndex(searchIndex_App(), content_SearchIndexType, &job->url);
+            }
+        }
+        else if (!ok && !findJob_ContentCache_(d, &job->url, NULL)) {
+            removeAt_ContentCache_(d, pos, iTrue);
+        }
+        delete_CacheJob_(job);
+        recycle_Garbage(); /* paths are collected */
+    }
+    unlock_Mutex(d->mtx);
+    return 0;
+}
+
+static void submit_ContentCache_(iContentCache *d, iCacheJob *job) {
+    /* Mutex must be locked. */
+    if (!d->writer) {
+        d->writer = new_Thread(writer_ContentCache_);
+        setUserData_Thread(d->writer, d);
+        start_Thread(d->writer);
+    }
+    pushBack_PtrArray(&d->jobs, job);
+    signal_Condition(&d->jobsAvailable);
+}
+
+static iBool parseIndexLine_(iRangecc line, iCachedContent *entry) {
+    /* "lastUsed size fileId url" */
+    char *endp = NULL;
+    entry->lastUsed = strtoull(line.start, &endp, 10);
+    entry->size     = strtoull(skipSpace_CStr(endp), &endp, 10);
+    const char *idStart = skipSpace_CStr(endp);
+    entry->fileId   = strtoull(idStart, &endp, 16);
+    const char *urlStart = skipSpace_CStr(endp);
+    if (entry->lastUsed == 0 || endp - idStart != 16 || urlStart == endp ||
+        urlStart >= line.end) {
+        return iFalse;
+    }
+    initRange_String(&entry->url, (iRangecc){ urlStart, line.end });
+    return iTrue;
+}
+
+static iBool insert_ContentCache_(iContentCache *d, iCachedContent *entry) {
+    /* Takes ownership of the entry's URL. */
+    if (isUsedFileId_ContentCache_(d, entry->fileId) ||
+        find_ContentCache_(d, &entry->url) != iInvalidPos) {
+        deinit_String(&entry->url);
+        return iFalse;
+    }
+    insert_SortedArray(&d->fileIds, &entry->fileId);
+    insert_SortedArray(&d->entries, entry);
+    d->totalSize += entry->size;
+    return iTrue;
+}
+
+static void recoverUnindexedFiles_ContentCache_(iContentCache *d) {
+    /* Entries stored after the index was last saved (e.g., due to a crash) are rebuilt from
+       the file headers. Only unreadable files and duplicates are removed. */
+    iForEach(DirFileInfo, i, iClob(new_DirFileInfo(&d->dir))) {
+        const iRangecc name = baseName_Path(path_FileInfo(i.value));
+        if (endsWith_Rangecc(name, ".lgr.tmp")) {
+            remove(cstr_String(path_FileInfo(i.value))); /* interrupted write */
+            continue;
+        }
+        if (!endsWith_Rangecc(name, ".lgr")) {
+            continue;
+        }
+        char *endp = NULL;
+        const uint64_t fileId = strtoull(name.start, &endp, 16);
+        if (endp == name.end - 4 && isUsedFileId_ContentCache_(d, fileId)) {
+            continue;
+        }
+        iBool isRecovered = iFalse;
+        if (endp == name.end - 4) {
+            iFile *f = new_File(path_FileInfo(i.value));
+            if (open_File(f, readOnly_FileMode)) {
+                iCachedContent entry;
+                init_String(&entry.url);
+                if (readHeader_ContentCache_(f, &entry.url)) {
+                    const iTime modified = lastModified_FileInfo(i.value);
+                    entry.fileId   = fileId;
+                    entry.size     = size_FileInfo(i.value);
+                    entry.lastUsed = iMax(1, integralSeconds_Time(&modified));
+                    isRecovered    = insert_ContentCache_(d, &entry);
+                }
+                else {
+                    deinit_String(&entry.url);
+                }
+            }
+            iRelease(f);
+        }
+        if (!isRecovered) {
+            remove(cstr_String(path_FileInfo(i.value)));
+        }
+    }
+}
+
+void load_ContentCache(iContentCache *d, const char *dirPath) {
+    stopWriter_ContentCache_(d);
+    lock_Mutex(d->mtx);
+    clearEntries_ContentCache_(d);
+    setCStr_String(&d->dir, concatPath_CStr(dirPath, dirName_ContentCache_));
+    if (!fileExists_FileInfo(&d->dir)) {
+        makeDirs_Path(&d->dir);
+    }
+    iFile *f = newCStr_File(concatPath_CStr(cstr_String(&d->dir), indexFileName_ContentCache_));
+    if (open_File(f, readOnly_FileMode | text_FileMode)) {
+        const iRangecc src  = range_Block(collect_Block(readAll_File(f)));
+        iRangecc       line = iNullRange;
+        while (nextSplit_Rangecc(src, "\n", &line)) {
+            iCachedContent entry;
+            if (parseIndexLine_(line, &entry)) {
+                insert_ContentCache_(d, &entry);
+            }
+        }
+    }
+    iRelease(f);
+    recoverUnindexedFiles_ContentCache_(d);
+    /* The search index is not saved, so contents of the earlier sessions are indexed
+       in the background. */
+    iConstForEach(Array, i, &d->entries.values) {
+        const iCachedContent *entry = i.value;
+        submit_ContentCache_(d, new_CacheJob_(&entry->url, entry->fileId, NULL));
+    }
+    unlock_Mutex(d->mtx);
+}
+
+void save_ContentCache(const iContentCache *d) {
+    if (isEmpty_String(&d->dir)) {
+        return;
+    }
+    iString *line = new_String();
+    iFile *f = newCStr_File(concatPath_CStr(cstr_String(&d->dir), indexFileName_ContentCache_));
+    if (open_File(f, writeOnly_FileMode | text_FileMode)) {
+        lock_Mutex(d->mtx);
+        iConstForEach(Array, i, &d->entries.values) {
+            const iCachedContent *entry = i.value;
+            format_String(line,
+                          "%llu %zu %016llx %s\n",
+                          (unsigned long long) entry->lastUsed,
+                          entry->size,
+                          (unsigned long long) entry->fileId,
+                          cstr_String(&entry->url));
+            writeData_File(f, cstr_String(line), size_String(line));
+        }
+        unlock_Mutex(d->mtx);
+    }
+    iRelease(f);
+    delete_String(line);
+}
+
+void clear_ContentCache(iContentCache *d) {
+    lock_Mutex(d->mtx);
+    while (!isEmpty_SortedArray(&d->entries)) {
+        removeAt_ContentCache_(d, size_SortedArray(&d->entries) - 1, iTrue);
+    }
+    unlock_Mutex(d->mtx);
+}
+
+void store_ContentCache(iContentCache *d, const iString *url, const iGmResponse *resp) {
+    if (isEmpty_String(&d->dir)) {
+        return;
+    }
+    url = canonicalUrl_String(url);
+    iGmResponse *copy = copy_GmResponse(resp);
+    const size_t size = size_String(url) + size_String(&resp->meta) +
+                        size_Block(&resp->body) + size_String(&resp->certSubject) + 64;
+    lock_Mutex(d->mtx);
+    uint64_t fileId;
+    const size_t pos = find_ContentCache_(d, url);
+    if (pos != iInvalidPos) {
+        iCachedContent *entry = at_SortedArray(&d->entries, pos);
+        d->totalSize -= entry->size;
+        entry->size     = size;
+        entry->lastUsed = now_();
+        d->totalSize += size;
+        fileId = entry->fileId;
+    }
+    else {
+        iCachedContent entry;
+        initCopy_String(&entry.url, url);
+        entry.fileId   = newFileId_ContentCache_(d, url);
+        entry.size     = size;
+        entry.lastUsed = now_();
+        fileId = entry.fileId;
+        insert_ContentCache_(d, &entry);
+    }
+    size_t jobPos;
+    iCacheJob *pending = findJob_ContentCache_(d, url, &jobPos);
+    if (pending && jobPos != iInvalidPos) {
+        /* Not started yet, so just write the latest response. */
+        delete_GmResponse(pending->resp);
+        pending->resp = copy;
+    }
+    else {
+        submit_ContentCache_(d, new_CacheJob_(url, fileId, copy));
+    }
+    unlock_Mutex(d->mtx);
+}
+void remove_ContentCache(iContentCache *d, const iString *url) {
+    url = canonicalUrl_String(url);
+    lock_Mutex(d->mtx);
+    const size_t pos = find_ContentCache_(d, url);
+    if (pos != iInvalidPos) {
+        removeAt_ContentCache_(d, pos, iTrue);
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static int cmpLastUsed_CachedContentPtr_(const void *a, const void *b) {
+    const iCachedContent *x = *(const iCachedContent **) a;
+    const iCachedContent *y = *(const iCachedContent **) b;
+    return x->lastUsed < y->lastUsed ? -1 : x->lastUsed > y->lastUsed ? 1 : 0;
+}
+
+size_t trim_ContentCache(iContentCache *d, size_t maxSize) {
+    size_t removed = 0;
+    lock_Mutex(d->mtx);
+    if (d->totalSize > maxSize) {
+        /* Pick the least recently used entries in one go. */
+        iArray *lru = new_Array(sizeof(iCachedContent *));
+        iForEach(Array, i, &d->entries.values) {
+            pushBack_Array(lru, &i.value);
+        }
+        sort_Array(lru, cmpLastUsed_CachedContentPtr_);
+        iStringList *urls = new_StringList();
+        size_t total = d->totalSize;
+        iConstForEach(Array, j, lru) {
+            if (total <= maxSize) break;
+            const iCachedContent *entry = *(const iCachedContent **) j.value;
+            pushBack_StringList(urls, &entry->url);
+            total -= entry->size;
+        }
+        delete_Array(lru);
+        /* Entries move around when removed, so look them up by URL. */
+        iConstForEach(StringList, k, urls) {
+            const size_t before = d->totalSize;
+            removeAt_ContentCache_(d, find_ContentCache_(d, k.value), iTrue);
+            removed += before - d->totalSize;
+        }
+        iRelease(urls);
+    }
+    unlock_Mutex(d->mtx);
+    return removed;
+}
+
+iBool contains_ContentCache(const iContentCache *d, const iString *url) {
+    iBool found;
+    url = canonicalUrl_String(url);
+    iGuardMutex(d->mtx, found = (find_ContentCache_(d, url) != iInvalidPos));
+    return found;
+}
+
+iGmResponse *find_ContentCache(iContentCache *d, const iString *url) {
+    iGmResponse *resp = NULL;
+    url = canonicalUrl_String(url);
+    lock_Mutex(d->mtx);
+    const size_t pos = find_ContentCache_(d, url);
+    if (pos != iInvalidPos) {
+        const iCacheJob *pending = findJob_ContentCache_(d, url, NULL);
+        if (pending) {
+            resp = copy_GmResponse(pending->resp);
+        }
+        else {
+            resp = readFile_ContentCache_(
+                d, ((const iCachedContent *) at_SortedArray(&d->entries, pos))->fileId, url);
+        }
+        if (resp) {
+            ((iCachedContent *) at_SortedArray(&d->entries, pos))->lastUsed = now_();
+        }
+        else {
+            removeAt_ContentCache_(d, pos, iFalse);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return resp;
+}
+
+size_t size_ContentCache(const iContentCache *d) {
+    size_t size;
+    iGuardMutex(d->mtx, size = d->totalSize);
+    return size;
+}
+
+size_t numEntries_ContentCache(const iContentCache *d) {
+    size_t count;
+    iGuardMutex(d->mtx, count = size_SortedArray(&d->entries));
+    return count;
+}
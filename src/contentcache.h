@@ -0,0 +1,49 @@
+/* Copyright 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include "gmrequest.h"
+
+#include <the_Foundation/string.h>
+
+/* Persistent cache of received content, shared by all tabs. Each response is stored in its
+   own file named after a hash of the canonical URL (probed forward on collisions), written
+   on a background thread. The index of cached URLs is kept in memory and saved in a
+   separate file; entries missing from it are recovered from the file headers. Least
+   recently used entries are removed first when the cache grows too large. */
+
+iDeclareType(ContentCache)
+iDeclareTypeConstruction(ContentCache)
+
+void            load_ContentCache       (iContentCache *, const char *dirPath);
+void            save_ContentCache       (const iContentCache *);
+
+void            clear_ContentCache      (iContentCache *);
+void            store_ContentCache      (iContentCache *, const iString *url, const iGmResponse *resp);
+void            remove_ContentCache     (iContentCache *, const iString *url);
+size_t          trim_ContentCache       (iContentCache *, size_t maxSize); /* returns bytes removed */
+
+iBool           contains_ContentCache   (const iContentCache *, const iString *url);
+iGmResponse *   find_ContentCache       (iContentCache *, const iString *url); /* caller owns result */
+size_t          size_ContentCache       (const iContentCache *); /* bytes */
+size_t          numEntries_ContentCache (const iContentCache *);
@@ -26,8 +26,10 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "visited.h"
 #include "lang.h"
 #include "app.h"
+#include "searchindex.h"
 
 #include <the_Foundation/file.h>
+#include <the_Foundation/condition.h>
 #include <the_Foundation/hash.h>
 #include <the_Foundation/intset.h>
 #include <the_Foundation/mutex.h>
@@ -78,10 +80,13 @@ iBool isUnread_FeedEntry(const iFeedEntry *d) {
 /*----------------------------------------------------------------------------------------------*/
 
 static int requestTimeoutSeconds_FeedJob_ = 10.0f;
+static int maxRedirects_FeedJob_          = 5;
 
 struct Impl_FeedJob {
     iString     url;
+    iString     host; /* of the current URL, for limiting concurrent requests */
     uint32_t    bookmarkId;
+    int         numRedirects;
     iTime       startTime;
     iBool       isFirstUpdate; /* hasn't been checked ever before */
     iBool       checkHeadings;
@@ -90,9 +95,19 @@ struct Impl_FeedJob {
     iPtrArray   results;
 };
 
+static void setUrl_FeedJob_(iFeedJob *d, const iString *url) {
+    set_String(&d->url, url);
+    iUrl parts;
+    init_Url(&parts, url);
+    setRange_String(&d->host, parts.host);
+}
+
 static void init_FeedJob(iFeedJob *d, const iBookmark *bookmark) {
-    initCopy_String(&d->url, &bookmark->url);
+    init_String(&d->url);
+    init_String(&d->host);
+    setUrl_FeedJob_(d, &bookmark->url);
     d->bookmarkId = id_Bookmark(bookmark);
+    d->numRedirects = 0;
     d->request = NULL;
     init_PtrArray(&d->results);
     iZap(d->startTime);
@@ -101,17 +116,46 @@ static void init_FeedJob(iFeedJob *d, const iBookmark *bookmark) {
     d->ignoreWeb     = hasTag_Bookmark(bookmark, ignoreWeb_BookmarkTag);
 }
 
+static void requestFinished_FeedJob_(iAnyObject *obj);
+
 static void deinit_FeedJob(iFeedJob *d) {
-    iRelease(d->request);
+    if (d->request) {
+        iDisconnect(GmRequest, d->request, finished, d->request, requestFinished_FeedJob_);
+        cancel_GmRequest(d->request);
+        iRelease(d->request);
+    }
     iForEach(PtrArray, i, &d->results) {
         delete_FeedEntry(i.ptr);
     }
     deinit_PtrArray(&d->results);
+    deinit_String(&d->host);
     deinit_String(&d->url);
 }
 
-static iBool isTimedOut_FeedJob_(iFeedJob *d) {
-    return elapsedSeconds_Time(&d->startTime) > requestTimeoutSeconds_FeedJob_;
+static double remainingSeconds_FeedJob_(const iFeedJob *d) {
+    return requestTimeoutSeconds_FeedJob_ - elapsedSeconds_Time(&d->startTime);
+}
+
+static iBool isTimedOut_FeedJob_(const iFeedJob *d) {
+    return remainingSeconds_FeedJob_(d) < 0;
+}
+
+static iBool followRedirect_FeedJob_(iFeedJob *d) {
+    if (category_GmStatusCode(status_GmRequest(d->request)) != categoryRedirect_GmStatusCode ||
+        d->numRedirects >= maxRedirects_FeedJob_) {
+        return iFalse;
+    }
+    const iString *dstUrl = absoluteUrl_String(&d->url, meta_GmRequest(d->request));
+    /* Like in a document, redirects to another scheme are not followed automatically. */
+    if (isEmpty_String(meta_GmRequest(d->request)) ||
+        !equalRangeCase_Rangecc(urlScheme_String(dstUrl), urlScheme_String(&d->url))) {
+        return iFalse;
+    }
+    iDisconnect(GmRequest, d->request, finished, d->request, requestFinished_FeedJob_);
+    iReleasePtr(&d->request);
+    setUrl_FeedJob_(d, dstUrl);
+    d->numRedirects++;
+    return iTrue;
 }
 
 iDefineTypeConstructionArgs(FeedJob, (const iBookmark *bm), bm)
@@ -119,27 +163,171 @@ iDefineTypeConstructionArgs(FeedJob, (const iBookmark *bm), bm)
 /*----------------------------------------------------------------------------------------------*/
 
 static const char *feedsFilename_Feeds_         = "feeds.txt";
+static const char *journalFilename_Feeds_       = "feeds.log"; /* changes since feeds.txt was written */
 static const int   updateIntervalSeconds_Feeds_ = 4 * 60 * 60;
+static const int   maxCheckIntervalSeconds_Feeds_ = 3 * 24 * 60 * 60;
+
+/* Feeds whose content stays the same are checked less often, and unchanged content is not
+   parsed again. */
+iDeclareType(FeedCheck)
+
+struct Impl_FeedCheck {
+    iHashNode node; /* key is the bookmark ID */
+    uint64_t  bodyHash;
+    iTime     parsedAt; /* when entries were last updated from the content */
+    iTime     checkedAt;
+    int       interval; /* seconds */
+};
+
+static uint64_t hash_FeedCheck_(const iBlock *body, iBool checkHeadings, iBool ignoreWeb) {
+    /* The feed's settings affect the parsed entries, so they are part of the hash. */
+    const uint8_t *bytes = constData_Block(body);
+    uint64_t       hash  = 0xcbf29ce484222325ull; /* FNV-1a */
+    hash = (hash ^ (checkHeadings ? 1 : 0)) * 0x100000001b3ull;
+    hash = (hash ^ (ignoreWeb ? 1 : 0)) * 0x100000001b3ull;
+    for (size_t i = 0; i < size_Block(body); i++) {
+        hash = (hash ^ bytes[i]) * 0x100000001b3ull;
+    }
+    return hash;
+}
 
 struct Impl_Feeds {
     iMutex *  mtx;
     iString   saveDir;
+    iThread * loader;  /* reads the saved entries in the background at startup */
+    iBool     isLoaded;
+    int       pendingRefresh; /* requested while loading: 1 = due feeds, 2 = all feeds */
+    iString   journal; /* records not yet appended to the journal file */
+    size_t    numJournalPending;
+    size_t    journalSize; /* number of records in the journal file */
+    iIntSet   journalFeeds; /* bookmark IDs whose URL has been recorded in the journal */
+    iBool     needCompact;  /* write everything to feeds.txt on the next save */
     iIntSet   previouslyCheckedFeeds; /* bookmark IDs */
+    iHash     checks; /* FeedCheck nodes */
     iTime     lastRefreshedAt;
     int       refreshTimer;
     iThread * worker;
     iBool     stopWorker;
+    iMutex *  wakeMtx;
+    iCondition wakeup; /* a request has finished or the worker should stop */
+    int       numFinishedRequests;
     iPtrArray jobs; /* pending */
     iSortedArray entries; /* pointers to all discovered feed entries, sorted by entry ID (URL) */
 };
 
 static iFeeds feeds_;
 
-#define maxConcurrentRequests_Feeds 4
+/* Each feed server is only sent a few requests at a time, so the total number of concurrent
+   requests can be high when subscriptions are spread over many hosts. */
+enum iFeedsRequestLimits {
+    maxConcurrentRequests_Feeds = 16,
+    maxRequestsPerHost_Feeds    = 2,
+};
+
+static iBool isDue_Feeds_(const iFeeds *d, uint32_t bookmarkId, const iTime *now) {
+    const iFeedCheck *check = (const iFeedCheck *) value_Hash(&d->checks, bookmarkId);
+    if (!check || !isValid_Time(&check->checkedAt)) {
+        return iTrue;
+    }
+    /* Some slack since refreshes happen at fixed intervals. */
+    return secondsSince_Time(now, &check->checkedAt) + 10 * 60 >= check->interval;
+}
+
+/* Changes to the database are appended to a journal file, and the full database is only
+   rewritten once the journal has grown large. Feeds are identified in journal records by
+   bookmark ID, and each ID is mapped to the feed URL with an "F" record. */
+
+static void journalFeed_Feeds_(iFeeds *d, uint32_t bookmarkId) {
+    if (!contains_IntSet(&d->journalFeeds, bookmarkId)) {
+        const iBookmark *bm = get_Bookmarks(bookmarks_App(), bookmarkId);
+        if (bm) {
+            appendFormat_String(&d->journal, "F %08x %s\n", bookmarkId, cstr_String(&bm->url));
+            insert_IntSet(&d->journalFeeds, bookmarkId);
+            d->numJournalPending++;
+        }
+    }
+}
+
+static void journalEntry_Feeds_(iFeeds *d, const iFeedEntry *entry) {
+    journalFeed_Feeds_(d, entry->bookmarkId);
+    appendFormat_String(&d->journal,
+                        "+ %08x %llu %llu %s\n%s\n",
+                        entry->bookmarkId,
+                        (unsigned long long) integralSeconds_Time(&entry->posted),
+                        (unsigned long long) integralSeconds_Time(&entry->discovered),
+                        cstr_String(&entry->url),
+                        cstr_String(&entry->title));
+    d->numJournalPending++;
+}
+
+static void journalRemoval_Feeds_(iFeeds *d, const iFeedEntry *entry) {
+    journalFeed_Feeds_(d, entry->bookmarkId);
+    appendFormat_String(
+        &d->journal, "- %08x %s\n", entry->bookmarkId, cstr_String(&entry->url));
+    d->numJournalPending++;
+}
+
+static void journalCheck_Feeds_(iFeeds *d, const iFeedCheck *check) {
+    journalFeed_Feeds_(d, (uint32_t) check->node.key);
+    appendFormat_String(&d->journal,
+                        "C %08x %016llx %llu %llu %d\n",
+                        (uint32_t) check->node.key,
+                        (unsigned long long) check->bodyHash,
+                        (unsigned long long) integralSeconds_Time(&check->parsedAt),
+                        (unsigned long long) integralSeconds_Time(&check->checkedAt),
+                        check->interval);
+    d->numJournalPending++;
+}
+
+static iBool updateCheck_Feeds_(iFeeds *d, const iFeedJob *job) {
+    /* Returns iTrue if the received content needs to be parsed for entries. */
+    if (!isSuccess_GmStatusCode(status_GmRequest(job->request))) {
+        return iFalse; /* Keep the entries we have. */
+    }
+    const uint64_t hash = hash_FeedCheck_(body_GmRequest(job->request), job->checkHeadings, job->ignoreWeb);
+    iBool needParse = iTrue;
+    iTime now;
+    initCurrent_Time(&now);
+    lock_Mutex(d->mtx);
+    iFeedCheck *check = (iFeedCheck *) value_Hash(&d->checks, job->bookmarkId);
+    if (!check) {
+        check = iMalloc(FeedCheck);
+        iZap(*check);
+        check->node.key = job->bookmarkId;
+        insert_Hash(&d->checks, &check->node);
+    }
+    check->checkedAt = now;
+    /* Entries are occasionally updated even from unchanged content so that their discovery
+       time is refreshed and they don't get forgotten. */
+    if (hash == check->bodyHash && isValid_Time(&check->parsedAt) &&
+        secondsSince_Time(&now, &check->parsedAt) < maxAge_Visited / 2) {
+        check->interval = iMin(2 * check->interval, maxCheckIntervalSeconds_Feeds_);
+        needParse = iFalse;
+    }
+    else {
+        check->bodyHash = hash;
+        check->parsedAt = now;
+        check->interval = updateIntervalSeconds_Feeds_;
+    }
+    journalCheck_Feeds_(d, check);
+    unlock_Mutex(d->mtx);
+    return needParse;
+}
+
+static void requestFinished_FeedJob_(iAnyObject *obj) {
+    /* Called in the request's thread. */
+    iFeeds *d = &feeds_;
+    iUnused(obj);
+    iGuardMutex(d->wakeMtx, {
+        d->numFinishedRequests++;
+        signal_Condition(&d->wakeup);
+    });
+}
 
 static void submit_FeedJob_(iFeedJob *d) {
     d->request = new_GmRequest(certs_App());
     setUrl_GmRequest(d->request, &d->url);
+    iConnect(GmRequest, d->request, finished, d->request, requestFinished_FeedJob_);
     initCurrent_Time(&d->startTime);
     submit_GmRequest(d->request);
 }
@@ -159,14 +347,30 @@ static const iPtrArray *listSubscriptions_(void) {
     return list_Bookmarks(bookmarks_App(), NULL, isSubscribed_, NULL);
 }
 
-static iFeedJob *startNextJob_Feeds_(iFeeds *d) {
-    if (isEmpty_PtrArray(&d->jobs)) {
-        return NULL;
+static size_t numRequestsToHost_(const iPtrArray *active, const iString *host) {
+    size_t count = 0;
+    iConstForEach(PtrArray, i, active) {
+        const iFeedJob *job = i.ptr;
+        if (equalCase_String(&job->host, host)) {
+            count++;
+        }
+    }
+    return count;
+}
+
+static void startJobs_Feeds_(iFeeds *d, iPtrArray *active) {
+    /* Pending jobs are started in order, skipping the ones whose host is already busy. */
+    for (size_t i = 0; i < size_PtrArray(&d->jobs) &&
+                       size_PtrArray(active) < maxConcurrentRequests_Feeds;) {
+        iFeedJob *job = at_PtrArray(&d->jobs, i);
+        if (numRequestsToHost_(active, &job->host) >= maxRequestsPerHost_Feeds) {
+            i++;
+            continue;
+        }
+        remove_Array(&d->jobs, i);
+        submit_FeedJob_(job);
+        pushBack_PtrArray(active, job);
     }
-    iFeedJob *job;
-    take_PtrArray(&d->jobs, 0, (void **) &job);
-    submit_FeedJob_(job);
-    return job;
 }
 
 static iBool isTrimmablePunctuation_(iChar c) {
@@ -274,10 +478,10 @@ static void parseResult_FeedJob_(iFeedJob *d) {
     }
 }
 
-static void save_Feeds_(iFeeds *d) {
+static void compact_Feeds_(iFeeds *d) {
+    /* Note: Called with the mutex locked. */
     iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)));
     if (open_File(f, write_FileMode | text_FileMode)) {
-        lock_Mutex(d->mtx);
         iString *str = new_String();
         format_String(str, "%llu\n# Feeds\n", integralSeconds_Time(&d->lastRefreshedAt));
         write_File(f, utf8_String(str));
@@ -288,6 +492,20 @@ static void save_Feeds_(iFeeds *d) {
                 write_File(f, utf8_String(str));
             }
         }
+        /* Content hashes and check intervals. */ {
+            writeData_File(f, "# Checks\n", 9);
+            iConstForEach(Hash, i, &d->checks) {
+                const iFeedCheck *check = (const iFeedCheck *) i.value;
+                format_String(str,
+                              "%08x %016llx %llu %llu %d\n",
+                              (uint32_t) check->node.key,
+                              (unsigned long long) check->bodyHash,
+                              (unsigned long long) integralSeconds_Time(&check->parsedAt),
+                              (unsigned long long) integralSeconds_Time(&check->checkedAt),
+                              check->interval);
+                write_File(f, utf8_String(str));
+            }
+        }
         writeData_File(f, "# Entries\n", 10);
         iTime now;
         initCurrent_Time(&now);
@@ -308,11 +526,63 @@ static void save_Feeds_(iFeeds *d) {
         }
         delete_String(str);
         close_File(f);
-        unlock_Mutex(d->mtx);
+        /* Everything in the journal is now included in the main file. */
+        remove(cstr_String(collect_String(concatCStr_Path(&d->saveDir, journalFilename_Feeds_))));
+        clear_String(&d->journal);
+        clear_IntSet(&d->journalFeeds);
+        d->numJournalPending = 0;
+        d->journalSize       = 0;
+        d->needCompact       = iFalse;
     }
     iRelease(f);
 }
 
+static void save_Feeds_(iFeeds *d) {
+    lock_Mutex(d->mtx);
+    if (d->needCompact || d->journalSize + d->numJournalPending >
+                              iMax((size_t) 1000, size_SortedArray(&d->entries) / 2)) {
+        compact_Feeds_(d);
+    }
+    else {
+        appendFormat_String(
+            &d->journal, "T %llu\n", (unsigned long long) integralSeconds_Time(&d->lastRefreshedAt));
+        d->numJournalPending++;
+        iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, journalFilename_Feeds_)));
+        if (open_File(f, append_FileMode | text_FileMode)) {
+            write_File(f, utf8_String(&d->journal));
+            d->journalSize += d->numJournalPending;
+            clear_String(&d->journal);
+            d->numJournalPending = 0;
+        }
+        iRelease(f);
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static void indexKey_FeedEntry_(const iFeedEntry *d, iString *key_out) {
+    /* The same URL may come from multiple feeds. */
+    format_String(key_out, "%x %s", d->bookmarkId, cstr_String(&d->url));
+}
+
+static void index_FeedEntry_(const iFeedEntry *d) {
+    iString key, text;
+    init_String(&key);
+    init_String(&text);
+    indexKey_FeedEntry_(d, &key);
+    format_String(&text, "%s %s", cstr_String(&d->title), cstr_String(&d->url));
+    set_SearchIndex(searchIndex_App(), feedEntry_SearchIndexType, &key, range_String(&text));
+    deinit_String(&text);
+    deinit_String(&key);
+}
+
+static void unindex_FeedEntry_(const iFeedEntry *d) {
+    iString key;
+    init_String(&key);
+    indexKey_FeedEntry_(d, &key);
+    remove_SearchIndex(searchIndex_App(), feedEntry_SearchIndexType, &key);
+    deinit_String(&key);
+}
+
 static iBool isHeadingEntry_FeedEntry_(const iFeedEntry *d) {
     return contains_String(&d->url, '#');
 }
@@ -351,6 +621,8 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
             if (!contains_StringSet(known, &entry->url)) {
 //                printf("  {%s} is new\n", cstr_String(&entry->url));
                 insert_SortedArray(&d->entries, &entry);
+                index_FeedEntry_(entry);
+                journalEntry_Feeds_(d, entry);
                 gotNew = iTrue;
                 remove_PtrArrayIterator(&i);
             }
@@ -366,6 +638,8 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
             if (entry->bookmarkId == sourceId &&
                 !contains_StringSet(presentInSource, &entry->url)) {
 //                printf("    {%s}\n", cstr_String(&entry->url));
+                unindex_FeedEntry_(entry);
+                journalRemoval_Feeds_(d, entry);
                 delete_FeedEntry(entry);
                 remove_ArrayIterator(&e);
             }
@@ -413,11 +687,18 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
                      newDate.day != oldDate.day)) {
                     changed = iTrue;
                 }
+                /* The discovery time only needs saving occasionally to prevent discarding. */
+                const iBool isDiscoveryStale =
+                    secondsSince_Time(&entry->discovered, &existing->discovered) > maxAge_Visited / 6;
                 set_String(&existing->title, &entry->title);
                 existing->posted     = entry->posted;
                 existing->discovered = entry->discovered; /* prevent discarding */
                 delete_FeedEntry(entry);
+                if (changed || isDiscoveryStale) {
+                    journalEntry_Feeds_(d, existing);
+                }
                 if (changed) {
+                    index_FeedEntry_(existing);
                     /* TODO: better to use a new flag for read feed entries? */
                     removeUrl_Visited(visited_App(), &existing->url);
                     gotNew = iTrue;
@@ -425,6 +706,8 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
             }
             else {
                 insert_SortedArray(&d->entries, &entry);
+                index_FeedEntry_(entry);
+                journalEntry_Feeds_(d, entry);
                 gotNew = iTrue;
             }
             remove_PtrArrayIterator(&i);
@@ -439,60 +722,79 @@ static iBool updateEntries_Feeds_(iFeeds *d, iBool isHeadings, uint32_t sourceId
 static iThreadResult fetch_Feeds_(iThread *thread) {
     iFeeds *d = &feeds_;
     iUnused(thread);
-    iFeedJob *work[maxConcurrentRequests_Feeds]; /* We'll do a couple of concurrent requests. */
-    iZap(work);
+    iPtrArray active; /* jobs with an ongoing request */
+    init_PtrArray(&active);
     iBool gotNew = iFalse;
+    iBool isChanged = iFalse; /* some feed had new content */
     postCommand_App("feeds.update.started");
     const int totalJobs = size_PtrArray(&d->jobs);
     int numFinishedJobs = 0;
     while (!d->stopWorker) {
-        /* Start new jobs. */
-        iForIndices(i, work) {
-            if (!work[i]) {
-                work[i] = startNextJob_Feeds_(d);
+        startJobs_Feeds_(d, &active);
+        if (isEmpty_PtrArray(&active)) {
+            break; /* Everything has finished. */
+        }
+        /* Sleep until a request finishes or the earliest deadline is reached. */ {
+            double timeout = requestTimeoutSeconds_FeedJob_;
+            iConstForEach(PtrArray, i, &active) {
+                timeout = iMin(timeout, remainingSeconds_FeedJob_(i.ptr));
             }
+            lock_Mutex(d->wakeMtx);
+            if (d->numFinishedRequests == 0 && !d->stopWorker && timeout > 0) {
+                iTime until;
+                initTimeout_Time(&until, timeout);
+                waitTimeout_Condition(&d->wakeup, d->wakeMtx, &until);
+            }
+            d->numFinishedRequests = 0;
+            unlock_Mutex(d->wakeMtx);
         }
-        sleep_Thread(0.5); /* TODO: wait on a Condition so we can exit quickly */
         if (d->stopWorker) break;
-        size_t ongoing = 0;
         iBool doNotify = iFalse;
-        iForIndices(i, work) {
-            if (work[i]) {
-                if (isFinished_GmRequest(work[i]->request)) {
-                    /* TODO: Handle redirects. Need to resubmit the job with new URL. */
-                    parseResult_FeedJob_(work[i]);
-                    gotNew |= updateEntries_Feeds_(
-                        d, work[i]->checkHeadings, work[i]->bookmarkId, &work[i]->results);
-                    delete_FeedJob(work[i]);
-                    work[i] = NULL;
-                    numFinishedJobs++;
-                    doNotify = iTrue;
-                }
-                else if (isTimedOut_FeedJob_(work[i])) {
-                    /* Maybe we'll get it next time! */
-                    delete_FeedJob(work[i]);
-                    work[i] = NULL;
-                    numFinishedJobs++;
-                    doNotify = iTrue;
+        for (size_t i = 0; i < size_PtrArray(&active); ) {
+            iFeedJob *job = at_PtrArray(&active, i);
+            if (isFinished_GmRequest(job->request)) {
+                remove_Array(&active, i);
+                if (followRedirect_FeedJob_(job)) {
+                    /* Resubmitted with the new URL, possibly to another host. */
+                    pushFront_Array(&d->jobs, &job);
+                    continue;
                 }
-                else {
-                    ongoing++;
+                if (updateCheck_Feeds_(d, job)) {
+                    parseResult_FeedJob_(job);
+                    gotNew |= updateEntries_Feeds_(
+                        d, job->checkHeadings, job->bookmarkId, &job->results);
+                    isChanged = iTrue;
                 }
-                /* TODO: abort job if it takes too long (> 15 seconds?) */
+                delete_FeedJob(job);
+                numFinishedJobs++;
+                doNotify = iTrue;
+            }
+            else if (isTimedOut_FeedJob_(job)) {
+                /* Maybe we'll get it next time! */
+                remove_Array(&active, i);
+                delete_FeedJob(job); /* cancels the request */
+                numFinishedJobs++;
+                doNotify = iTrue;
+            }
+            else {
+                i++;
             }
         }
         if (doNotify) {
             postCommandf_App("feeds.update.progress arg:%d total:%d", numFinishedJobs, totalJobs);
         }
-        /* Stop if everything has finished. */
-        if (ongoing == 0 && isEmpty_PtrArray(&d->jobs)) {
-            break;
-        }
     }
+    iForEach(PtrArray, j, &active) {
+        delete_FeedJob(j.ptr);
+    }
+    deinit_PtrArray(&active);
     initCurrent_Time(&d->lastRefreshedAt);
+    /* Saved even if no content changed, so the updated check times and intervals are
+       not lost. */
     save_Feeds_(d);
     /* Check if there are visited URLs marked as Kept that can be cleared because they are no
-       longer present in the database. */ {
+       longer present in the database. */
+    if (isChanged) {
         iStringSet *knownEntryUrls = new_StringSet();
         lock_Mutex(d->mtx);
         iConstForEach(Array, i, &d->entries.values) {
@@ -509,18 +811,36 @@ static iThreadResult fetch_Feeds_(iThread *thread) {
         }
         iRelease(knownEntryUrls);
     }
-    postCommandf_App("feeds.update.finished arg:%d unread:%zu", gotNew ? 1 : 0,
+    postCommandf_App("feeds.update.finished arg:%d changed:%d unread:%zu",
+                     gotNew ? 1 : 0,
+                     isChanged ? 1 : 0,
                      numUnread_Feeds());
     return 0;
 }
 
-static iBool startWorker_Feeds_(iFeeds *d) {
+static iBool startWorker_Feeds_(iFeeds *d, iBool checkAll) {
+    /* Called from the loader, the refresh timer, and the main thread, so the worker is
+       checked and started while holding the lock. */
+    iTime now;
+    initCurrent_Time(&now);
+    lock_Mutex(d->mtx);
     if (d->worker) {
+        unlock_Mutex(d->mtx);
         return iFalse; /* Refresh is already ongoing. */
     }
-    /* Queue up all the subscriptions for the worker. */
+    if (!d->isLoaded) {
+        /* The loader will start the refresh when it's done. */
+        d->pendingRefresh = iMax(d->pendingRefresh, checkAll ? 2 : 1);
+        unlock_Mutex(d->mtx);
+        return iFalse;
+    }
+    /* Queue up the subscriptions for the worker. */
     iConstForEach(PtrArray, i, listSubscriptions_()) {
         const iBookmark *bm = i.ptr;
+        if (!checkAll && contains_IntSet(&d->previouslyCheckedFeeds, id_Bookmark(bm)) &&
+            !isDue_Feeds_(d, id_Bookmark(bm), &now)) {
+            continue;
+        }
         iFeedJob *job = new_FeedJob(bm);
         if (!contains_IntSet(&d->previouslyCheckedFeeds, id_Bookmark(bm))) {
             job->isFirstUpdate = iTrue;
@@ -530,25 +850,37 @@ static iBool startWorker_Feeds_(iFeeds *d) {
         }
         pushBack_PtrArray(&d->jobs, job);
     }
+    iBool isStarted = iFalse;
     if (!isEmpty_Array(&d->jobs)) {
         d->worker = new_Thread(fetch_Feeds_);
         d->stopWorker = iFalse;
+        d->numFinishedRequests = 0;
         start_Thread(d->worker);
-        return iTrue;
+        isStarted = iTrue;
     }
-    return iFalse;
+    unlock_Mutex(d->mtx);
+    return isStarted;
 }
 
 static uint32_t refresh_Feeds_(uint32_t interval, void *data) {
     /* Called in the SDL timer thread, so let's start a worker thread for running the update. */
-    startWorker_Feeds_(&feeds_);
+    startWorker_Feeds_(&feeds_, iFalse);
     return 1000 * updateIntervalSeconds_Feeds_;
 }
 
 static void stopWorker_Feeds_(iFeeds *d) {
+    iThread *worker;
+    iGuardMutex(d->mtx, worker = d->worker);
+    if (worker) {
+        iGuardMutex(d->wakeMtx, {
+            d->stopWorker = iTrue;
+            signal_Condition(&d->wakeup);
+        });
+        join_Thread(worker);
+    }
+    /* A new refresh can't start until the worker is cleared. */
+    lock_Mutex(d->mtx);
     if (d->worker) {
-        d->stopWorker = iTrue;
-        join_Thread(d->worker);
         iReleasePtr(&d->worker);
     }
     /* Clear remaining jobs. */
@@ -556,6 +888,7 @@ static void stopWorker_Feeds_(iFeeds *d) {
         delete_FeedJob(i.ptr);
     }
     clear_PtrArray(&d->jobs);
+    unlock_Mutex(d->mtx);
 }
 
 static int cmp_FeedEntryPtr_(const void *a, const void *b) {
@@ -575,14 +908,15 @@ struct Impl_FeedHashNode {
     uint32_t  bookmarkId;
 };
 
-static void load_Feeds_(iFeeds *d) {
-    /* TODO: If there are lots of entries, it would make sense to load async. */
+static void loadSnapshot_Feeds_(iFeeds *d) {
+    /* Note: Called in the loader thread. */
     iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, feedsFilename_Feeds_)));
     if (open_File(f, read_FileMode | text_FileMode)) {
-        iBlock * src     = readAll_File(f);
-        iRangecc line    = iNullRange;
-        int      section = 0;
-        iHash *  feeds   = new_Hash(); /* mapping from IDs to feed URLs */
+        iBlock *   src     = readAll_File(f);
+        iRangecc   line    = iNullRange;
+        int        section = 0;
+        iHash *    feeds   = new_Hash(); /* mapping from IDs to feed URLs */
+        iPtrArray *loaded  = new_PtrArray(); /* entries are added to the database all at once */
         while (nextSplit_Rangecc(range_Block(src), "\n", &line)) {
             if (equal_Rangecc(line, "# Feeds")) {
                 section = 1;
@@ -592,6 +926,10 @@ static void load_Feeds_(iFeeds *d) {
                 section = 2;
                 continue;
             }
+            else if (equal_Rangecc(line, "# Checks")) {
+                section = 3;
+                continue;
+            }
             switch (section) {
                 case 0: {
                     unsigned long long ts = 0;
@@ -662,15 +1000,50 @@ static void load_Feeds_(iFeeds *d) {
 //                            printf("[Feeds] src:%d url:{%s}\n", entry->bookmarkId,
 //                                   cstr_String(&entry->url));
 //                        }
-                        insert_SortedArray(&d->entries, &entry);
+                        pushBack_PtrArray(loaded, entry);
                     }
                     delete_String(title);
                     delete_String(url);
                     break;
                 }
+                case 3: {
+                    uint32_t           feedId     = 0;
+                    unsigned long long hash       = 0;
+                    unsigned long long parsedAt   = 0;
+                    unsigned long long checkedAt  = 0;
+                    int                interval   = 0;
+                    if (sscanf(line.start, "%08x %llx %llu %llu %d",
+                               &feedId, &hash, &parsedAt, &checkedAt, &interval) == 5) {
+                        const iFeedHashNode *node = (iFeedHashNode *) value_Hash(feeds, feedId);
+                        lock_Mutex(d->mtx);
+                        if (node && !value_Hash(&d->checks, node->bookmarkId)) {
+                            iFeedCheck *check = iMalloc(FeedCheck);
+                            iZap(*check);
+                            check->node.key            = node->bookmarkId;
+                            check->bodyHash            = hash;
+                            check->parsedAt.ts.tv_sec  = parsedAt;
+                            check->checkedAt.ts.tv_sec = checkedAt;
+                            check->interval = iClamp(interval, updateIntervalSeconds_Feeds_,
+                                                     maxCheckIntervalSeconds_Feeds_);
+                            insert_Hash(&d->checks, &check->node);
+                        }
+                        unlock_Mutex(d->mtx);
+                    }
+                    break;
+                }
             }
         }
     aborted:
+        /* The file is in entry order, so the entries are simply appended. */
+        lock_Mutex(d->mtx);
+        iConstForEach(PtrArray, e, loaded) {
+            insert_SortedArray(&d->entries, &e.ptr);
+        }
+        unlock_Mutex(d->mtx);
+        iConstForEach(PtrArray, e2, loaded) {
+            index_FeedEntry_(e2.ptr);
+        }
+        delete_PtrArray(loaded);
         /* Cleanup. */
         delete_Block(src);
         iForEach(Hash, i, feeds) {
@@ -683,31 +1056,182 @@ static void load_Feeds_(iFeeds *d) {
 
 /*----------------------------------------------------------------------------------------------*/
 
+static void loadJournal_Feeds_(iFeeds *d) {
+    /* Note: Called in the loader thread. */
+    iFile *f = new_File(collect_String(concatCStr_Path(&d->saveDir, journalFilename_Feeds_)));
+    if (open_File(f, read_FileMode | text_FileMode)) {
+        iBlock * src     = readAll_File(f);
+        iRangecc line    = iNullRange;
+        iHash *  feeds   = new_Hash(); /* mapping from journal IDs to bookmark IDs */
+        size_t   count   = 0;
+        lock_Mutex(d->mtx);
+        while (nextSplit_Rangecc(range_Block(src), "\n", &line)) {
+            if (size_Range(&line) < 4 || line.start[1] != ' ') {
+                continue;
+            }
+            count++;
+            const char     type   = *line.start;
+            char *         endp   = NULL;
+            const uint32_t feedId = strtoul(line.start + 2, &endp, 16);
+            if (type == 'T') {
+                d->lastRefreshedAt.ts.tv_sec = strtoull(line.start + 2, NULL, 10);
+                continue;
+            }
+            if (type == 'F') {
+                iString *feedUrl = collect_String(newRange_String((iRangecc){ endp + 1, line.end }));
+                const uint32_t bookmarkId = findUrl_Bookmarks(bookmarks_App(), feedUrl);
+                /* IDs may be mapped again in a later session. */
+                free(remove_Hash(feeds, feedId));
+                if (bookmarkId) {
+                    iFeedHashNode *node = iMalloc(FeedHashNode);
+                    node->node.key      = feedId;
+                    node->bookmarkId    = bookmarkId;
+                    insert_Hash(feeds, &node->node);
+                    insert_IntSet(&d->previouslyCheckedFeeds, bookmarkId);
+                }
+                continue;
+            }
+            const iFeedHashNode *node = (const iFeedHashNode *) value_Hash(feeds, feedId);
+            if (type == 'C') {
+                unsigned long long hash = 0, parsedAt = 0, checkedAt = 0;
+                int interval = 0;
+                if (node && sscanf(endp, "%llx %llu %llu %d",
+                                   &hash, &parsedAt, &checkedAt, &interval) == 4) {
+                    iFeedCheck *check = (iFeedCheck *) value_Hash(&d->checks, node->bookmarkId);
+                    if (!check) {
+                        check = iMalloc(FeedCheck);
+                        iZap(*check);
+                        check->node.key = node->bookmarkId;
+                        insert_Hash(&d->checks, &check->node);
+                    }
+                    check->bodyHash            = hash;
+                    check->parsedAt.ts.tv_sec  = parsedAt;
+                    check->checkedAt.ts.tv_sec = checkedAt;
+                    check->interval            = iClamp(
+                        interval, updateIntervalSeconds_Feeds_, maxCheckIntervalSeconds_Feeds_);
+                }
+            }
+            else if (type == '+') {
+                const unsigned long long posted     = strtoull(endp, &endp, 10);
+                const unsigned long long discovered = strtoull(endp, &endp, 10);
+                const iRangecc urlRange = { skipSpace_CStr(endp), line.end };
+                if (!nextSplit_Rangecc(range_Block(src), "\n", &line)) {
+                    break;
+                }
+                if (!node || posted == 0) {
+                    continue;
+                }
+                iFeedEntry *entry = new_FeedEntry();
+                entry->bookmarkId           = node->bookmarkId;
+                entry->posted.ts.tv_sec     = posted;
+                entry->discovered.ts.tv_sec = discovered;
+                setRange_String(&entry->url, urlRange);
+                setRange_String(&entry->title, line);
+                entry->isHeading = isHeadingEntry_FeedEntry_(entry);
+                size_t pos;
+                if (locate_SortedArray(&d->entries, &entry, &pos)) {
+                    iFeedEntry *existing = *(iFeedEntry **) at_SortedArray(&d->entries, pos);
+                    set_String(&existing->title, &entry->title);
+                    existing->posted     = entry->posted;
+                    existing->discovered = entry->discovered;
+                    index_FeedEntry_(existing);
+                    delete_FeedEntry(entry);
+                }
+                else {
+                    insert_SortedArray(&d->entries, &entry);
+                    index_FeedEntry_(entry);
+                }
+            }
+            else if (type == '-' && node) {
+                iFeedEntry key;
+                iZap(key);
+                key.bookmarkId = node->bookmarkId;
+                initRange_String(&key.url, (iRangecc){ skipSpace_CStr(endp), line.end });
+                const iFeedEntry *pKey = &key;
+                size_t pos;
+                if (locate_SortedArray(&d->entries, &pKey, &pos)) {
+                    iFeedEntry *entry = *(iFeedEntry **) at_SortedArray(&d->entries, pos);
+                    unindex_FeedEntry_(entry);
+                    delete_FeedEntry(entry);
+                    remove_Array(&d->entries.values, pos);
+                }
+                deinit_String(&key.url);
+            }
+        }
+        /* New records are appended after these, with IDs mapped again. */
+        d->journalSize = count;
+        unlock_Mutex(d->mtx);
+        delete_Block(src);
+        iForEach(Hash, i, feeds) {
+            free(i.value);
+        }
+        delete_Hash(feeds);
+    }
+    iRelease(f);
+}
+
+static iThreadResult load_Feeds_(iThread *thread) {
+    iFeeds *d = &feeds_;
+    iUnused(thread);
+    iBeginCollect();
+    loadSnapshot_Feeds_(d);
+    loadJournal_Feeds_(d);
+    lock_Mutex(d->mtx);
+    d->isLoaded = iTrue;
+    const int pendingRefresh = d->pendingRefresh;
+    d->pendingRefresh = 0;
+    /* Update feeds if it has been a while. */
+    int intervalSec = updateIntervalSeconds_Feeds_;
+    if (isValid_Time(&d->lastRefreshedAt)) {
+        const double elapsed = elapsedSeconds_Time(&d->lastRefreshedAt);
+        intervalSec = iMax(1, updateIntervalSeconds_Feeds_ - elapsed);
+    }
+    d->refreshTimer = SDL_AddTimer(1000 * intervalSec, refresh_Feeds_, NULL);
+    unlock_Mutex(d->mtx);
+    postCommandf_App("feeds.loaded unread:%zu", numUnread_Feeds());
+    if (pendingRefresh) {
+        startWorker_Feeds_(d, pendingRefresh == 2);
+    }
+    iEndCollect();
+    return 0;
+}
+
 void init_Feeds(const char *saveDir) {
     iFeeds *d = &feeds_;
     d->mtx = new_Mutex();
     initCStr_String(&d->saveDir, saveDir);
     init_IntSet(&d->previouslyCheckedFeeds);
+    init_Hash(&d->checks);
     iZap(d->lastRefreshedAt);
     d->worker = NULL;
+    d->wakeMtx = new_Mutex();
+    init_Condition(&d->wakeup);
+    d->numFinishedRequests = 0;
     init_PtrArray(&d->jobs);
     init_SortedArray(&d->entries, sizeof(iFeedEntry *), cmp_FeedEntryPtr_);
-    load_Feeds_(d);
-    /* Update feeds if it has been a while. */
-    int intervalSec = updateIntervalSeconds_Feeds_;
-    if (isValid_Time(&d->lastRefreshedAt)) {
-        const double elapsed = elapsedSeconds_Time(&d->lastRefreshedAt);
-        intervalSec = iMax(1, updateIntervalSeconds_Feeds_ - elapsed);
-    }
-    d->refreshTimer = SDL_AddTimer(1000 * intervalSec, refresh_Feeds_, NULL);
+    init_String(&d->journal);
+    init_IntSet(&d->journalFeeds);
+    d->numJournalPending = 0;
+    d->journalSize       = 0;
+    d->needCompact       = iFalse;
+    d->isLoaded          = iFalse;
+    d->pendingRefresh    = 0;
+    d->refreshTimer      = 0;
+    /* Users may have accumulated lots of entries over the years. */
+    d->loader = new_Thread(load_Feeds_);
+    start_Thread(d->loader);
 }
 
 void deinit_Feeds(void) {
     iFeeds *d = &feeds_;
+    join_Thread(d->loader);
+    iRelease(d->loader);
     SDL_RemoveTimer(d->refreshTimer);
     stopWorker_Feeds_(d);
     iAssert(isEmpty_PtrArray(&d->jobs));
     deinit_PtrArray(&d->jobs);
+    deinit_Condition(&d->wakeup);
+    delete_Mutex(d->wakeMtx);
     deinit_String(&d->saveDir);
     delete_Mutex(d->mtx);
     iForEach(Array, i, &d->entries.values) {
@@ -715,11 +1239,17 @@ void deinit_Feeds(void) {
         delete_FeedEntry(*entry);
     }
     deinit_IntSet(&d->previouslyCheckedFeeds);
+    deinit_IntSet(&d->journalFeeds);
+    deinit_String(&d->journal);
+    iForEach(Hash, c, &d->checks) {
+        free(c.value);
+    }
+    deinit_Hash(&d->checks);
     deinit_SortedArray(&d->entries);
 }
 
 void refresh_Feeds(void) {
-    startWorker_Feeds_(&feeds_);
+    startWorker_Feeds_(&feeds_, iTrue); /* requested manually */
 }
 
 void refreshFinished_Feeds(void) {
@@ -728,13 +1258,18 @@ void refreshFinished_Feeds(void) {
 
 void removeEntries_Feeds(uint32_t feedBookmarkId) {
     iFeeds *d = &feeds_;
+    lock_Mutex(d->mtx);
+    free(remove_Hash(&d->checks, feedBookmarkId));
     iForEach(Array, i, &d->entries.values) {
         iFeedEntry **entry = i.value;
         if ((*entry)->bookmarkId == feedBookmarkId) {
+            unindex_FeedEntry_(*entry);
             delete_FeedEntry(*entry);
             remove_ArrayIterator(&i);
         }
     }
+    d->needCompact = iTrue; /* the feed is no longer known, so can't be referred to */
+    unlock_Mutex(d->mtx);
 }
 
 static int cmpTimeDescending_FeedEntryPtr_(const void *a, const void *b) {
@@ -748,14 +1283,44 @@ static int cmpTimeDescending_FeedEntryPtr_(const void *a, const void *b) {
 const iPtrArray *listEntries_Feeds(void) {
     iFeeds *d = &feeds_;
     lock_Mutex(d->mtx);
-    /* The worker will never delete feed entries so we can use the same ones. Just make a copy
-       of the array in case the worker modifies it. */
-    iPtrArray *list = collect_PtrArray(copy_Array(&d->entries.values));
+    /* Replaying the journal deletes entries, so nothing is listed before loading has finished.
+       After that, only the worker deletes entries (headings no longer present in their
+       source). Make a copy of the array in case the worker modifies it. */
+    iPtrArray *list = collect_PtrArray(d->isLoaded ? copy_Array(&d->entries.values)
+                                                   : new_PtrArray());
     unlock_Mutex(d->mtx);
     sort_Array(list, cmpTimeDescending_FeedEntryPtr_);
     return list;
 }
 
+const iPtrArray *listIndexedEntries_Feeds(const iStringSet *keys) {
+    iFeeds *d = &feeds_;
+    iPtrArray *list = collectNew_PtrArray();
+    iFeedEntry key;
+    iZap(key);
+    lock_Mutex(d->mtx);
+    if (!d->isLoaded) {
+        /* See listEntries_Feeds(). */
+        unlock_Mutex(d->mtx);
+        return list;
+    }
+    iConstForEach(StringSet, i, keys) {
+        /* See indexKey_FeedEntry_(). */
+        const char *sep = strchr(cstr_String(i.value), ' ');
+        if (!sep) continue;
+        key.bookmarkId = strtoul(cstr_String(i.value), NULL, 16);
+        initCStr_String(&key.url, sep + 1);
+        const iFeedEntry *pKey = &key;
+        size_t pos;
+        if (locate_SortedArray(&d->entries, &pKey, &pos)) {
+            pushBack_PtrArray(list, *(iFeedEntry **) at_SortedArray(&d->entries, pos));
+        }
+        deinit_String(&key.url);
+    }
+    unlock_Mutex(d->mtx);
+    return list;
+}
+
 size_t numSubscribed_Feeds(void) {
     return size_PtrArray(listSubscriptions_());
 }
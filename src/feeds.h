@@ -23,6 +23,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #pragma once
 
 #include <the_Foundation/ptrarray.h>
+#include <the_Foundation/stringset.h>
 #include <the_Foundation/string.h>
 #include <the_Foundation/time.h>
 
@@ -55,6 +56,7 @@ void    removeEntries_Feeds     (uint32_t feedBookmarkId);
 void    refreshFinished_Feeds   (void); /* called on "feeds.update.finished" */
 
 const iPtrArray *   listEntries_Feeds   (void);
+const iPtrArray *   listIndexedEntries_Feeds(const iStringSet *keys); /* keys from the search index */
 const iString *     entryListPage_Feeds (void);
 size_t              numSubscribed_Feeds (void);
 size_t              numUnread_Feeds     (void);
@@ -151,6 +151,175 @@ static uint32_t themeHash_(const iBlock *data) {
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(GmNormState)
+iDeclareType(GmLayoutState)
+
+/* Position of the last complete line in the unnormalized and normalized sources. Appended
+   content is normalized starting from here. */
+struct Impl_GmNormState {
+    size_t srcPos;
+    size_t destPos;
+    iBool  isPreformat;
+    iBool  isNormalized; /* if not, source is a copy of the unnormalized source */
+};
+
+/* Typesetter state at the beginning of a line. When more content is appended, the layout
+   is rewound to the last saved state and continues from there. */
+struct Impl_GmLayoutState {
+    iBool            isValid;
+    size_t           srcPos; /* in the normalized source */
+    size_t           numRuns;
+    size_t           numLinks;
+    size_t           numHeadings;
+    iBool            hasTitle;
+    iInt2            pos;
+    iBool            isFirstText;
+    iBool            addQuoteIcon;
+    iBool            isPreformat;
+    int              preFont;
+    uint16_t         preId;
+    iBool            enableIndents;
+    enum iGmLineType prevType;
+    enum iGmLineType prevNonBlankType;
+    iBool            followsBlank;
+};
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(GmRunIndex)
+
+/* Lookup tables for finding a starting point when scanning the layout. The document is
+   divided into fixed-size bands, and each entry is the index of the first run that reaches
+   the corresponding band. None of the runs before it can be in the band or after it. */
+struct Impl_GmRunIndex {
+    iArray visBands; /* uint32_t; runs whose `visBounds` bottom is at or below the band top */
+    iArray hitBands; /* non-decoration runs whose `bounds` extend below the band top */
+    iArray locBands; /* non-decoration runs whose text ends after the band start */
+};
+
+enum {
+    yBandHeight_GmRunIndex_  = 256,  /* document pixels */
+    locBandSize_GmRunIndex_  = 4096, /* source bytes */
+};
+
+static void init_GmRunIndex_(iGmRunIndex *d) {
+    init_Array(&d->visBands, sizeof(uint32_t));
+    init_Array(&d->hitBands, sizeof(uint32_t));
+    init_Array(&d->locBands, sizeof(uint32_t));
+}
+
+static void deinit_GmRunIndex_(iGmRunIndex *d) {
+    deinit_Array(&d->locBands);
+    deinit_Array(&d->hitBands);
+    deinit_Array(&d->visBands);
+}
+
+static void truncateBands_GmRunIndex_(iArray *bands, size_t numRuns) {
+    size_t count = size_Array(bands);
+    while (count > 0 && constValue_Array(bands, count - 1, uint32_t) >= numRuns) {
+        count--;
+    }
+    resize_Array(bands, count);
+}
+
+static void extendBands_GmRunIndex_(iArray *bands, int bandSize, ptrdiff_t reach,
+                                    uint32_t runIndex) {
+    /* Bands are filled in order, so the run can only be the first one in the new bands. */
+    while ((ptrdiff_t) size_Array(bands) * bandSize < reach) {
+        pushBack_Array(bands, &runIndex);
+    }
+}
+
+static size_t firstRun_GmRunIndex_(const iArray *bands, int bandSize, ptrdiff_t pos,
+                                   size_t numRuns) {
+    if (pos < 0) {
+        return 0;
+    }
+    const size_t band = pos / bandSize;
+    if (band < size_Array(bands)) {
+        return constValue_Array(bands, band, uint32_t);
+    }
+    return numRuns; /* nothing reaches this far */
+}
+
+static size_t memorySize_GmRunIndex_(const iGmRunIndex *d) {
+    return (size_Array(&d->visBands) + size_Array(&d->hitBands) + size_Array(&d->locBands)) *
+           sizeof(uint32_t);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(GmLayoutKey)
+iDeclareType(GmCachedLayout)
+
+/* Parameters that determine the layout of a given source. */
+struct Impl_GmLayoutKey {
+    int      width;
+    int      outsideMargin;
+    int      fontHeight; /* paragraph font */
+    int      theme;
+    uint32_t themeSeed;
+    uint32_t prefsHash; /* layout-affecting preferences */
+};
+
+iLocalDef iBool equal_GmLayoutKey(const iGmLayoutKey *d, const iGmLayoutKey *other) {
+    return memcmp(d, other, sizeof(*d)) == 0;
+}
+
+/* A previous layout of the current source, kept for switching back to a recent width. */
+struct Impl_GmCachedLayout {
+    iGmLayoutKey   key;
+    int            height;
+    iArray         layout;
+    iGmRunIndex    runIndex;
+    iPtrArray      links;
+    iArray         headings;
+    iArray         preMeta;
+    iSortedArray   glyphs;
+    iString        title;
+    iGmLayoutState layoutState;
+    int            warnings;
+};
+
+enum {
+    maxCount_GmCachedLayout_ = 4,
+    maxSize_GmCachedLayout_  = 16 * 1024 * 1024, /* bytes, all cached layouts of a document */
+};
+
+static void init_GmCachedLayout(iGmCachedLayout *d) {
+    iZap(d->key);
+    d->height = 0;
+    init_Array(&d->layout, sizeof(iGmRun));
+    init_GmRunIndex_(&d->runIndex);
+    init_PtrArray(&d->links);
+    init_Array(&d->headings, sizeof(iGmHeading));
+    init_Array(&d->preMeta, sizeof(iGmPreMeta));
+    initGlyphSet_Text(&d->glyphs);
+    init_String(&d->title);
+    iZap(d->layoutState);
+    d->warnings = 0;
+}
+
+static void deinit_GmCachedLayout(iGmCachedLayout *d) {
+    deinit_String(&d->title);
+    deinit_SortedArray(&d->glyphs);
+    deinit_Array(&d->preMeta);
+    deinit_Array(&d->headings);
+    iForEach(PtrArray, i, &d->links) {
+        delete_GmLink(i.ptr);
+    }
+    deinit_PtrArray(&d->links);
+    deinit_GmRunIndex_(&d->runIndex);
+    deinit_Array(&d->layout);
+}
+
+static size_t memorySize_GmCachedLayout_(const iGmCachedLayout *d) {
+    return size_Array(&d->layout) * sizeof(iGmRun) + size_PtrArray(&d->links) * sizeof(iGmLink) +
+           memorySize_GmRunIndex_(&d->runIndex);
+}
+
+iDefineTypeConstruction(GmCachedLayout)
+
 struct Impl_GmDocument {
     iObject object;
     enum iSourceFormat format;
@@ -162,11 +331,19 @@ struct Impl_GmDocument {
     int       outsideMargin;
     iBool     enableCommandLinks; /* `about:command?` only allowed on selected pages */
     iBool     isLayoutInvalidated;
+    iBool     isLayoutCopy;   /* laid out in a background thread */
+    unsigned  layoutRevision; /* incremented whenever the layout is redone */
+    iGmNormState   normState;
+    iGmLayoutState layoutState; /* for resuming layout of appended content */
     iArray    layout; /* contents of source, laid out in document space */
+    iGmRunIndex runIndex;
+    iGmLayoutKey layoutKey;
+    iPtrArray layoutCache; /* GmCachedLayouts of the same source, oldest first */
     iPtrArray links;
     iString   title; /* the first top-level title */
     iArray    headings;
     iArray    preMeta; /* metadata about preformatted blocks */
+    iSortedArray glyphs; /* first glyphs used by the layout, for prewarming the glyph cache */
     iGmTheme  theme;
     uint32_t  themeSeed;
     iChar     siteIcon;
@@ -597,7 +774,157 @@ static iBool typesetOneLine_RunTypesetter_(iWrapText *wrap, iRangecc wrapRange,
     return iTrue; /* continue to next wrapped line */
 }
 
-static void doLayout_GmDocument_(iGmDocument *d) {
+static void rewindLayout_GmDocument_(iGmDocument *d) {
+    const iGmLayoutState *st = &d->layoutState;
+    resize_Array(&d->layout, st->numRuns);
+    for (size_t i = st->numLinks; i < size_PtrArray(&d->links); i++) {
+        delete_GmLink(at_PtrArray(&d->links, i));
+    }
+    resize_Array(&d->links, st->numLinks);
+    resize_Array(&d->headings, st->numHeadings);
+    resize_Array(&d->preMeta, st->preId);
+    if (!st->hasTitle) {
+        clear_String(&d->title);
+    }
+}
+
+static uint32_t hashData_(uint32_t hash, const void *data, size_t size) {
+    /* FNV-1a */
+    for (const uint8_t *ch = data; size--; ch++) {
+        hash ^= *ch;
+        hash *= 0x01000193u;
+    }
+    return hash;
+}
+
+static uint32_t layoutPrefsHash_(void) {
+    /* Everything that `doLayout_GmDocument_` reads from the preferences. The fonts are
+       identified by name, since their sizes alone may not change. */
+    const iPrefs *prefs  = prefs_App();
+    const int     values[] = { prefs->gemtextAnsiEscapes,
+                               prefs->monospaceGemini,
+                               prefs->monospaceGopher,
+                               prefs->boldLinkVisited,
+                               prefs->boldLinkDark,
+                               prefs->boldLinkLight,
+                               prefs->lineWidth,
+                               (int) (prefs->lineSpacing * 1000),
+                               prefs->bigFirstParagraph,
+                               prefs->quoteIcon,
+                               prefs->centerShortDocs,
+                               prefs->plainTextWrap,
+                               prefs->collapsePreOnLoad,
+                               prefs->docThemeDark,
+                               prefs->docThemeLight };
+    uint32_t hash = hashData_(0x811c9dc5u, values, sizeof(values));
+    for (int i = headingFont_PrefsString; i <= monospaceDocumentFont_PrefsString; i++) {
+        hash = hashData_(hash, cstr_String(&prefs->strings[i]), size_String(&prefs->strings[i]));
+    }
+    return hash;
+}
+
+static iGmLayoutKey layoutKey_GmDocument_(const iGmDocument *d) {
+    return (iGmLayoutKey){ .width         = d->size.x,
+                           .outsideMargin = d->outsideMargin,
+                           .fontHeight    = lineHeight_Text(paragraph_FontId),
+                           .theme         = currentTheme_(),
+                           .themeSeed     = d->themeSeed,
+                           .prefsHash     = layoutPrefsHash_() };
+}
+
+static void swapCachedLayout_GmDocument_(iGmDocument *d, iGmCachedLayout *cached) {
+    iSwap(iGmLayoutKey,   d->layoutKey,   cached->key);
+    iSwap(int,            d->size.y,      cached->height);
+    iSwap(iArray,         d->layout,      cached->layout);
+    iSwap(iGmRunIndex,    d->runIndex,    cached->runIndex);
+    iSwap(iPtrArray,      d->links,       cached->links);
+    iSwap(iArray,         d->headings,    cached->headings);
+    iSwap(iArray,         d->preMeta,     cached->preMeta);
+    iSwap(iSortedArray,   d->glyphs,      cached->glyphs);
+    iSwap(iString,        d->title,       cached->title);
+    iSwap(iGmLayoutState, d->layoutState, cached->layoutState);
+    iSwap(int,            d->warnings,    cached->warnings);
+}
+
+static void clearLayoutCache_GmDocument_(iGmDocument *d) {
+    iForEach(PtrArray, i, &d->layoutCache) {
+        delete_GmCachedLayout(i.ptr);
+    }
+    clear_PtrArray(&d->layoutCache);
+}
+
+static size_t layoutCacheSize_GmDocument_(const iGmDocument *d) {
+    size_t size = 0;
+    iConstForEach(PtrArray, i, &d->layoutCache) {
+        size += memorySize_GmCachedLayout_(i.ptr);
+    }
+    return size;
+}
+
+static void storeLayout_GmDocument_(iGmDocument *d) {
+    /* The current layout is moved to the cache. */
+    if (!d->layoutState.isValid || d->isLayoutInvalidated || d->isLayoutCopy ||
+        isEmpty_Array(&d->layout)) {
+        return;
+    }
+    const int ansiWarning = d->warnings & ansiEscapes_GmDocumentWarning; /* not from layout */
+    iGmCachedLayout *cached = new_GmCachedLayout();
+    swapCachedLayout_GmDocument_(d, cached);
+    d->warnings = ansiWarning;
+    pushBack_PtrArray(&d->layoutCache, cached);
+    while (size_PtrArray(&d->layoutCache) > maxCount_GmCachedLayout_ ||
+           (size_PtrArray(&d->layoutCache) > 1 &&
+            layoutCacheSize_GmDocument_(d) > maxSize_GmCachedLayout_)) {
+        delete_GmCachedLayout(at_PtrArray(&d->layoutCache, 0));
+        remove_Array(&d->layoutCache, 0);
+    }
+}
+
+static iBool restoreLayout_GmDocument_(iGmDocument *d) {
+    const iGmLayoutKey key = layoutKey_GmDocument_(d);
+    iForEach(PtrArray, i, &d->layoutCache) {
+        iGmCachedLayout *cached = i.ptr;
+        if (equal_GmLayoutKey(&cached->key, &key)) {
+            const int ansiWarning = d->warnings & ansiEscapes_GmDocumentWarning;
+            remove_PtrArrayIterator(&i);
+            swapCachedLayout_GmDocument_(d, cached);
+            iChangeFlags(d->warnings, ansiEscapes_GmDocumentWarning, ansiWarning);
+            delete_GmCachedLayout(cached); /* whatever was laid out previously */
+            d->layoutRevision++;
+            /* Link states may have changed since the layout was cached. */
+            updateOpenURLs_GmDocument(d);
+            updateVisitedLinks_GmDocument(d);
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
+static void updateRunIndex_GmDocument_(iGmDocument *d, size_t firstNewRun) {
+    iGmRunIndex *index   = &d->runIndex;
+    const char * srcBegin = constBegin_String(&d->source);
+    const char * srcEnd   = constEnd_String(&d->source);
+    truncateBands_GmRunIndex_(&index->visBands, firstNewRun);
+    truncateBands_GmRunIndex_(&index->hitBands, firstNewRun);
+    truncateBands_GmRunIndex_(&index->locBands, firstNewRun);
+    for (size_t i = firstNewRun; i < size_Array(&d->layout); i++) {
+        const iGmRun *run = constAt_Array(&d->layout, i);
+        /* Rendering includes runs whose bottom edge touches the visible range. */
+        extendBands_GmRunIndex_(&index->visBands, yBandHeight_GmRunIndex_,
+                                bottom_Rect(run->visBounds) + 1, (uint32_t) i);
+        if (run->flags & decoration_GmRunFlag) {
+            continue;
+        }
+        extendBands_GmRunIndex_(&index->hitBands, yBandHeight_GmRunIndex_,
+                                bottom_Rect(run->bounds), (uint32_t) i);
+        if (run->text.end >= srcBegin && run->text.end <= srcEnd) {
+            extendBands_GmRunIndex_(&index->locBands, locBandSize_GmRunIndex_,
+                                    run->text.end - srcBegin, (uint32_t) i);
+        }
+    }
+}
+
+static void layout_GmDocument_(iGmDocument *d, iBool isAppending) {
     const iPrefs *prefs             = prefs_App();
     const iBool   isMono            = isForcedMonospace_GmDocument_(d);
     const iBool   isGopher          = isGopher_GmDocument_(d);
@@ -607,8 +934,11 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     const iBool   isFullWidthImages = (d->outsideMargin < 5 * gap_UI);
 //    const iBool   isDarkBg          = isDark_GmDocumentTheme(
 //        isDark_ColorTheme(colorTheme_App()) ? prefs->docThemeDark : prefs->docThemeLight);
-    initTheme_GmDocument_(d);
-    d->isLayoutInvalidated = iFalse;
+    if (!isAppending) {
+        initTheme_GmDocument_(d);
+        d->isLayoutInvalidated = iFalse;
+        d->layoutKey = layoutKey_GmDocument_(d);
+    }
     /* TODO: Collect these parameters into a GmTheme. */
     float indents[max_GmLineType] = { 5, 10, 5, isNarrow ? 5 : 10, 0, 0, 5, 5 };
     if (isExtremelyNarrow) {
@@ -637,39 +967,83 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     static const char *pointingFinger  = "\U0001f449";
     static const char *uploadArrow     = upload_Icon;
     static const char *image           = photo_Icon;
-    clear_Array(&d->layout);
-    clearLinks_GmDocument_(d);
-    clear_Array(&d->headings);
     const iArray *oldPreMeta = collect_Array(copy_Array(&d->preMeta)); /* remember fold states */
-    clear_Array(&d->preMeta);
-    clear_String(&d->title);
-//    clear_String(&d->bannerText);
+    if (isAppending) {
+        rewindLayout_GmDocument_(d);
+    }
+    else {
+        clear_SortedArray(&d->glyphs);
+        clear_Array(&d->layout);
+        updateRunIndex_GmDocument_(d, 0);
+        clearLinks_GmDocument_(d);
+        clear_Array(&d->headings);
+        clear_Array(&d->preMeta);
+        clear_String(&d->title);
+//        clear_String(&d->bannerText);
+        iZap(d->layoutState);
+        d->layoutState.isFirstText  = prefs->bigFirstParagraph;
+        d->layoutState.addQuoteIcon = prefs->quoteIcon;
+        d->layoutState.preFont      = preformatted_FontId;
+        d->layoutState.prevType     = text_GmLineType;
+        d->layoutState.prevNonBlankType = text_GmLineType;
+        if (d->format == plainText_SourceFormat) {
+            d->layoutState.isPreformat = iTrue;
+            d->layoutState.isFirstText = iFalse;
+        }
+        d->warnings &= ~missingGlyphs_GmDocumentWarning;
+    }
+    if (!d->isLayoutCopy) {
+        d->layoutRevision++;
+    }
     if (d->size.x <= 0 || isEmpty_String(&d->source)) {
         return;
     }
-    updateOpenURLs_GmDocument_(d);
-    const iRangecc   content       = range_String(&d->source);
+    if (!d->isLayoutCopy) {
+        updateOpenURLs_GmDocument_(d); /* the copy uses a snapshot */
+    }
+    const iGmLayoutState *start    = &d->layoutState;
+    const char *     docStart      = constBegin_String(&d->source);
+    const char *     stableEnd     = docStart + d->normState.destPos; /* after last complete line */
+    const size_t     firstNewRun   = start->numRuns;
+    const iRangecc   content       = { docStart + start->srcPos, constEnd_String(&d->source) };
     iRangecc         contentLine   = iNullRange;
-    iInt2            pos           = zero_I2();
-    iBool            isFirstText   = prefs->bigFirstParagraph;
-    iBool            addQuoteIcon  = prefs->quoteIcon;
-    iBool            isPreformat   = iFalse;
-    int              preFont       = preformatted_FontId;
-    uint16_t         preId         = 0;
-    iBool            enableIndents = iFalse;
+    iInt2            pos           = start->pos;
+    iBool            isFirstText   = start->isFirstText;
+    iBool            addQuoteIcon  = start->addQuoteIcon;
+    iBool            isPreformat   = start->isPreformat;
+    int              preFont       = start->preFont;
+    uint16_t         preId         = start->preId;
+    iBool            enableIndents = start->enableIndents;
 //    iBool            addSiteBanner = d->bannerType != none_GmDocumentBanner;
     const iBool      isNormalized  = isNormalized_GmDocument_(d);
-    enum iGmLineType prevType      = text_GmLineType;
-    enum iGmLineType prevNonBlankType = text_GmLineType;
-    iBool            followsBlank  = iFalse;
-    if (d->format == plainText_SourceFormat) {
-        isPreformat = iTrue;
-        isFirstText = iFalse;
-    }
-    d->warnings &= ~missingGlyphs_GmDocumentWarning;
+    enum iGmLineType prevType      = start->prevType;
+    enum iGmLineType prevNonBlankType = start->prevNonBlankType;
+    iBool            followsBlank  = start->followsBlank;
+    iBool            isUnclosedPre = iFalse; /* rest of the layout depends on missing content */
     checkMissing_Text(); /* clear the flag */
     setAnsiFlags_Text(d->theme.ansiEscapes);
+    setGlyphCollector_Text(&d->glyphs);
     while (nextSplit_Rangecc(content, "\n", &contentLine)) {
+        /* Remember the state at the start of each complete line. Lines inside a preformatted
+           block depend on the rest of the block, so the block is always laid out in full. */
+        if (contentLine.start <= stableEnd && !isUnclosedPre &&
+            (!isPreformat || d->format == plainText_SourceFormat)) {
+            d->layoutState = (iGmLayoutState){ .srcPos           = contentLine.start - docStart,
+                                               .numRuns          = size_Array(&d->layout),
+                                               .numLinks         = size_PtrArray(&d->links),
+                                               .numHeadings      = size_Array(&d->headings),
+                                               .hasTitle         = !isEmpty_String(&d->title),
+                                               .pos              = pos,
+                                               .isFirstText      = isFirstText,
+                                               .addQuoteIcon     = addQuoteIcon,
+                                               .isPreformat      = isPreformat,
+                                               .preFont          = preFont,
+                                               .preId            = preId,
+                                               .enableIndents    = enableIndents,
+                                               .prevType         = prevType,
+                                               .prevNonBlankType = prevNonBlankType,
+                                               .followsBlank     = followsBlank };
+        }
         iRangecc line = contentLine; /* `line` will be trimmed; modifying would confuse `nextSplit_Rangecc` */
         if (*line.end == '\r') {
             line.end--; /* trim CR always */
@@ -680,7 +1054,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
         /* Detect the type of the line. */
         if (!isPreformat) {
             type = lineType_GmDocument_(d, line);
-            if (contentLine.start == content.start) {
+            if (contentLine.start == docStart) {
                 prevType = type;
             }
             indent = indents[type];
@@ -693,6 +1067,9 @@ static void doLayout_GmDocument_(iGmDocument *d) {
                 iGmPreMeta meta = { .bounds = line };
                 meta.pixelRect.size = measurePreformattedBlock_GmDocument_(
                     d, line.start, preFont, &meta.contents, &meta.bounds.end);
+                if (meta.bounds.end == line.end) {
+                    isUnclosedPre = iTrue;
+                }
                 const float oversizeRatio =
                     meta.pixelRect.size.x /
                     (float) (d->size.x -
@@ -735,7 +1112,7 @@ static void doLayout_GmDocument_(iGmDocument *d) {
         else {
             /* Preformatted line. */
             type = preformatted_GmLineType;
-            if (contentLine.start == content.start) {
+            if (contentLine.start == docStart) {
                 prevType = type;
             }
             if (d->format == gemini_SourceFormat &&
@@ -1124,23 +1501,30 @@ static void doLayout_GmDocument_(iGmDocument *d) {
     }
     /* Go over the preformatted blocks and mark them wide if at least one run is wide. */ {
         /* TODO: Store the dimensions and ranges for later access. */
-        iForEach(Array, i, &d->layout) {
-            iGmRun *run = i.value;
+        for (size_t i = firstNewRun; i < size_Array(&d->layout); i++) {
+            iGmRun *run = at_Array(&d->layout, i);
             if (preId_GmRun(run) && run->flags & wide_GmRunFlag) {
                 iGmRunRange block = findPreformattedRange_GmDocument(d, run);
                 for (const iGmRun *j = block.start; j != block.end; j++) {
                     iConstCast(iGmRun *, j)->flags |= wide_GmRunFlag;
                 }
                 /* Skip to the end of the block. */
-                i.pos = block.end - (const iGmRun *) constData_Array(&d->layout) - 1;
+                i = block.end - (const iGmRun *) constData_Array(&d->layout) - 1;
             }
         }
     }
+    updateRunIndex_GmDocument_(d, firstNewRun);
     setAnsiFlags_Text(allowAll_AnsiFlag);
+    setGlyphCollector_Text(NULL);
+    d->layoutState.isValid = iTrue;
 //    printf("[GmDocument] layout size: %zu runs (%zu bytes)\n",
 //           size_Array(&d->layout), size_Array(&d->layout) * sizeof(iGmRun));        
 }
 
+static void doLayout_GmDocument_(iGmDocument *d) {
+    layout_GmDocument_(d, iFalse);
+}
+
 void init_GmDocument(iGmDocument *d) {
     d->format = gemini_SourceFormat;
     init_String(&d->unormSource);
@@ -1151,11 +1535,19 @@ void init_GmDocument(iGmDocument *d) {
     d->size = zero_I2();
     d->enableCommandLinks = iFalse;
     d->isLayoutInvalidated = iFalse;
+    d->isLayoutCopy = iFalse;
+    d->layoutRevision = 0;
+    iZap(d->normState);
+    iZap(d->layoutState);
     init_Array(&d->layout, sizeof(iGmRun));
+    init_GmRunIndex_(&d->runIndex);
+    iZap(d->layoutKey);
+    init_PtrArray(&d->layoutCache);
     init_PtrArray(&d->links);
     init_String(&d->title);
     init_Array(&d->headings, sizeof(iGmHeading));
     init_Array(&d->preMeta, sizeof(iGmPreMeta));
+    initGlyphSet_Text(&d->glyphs);
     d->themeSeed = 0;
     d->siteIcon = 0;
     d->media = new_Media();
@@ -1171,8 +1563,12 @@ void deinit_GmDocument(iGmDocument *d) {
     deinit_String(&d->title);
     clearLinks_GmDocument_(d);
     deinit_PtrArray(&d->links);
+    deinit_SortedArray(&d->glyphs);
     deinit_Array(&d->preMeta);
     deinit_Array(&d->headings);
+    clearLayoutCache_GmDocument_(d);
+    deinit_PtrArray(&d->layoutCache);
+    deinit_GmRunIndex_(&d->runIndex);
     deinit_Array(&d->layout);
     deinit_String(&d->localHost);
     deinit_String(&d->url);
@@ -1720,13 +2116,27 @@ void invalidatePalette_GmDocument(iGmDocument *d) {
 }
 
 void setFormat_GmDocument(iGmDocument *d, enum iSourceFormat format) {
+    if (d->format != format) {
+        d->layoutState.isValid = iFalse;
+        clearLayoutCache_GmDocument_(d);
+    }
     d->format = format;
 }
 
 void setWidth_GmDocument(iGmDocument *d, int width, int canvasWidth) {
+    const int outsideMargin = iMax(0, (canvasWidth - width) / 2); /* distance to edge of the canvas */
+    if (width == d->size.x && outsideMargin == d->outsideMargin) {
+        /* Something else than the width has changed, so cached layouts are out of date. */
+        clearLayoutCache_GmDocument_(d);
+    }
+    else {
+        storeLayout_GmDocument_(d);
+    }
     d->size.x        = width;
-    d->outsideMargin = iMax(0, (canvasWidth - width) / 2); /* distance to edge of the canvas */
-    doLayout_GmDocument_(d); /* TODO: just flag need-layout and do it later */
+    d->outsideMargin = outsideMargin;
+    if (!restoreLayout_GmDocument_(d)) {
+        doLayout_GmDocument_(d); /* TODO: just flag need-layout and do it later */
+    }
 }
 
 iBool updateWidth_GmDocument(iGmDocument *d, int width, int canvasWidth) {
@@ -1738,11 +2148,88 @@ iBool updateWidth_GmDocument(iGmDocument *d, int width, int canvasWidth) {
 }
 
 void redoLayout_GmDocument(iGmDocument *d) {
+    clearLayoutCache_GmDocument_(d);
     doLayout_GmDocument_(d);
 }
 
+const iSortedArray *glyphs_GmDocument(const iGmDocument *d) {
+    return &d->glyphs;
+}
+
+iBool isLayoutCached_GmDocument(const iGmDocument *d, int width, int canvasWidth) {
+    iGmLayoutKey key = layoutKey_GmDocument_(d);
+    key.width         = width;
+    key.outsideMargin = iMax(0, (canvasWidth - width) / 2);
+    iConstForEach(PtrArray, i, &d->layoutCache) {
+        if (equal_GmLayoutKey(&((const iGmCachedLayout *) i.ptr)->key, &key)) {
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
+static void rebaseSourceRanges_GmDocument_(iGmDocument *d, iRangecc oldSource);
+
+iGmDocument *newLayoutCopy_GmDocument(const iGmDocument *d) {
+    /* Inline media is not copied, so the copy's layout would be missing it. */
+    if (!isEmpty_Media(d->media)) {
+        return NULL;
+    }
+    iGmDocument *copy = new_GmDocument();
+    copy->format             = d->format;
+    copy->size               = d->size;
+    copy->outsideMargin      = d->outsideMargin;
+    copy->enableCommandLinks = d->enableCommandLinks;
+    copy->isLayoutCopy       = iTrue;
+    copy->layoutRevision     = d->layoutRevision;
+    copy->normState          = d->normState;
+    copy->theme              = d->theme;
+    copy->themeSeed          = d->themeSeed;
+    copy->siteIcon           = d->siteIcon;
+    copy->warnings           = d->warnings;
+    copy->openURLs           = d->openURLs ? ref_Object(d->openURLs) : new_StringSet();
+    set_String(&copy->source, &d->source);
+    set_String(&copy->url, &d->url);
+    set_String(&copy->localHost, &d->localHost);
+    iConstForEach(Array, i, &d->preMeta) {
+        pushBack_Array(&copy->preMeta, i.value); /* fold states */
+    }
+    return copy;
+}
+
+iBool takeLayout_GmDocument(iGmDocument *d, iGmDocument *layoutCopy) {
+    iAssert(layoutCopy->isLayoutCopy);
+    /* If the document was laid out again in the meantime, the copy is out of date. */
+    if (layoutCopy->layoutRevision != d->layoutRevision ||
+        size_String(&layoutCopy->source) != size_String(&d->source) ||
+        !isEmpty_Media(d->media)) {
+        return iFalse;
+    }
+    storeLayout_GmDocument_(d); /* the old width may be needed again */
+    iSwap(iArray,    d->layout,   layoutCopy->layout);
+    iSwap(iGmRunIndex, d->runIndex, layoutCopy->runIndex); /* source offsets are the same */
+    iSwap(iPtrArray, d->links,    layoutCopy->links);
+    iSwap(iArray,    d->headings, layoutCopy->headings);
+    iSwap(iArray,    d->preMeta,  layoutCopy->preMeta);
+    iSwap(iSortedArray, d->glyphs, layoutCopy->glyphs);
+    iSwap(iString,   d->title,    layoutCopy->title);
+    d->size          = layoutCopy->size;
+    d->outsideMargin = layoutCopy->outsideMargin;
+    d->theme         = layoutCopy->theme;
+    d->warnings      = layoutCopy->warnings;
+    d->layoutState   = layoutCopy->layoutState;
+    d->layoutKey     = layoutCopy->layoutKey;
+    d->isLayoutInvalidated = iFalse;
+    d->layoutRevision++;
+    /* Everything still points to the copy's source. */
+    rebaseSourceRanges_GmDocument_(d, range_String(&layoutCopy->source));
+    return iTrue;
+}
+
 void invalidateLayout_GmDocument(iGmDocument *d) {
+    clearLayoutCache_GmDocument_(d);
     d->isLayoutInvalidated = iTrue;
+    d->layoutState.isValid = iFalse;
 }
 
 static void markLinkRunsVisited_GmDocument_(iGmDocument *d, const iIntSet *linkIds) {
@@ -1787,10 +2274,16 @@ iLocalDef iBool isNormalizableSpace_(char ch) {
     return ch == ' ' || ch == '\t';
 }
 
-static void normalize_GmDocument(iGmDocument *d) {
-    iString *normalized = new_String();
-    iRangecc src = range_String(&d->source);
-    /* Check for a BOM. In UTF-8, the BOM can just be skipped if present. */ {
+static void normalizeAppended_GmDocument_(iGmDocument *d) {
+    /* Lines are normalized starting from the last complete one; the previous output from that
+       point onwards is replaced. */
+    iGmNormState *st = &d->normState;
+    iString *normalized = &d->source;
+    truncate_Block(&normalized->chars, st->destPos);
+    iRangecc src = { constBegin_String(&d->unormSource) + st->srcPos,
+                     constEnd_String(&d->unormSource) };
+    if (st->srcPos == 0) {
+        /* Check for a BOM. In UTF-8, the BOM can just be skipped if present. */
         iChar ch = 0;
         decodeBytes_MultibyteChar(src.start, src.end, &ch);
         if (ch == 0xfeff) /* zero-width non-breaking space */ {
@@ -1798,7 +2291,7 @@ static void normalize_GmDocument(iGmDocument *d) {
         }
     }
     iRangecc line = iNullRange;
-    iBool isPreformat = iFalse;
+    iBool isPreformat = st->isPreformat;
     if (d->format == plainText_SourceFormat) {
         isPreformat = iTrue; /* Cannot be turned off. */
     }
@@ -1806,6 +2299,10 @@ static void normalize_GmDocument(iGmDocument *d) {
     iBool wasNormalized = iFalse;
     iBool hasTabs = iFalse;
     while (nextSplit_Rangecc(src, "\n", &line)) {
+        /* The last line may still be incomplete. */
+        st->srcPos      = line.start - constBegin_String(&d->unormSource);
+        st->destPos     = size_String(normalized);
+        st->isPreformat = isPreformat;
         if (isPreformat) {
             /* Replace any tab characters with spaces for visualization. */
             for (const char *ch = line.start; ch != line.end; ch++) {
@@ -1875,15 +2372,89 @@ static void normalize_GmDocument(iGmDocument *d) {
 //    printf("hasTabs: %d\n", hasTabs);
 //    printf("wasNormalized: %d\n", wasNormalized);
 //    fflush(stdout);
-    set_String(&d->source, collect_String(normalized));
     //normalize_String(&d->source); /* NFC */
 //    printf("orig:%zu norm:%zu\n", size_String(&d->unormSource), size_String(&d->source));
     /* normalized source has an extra newline at the end */
 //    iAssert(wasNormalized || equal_String(&d->unormSource, &d->source));
 }
 
+static void appendSource_GmDocument_(iGmDocument *d) {
+    /* Updates the (normalized) source to match the unnormalized source, processing only the
+       content after the last complete line. */
+    iGmNormState *st = &d->normState;
+    st->isNormalized = isNormalized_GmDocument_(d);
+    if (st->isNormalized) {
+        normalizeAppended_GmDocument_(d);
+        return;
+    }
+    const char *src = constBegin_String(&d->unormSource);
+    truncate_Block(&d->source.chars, st->destPos);
+    appendRange_String(&d->source, (iRangecc){ src + st->srcPos, constEnd_String(&d->unormSource) });
+    for (const char *end = constEnd_String(&d->unormSource); end > src + st->srcPos; end--) {
+        if (end[-1] == '\n') {
+            st->srcPos = st->destPos = end - src;
+            break;
+        }
+    }
+}
+
+static void rebaseRange_(iRangecc *range, iRangecc oldSource, const char *newStart) {
+    if (range->start >= oldSource.start && range->start <= oldSource.end) {
+        range->start = newStart + (range->start - oldSource.start);
+        range->end   = newStart + (range->end   - oldSource.start);
+    }
+}
+
+static void rebaseSourceRanges_GmDocument_(iGmDocument *d, iRangecc oldSource) {
+    /* The source may have been reallocated. Ranges that point to other strings (e.g.,
+       decorations) are left as is. */
+    const char *newStart = constBegin_String(&d->source);
+    if (newStart == oldSource.start) {
+        return;
+    }
+    iForEach(Array, i, &d->layout) {
+        rebaseRange_(&((iGmRun *) i.value)->text, oldSource, newStart);
+    }
+    iForEach(PtrArray, j, &d->links) {
+        iGmLink *link = j.ptr;
+        rebaseRange_(&link->urlRange, oldSource, newStart);
+        rebaseRange_(&link->labelRange, oldSource, newStart);
+        rebaseRange_(&link->labelIcon, oldSource, newStart);
+    }
+    iForEach(Array, h, &d->headings) {
+        rebaseRange_(&((iGmHeading *) h.value)->text, oldSource, newStart);
+    }
+    iForEach(Array, p, &d->preMeta) {
+        iGmPreMeta *meta = p.value;
+        rebaseRange_(&meta->bounds, oldSource, newStart);
+        rebaseRange_(&meta->altText, oldSource, newStart);
+        rebaseRange_(&meta->contents, oldSource, newStart);
+    }
+}
+
+static iBool canAppendSource_GmDocument_(const iGmDocument *d, const iString *source, int width,
+                                         int canvasWidth) {
+    if (!d->layoutState.isValid || d->isLayoutInvalidated ||
+        d->normState.isNormalized != isNormalized_GmDocument_(d)) {
+        return iFalse;
+    }
+    if (d->format != gemini_SourceFormat && d->format != plainText_SourceFormat) {
+        return iFalse;
+    }
+    if (d->size.x != width || d->outsideMargin != iMax(0, (canvasWidth - width) / 2)) {
+        return iFalse;
+    }
+    const size_t oldSize = size_String(&d->unormSource);
+    return oldSize > 0 && size_String(source) > oldSize &&
+           memcmp(constBegin_String(source), constBegin_String(&d->unormSource), oldSize) == 0;
+}
+
 void setUrl_GmDocument(iGmDocument *d, const iString *url) {
     url = canonicalUrl_String(url);
+    if (!equal_String(&d->url, url)) {
+        d->layoutState.isValid = iFalse; /* links need to be resolved again */
+        clearLayoutCache_GmDocument_(d);
+    }
     set_String(&d->url, url);
     iUrl parts;
     init_Url(&parts, url);
@@ -2091,8 +2662,6 @@ static void convertMarkdownToGemtext_GmDocument_(iGmDocument *d) {
 
 void setSource_GmDocument(iGmDocument *d, const iString *source, int width, int canvasWidth,
                           enum iGmDocumentUpdate updateType) {
-    /* TODO: This API has been set up to allow partial/progressive updating of the content.
-       Currently the entire source is replaced every time, though. */
 //    printf("[GmDocument] source update (%zu bytes), width:%d, final:%d\n",
 //           size_String(source), width, updateType == final_GmDocumentUpdate);
     if (size_String(source) == size_String(&d->unormSource)) {
@@ -2100,6 +2669,32 @@ void setSource_GmDocument(iGmDocument *d, const iString *source, int width, int
 //        printf("[GmDocument] source is unchanged!\n");
         return; /* Nothing to do. */
     }
+    clearLayoutCache_GmDocument_(d); /* only valid for the old source */
+    if (canAppendSource_GmDocument_(d, source, width, canvasWidth)) {
+        /* More content has arrived. Only the new lines need to be processed and laid out;
+           the incomplete last line is always redone. */
+        const iRangecc oldSource  = range_String(&d->source);
+        const size_t   newLinePos = d->normState.srcPos;
+        appendRange_String(&d->unormSource,
+                           (iRangecc){ constBegin_String(source) + size_String(&d->unormSource),
+                                       constEnd_String(source) });
+        if (~d->warnings & ansiEscapes_GmDocumentWarning) {
+            iRegExp *ansiEsc = new_RegExp("\x1b[[()]([0-9;AB]*?)[ABCDEFGHJKSTfimn]", 0);
+            iRegExpMatch m;
+            init_RegExpMatch(&m);
+            if (matchRange_RegExp(ansiEsc,
+                                  (iRangecc){ constBegin_String(&d->unormSource) + newLinePos,
+                                              constEnd_String(&d->unormSource) },
+                                  &m)) {
+                d->warnings |= ansiEscapes_GmDocumentWarning;
+            }
+            iRelease(ansiEsc);
+        }
+        appendSource_GmDocument_(d);
+        rebaseSourceRanges_GmDocument_(d, oldSource);
+        layout_GmDocument_(d, iTrue);
+        return;
+    }
     /* Normalize and convert to Gemtext if needed. */
     set_String(&d->unormSource, source);
     set_String(&d->source, source);
@@ -2128,13 +2723,14 @@ void setSource_GmDocument(iGmDocument *d, const iString *source, int width, int
     else {
         d->theme.ansiEscapes = allowAll_AnsiFlag;
     }
-    if (isNormalized_GmDocument_(d)) {
-        normalize_GmDocument(d);
-    }
+    iZap(d->normState);
+    appendSource_GmDocument_(d);
+    d->layoutState.isValid = iFalse; /* old layout refers to the previous source */
     setWidth_GmDocument(d, width, canvasWidth); /* re-do layout */
 }
 
 void foldPre_GmDocument(iGmDocument *d, uint16_t preId) {
+    clearLayoutCache_GmDocument_(d);
     if (preId > 0 && preId <= size_Array(&d->preMeta)) {
         iGmPreMeta *meta = at_Array(&d->preMeta, preId - 1);
         meta->flags ^= folded_GmPreMetaFlag;
@@ -2169,9 +2765,11 @@ void render_GmDocument(const iGmDocument *d, iRangei visRangeY, iGmDocumentRende
                        void *context) {
     iBool isInside = iFalse;
     setAnsiFlags_Text(d->theme.ansiEscapes);
-    /* TODO: Check lookup table for quick starting position. */
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
+    const size_t numRuns = size_Array(&d->layout);
+    for (size_t i = firstRun_GmRunIndex_(&d->runIndex.visBands, yBandHeight_GmRunIndex_,
+                                         visRangeY.start, numRuns);
+         i < numRuns; i++) {
+        const iGmRun *run = constAt_Array(&d->layout, i);
         if (isInside) {
             if (top_Rect(run->visBounds) > visRangeY.end) {
                 break;
@@ -2257,6 +2855,8 @@ size_t memorySize_GmDocument(const iGmDocument *d) {
            size_String(&d->source) +
            size_Array(&d->layout) * sizeof(iGmRun) +
            size_Array(&d->links)  * sizeof(iGmLink) +
+           memorySize_GmRunIndex_(&d->runIndex) +
+           layoutCacheSize_GmDocument_(d) +
            memorySize_Media(d->media);
 }
 
@@ -2306,11 +2906,21 @@ iGmRunRange findPreformattedRange_GmDocument(const iGmDocument *d, const iGmRun
 }
 
 const iGmRun *findRun_GmDocument(const iGmDocument *d, iInt2 pos) {
-    /* TODO: Perf optimization likely needed; use a block map? */
+    const size_t numRuns = size_Array(&d->layout);
+    const size_t start   = firstRun_GmRunIndex_(&d->runIndex.hitBands, yBandHeight_GmRunIndex_,
+                                                pos.y, numRuns);
     const iGmRun *last = NULL;
-    iBool isFirstNonDecoration = iTrue;
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
+    /* All the runs before `start` are above the point. */
+    for (size_t i = start; i > 0; i--) {
+        const iGmRun *run = constAt_Array(&d->layout, i - 1);
+        if (~run->flags & decoration_GmRunFlag) {
+            last = run;
+            break;
+        }
+    }
+    iBool isFirstNonDecoration = (last == NULL);
+    for (size_t i = start; i < numRuns; i++) {
+        const iGmRun *run = constAt_Array(&d->layout, i);
         if (run->flags & decoration_GmRunFlag) continue;
         const iRangei span = ySpan_Rect(run->bounds);
         if (contains_Range(&span, pos.y)) {
@@ -2341,8 +2951,14 @@ iRangecc findLoc_GmDocument(const iGmDocument *d, iInt2 pos) {
 }
 
 const iGmRun *findRunAtLoc_GmDocument(const iGmDocument *d, const char *textCStr) {
-    iConstForEach(Array, i, &d->layout) {
-        const iGmRun *run = i.value;
+    const size_t numRuns = size_Array(&d->layout);
+    size_t       start   = 0;
+    if (textCStr >= constBegin_String(&d->source) && textCStr <= constEnd_String(&d->source)) {
+        start = firstRun_GmRunIndex_(&d->runIndex.locBands, locBandSize_GmRunIndex_,
+                                     textCStr - constBegin_String(&d->source), numRuns);
+    }
+    for (size_t i = start; i < numRuns; i++) {
+        const iGmRun *run = constAt_Array(&d->layout, i);
         if (run->flags & decoration_GmRunFlag) {
             continue;
         }
@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/array.h>
 #include <the_Foundation/object.h>
 #include <the_Foundation/rect.h>
+#include <the_Foundation/sortedarray.h>
 #include <the_Foundation/string.h>
 #include <the_Foundation/time.h>
 
@@ -185,7 +186,10 @@ void    setFormat_GmDocument    (iGmDocument *, enum iSourceFormat format);
 void    setWidth_GmDocument     (iGmDocument *, int width, int canvasWidth);
 iBool   updateWidth_GmDocument  (iGmDocument *, int width, int canvasWidth);
 void    redoLayout_GmDocument   (iGmDocument *);
+iBool   isLayoutCached_GmDocument(const iGmDocument *, int width, int canvasWidth);
 void    invalidateLayout_GmDocument(iGmDocument *); /* will have to be redone later */
+iGmDocument *newLayoutCopy_GmDocument(const iGmDocument *); /* NULL if not possible */
+iBool   takeLayout_GmDocument   (iGmDocument *, iGmDocument *layoutCopy);
 iBool   updateOpenURLs_GmDocument(iGmDocument *);
 void    setUrl_GmDocument       (iGmDocument *, const iString *url);
 void    setSource_GmDocument    (iGmDocument *, const iString *source, int width, int canvasWidth,
@@ -210,6 +214,7 @@ const iGmRun *  renderProgressive_GmDocument(const iGmDocument *d, const iGmRun
                                              void *context);
 iInt2           size_GmDocument             (const iGmDocument *);
 const iArray *  headings_GmDocument         (const iGmDocument *); /* array of GmHeadings */
+const iSortedArray *glyphs_GmDocument       (const iGmDocument *); /* used glyphs, see text.h */
 const iString * source_GmDocument           (const iGmDocument *);
 size_t          memorySize_GmDocument       (const iGmDocument *); /* bytes */
 int             warnings_GmDocument         (const iGmDocument *);
@@ -172,6 +172,11 @@ struct Impl_GmRequest {
     iAudience *          updated;
     iAudience *          finished;
     iGmRequestProgressFunc sendProgress;
+    enum iGmBodySinkType sinkType;
+    iGmRequestBodyFunc   sinkFunc;
+    iAnyObject *         sinkContext;
+    iFile *              sinkFile; /* owned; context of the file sink */
+    size_t               bodyOffset; /* number of body bytes no longer in `resp->body` */
 };
 
 iDefineObjectConstructionArgs(GmRequest, (iGmCerts *certs), certs)
@@ -208,6 +213,31 @@ static void checkServerCertificate_GmRequest_(iGmRequest *d) {
     }
 }
 
+static void flushBody_GmRequest_(iGmRequest *d) {
+    /* Note: Mutex must be locked. */
+    iBlock *body = &d->resp->body;
+    if (d->sinkType == memory_GmBodySinkType || d->isRespFiltered || isEmpty_Block(body)) {
+        return;
+    }
+    d->sinkFunc(d->sinkContext, d, range_Block(body));
+    d->bodyOffset += size_Block(body);
+    clear_Block(body);
+}
+
+static void resetBodySink_GmRequest_(iGmRequest *d) {
+    /* Note: Mutex must be locked. */
+    iReleasePtr(&d->sinkFile);
+    d->sinkType    = memory_GmBodySinkType;
+    d->sinkFunc    = NULL;
+    d->sinkContext = NULL;
+}
+
+static void endBody_GmRequest_(iGmRequest *d) {
+    /* Note: Mutex must be locked. The rest of the body is passed on and the file closed. */
+    flushBody_GmRequest_(d);
+    iReleasePtr(&d->sinkFile);
+}
+
 static int processIncomingData_GmRequest_(iGmRequest *d, const iBlock *data) {
     iBool        notifyUpdate = iFalse;
     iBool        notifyDone   = iFalse;
@@ -252,6 +282,7 @@ static int processIncomingData_GmRequest_(iGmRequest *d, const iBlock *data) {
                 if (d->isFilterEnabled && willTryFilter_MimeHooks(mimeHooks_App(), &resp->meta)) {
                     d->isRespFiltered = iTrue;
                 }
+                flushBody_GmRequest_(d);
             }
             checkServerCertificate_GmRequest_(d);
             iRelease(metaPattern);
@@ -259,6 +290,7 @@ static int processIncomingData_GmRequest_(iGmRequest *d, const iBlock *data) {
     }
     else if (d->state == receivingBody_GmRequestState) {
         append_Block(&resp->body, data);
+        flushBody_GmRequest_(d);
         notifyUpdate = iTrue;
     }
     return (notifyUpdate ? 1 : 0) | (notifyDone ? 2 : 0);
@@ -338,6 +370,7 @@ static void requestFinished_GmRequest_(iGmRequest *d, iTlsRequest *req) {
     if (d->isRespFiltered && d->state == finished_GmRequestState) {
         applyFilter_GmRequest_(d);
     }
+    iGuardMutex(d->mtx, endBody_GmRequest_(d));
     iNotifyAudience(d, finished, GmRequestFinished);
 }
 
@@ -474,6 +507,7 @@ static void gopherRead_GmRequest_(iGmRequest *d, iSocket *socket) {
     iBlock *data = readAll_Socket(socket);
     if (!isEmpty_Block(data)) {
         processResponse_Gopher(&d->gopher, data);
+        flushBody_GmRequest_(d);
     }
     delete_Block(data);
     unlock_Mutex(d->mtx);
@@ -490,6 +524,7 @@ static void gopherDisconnected_GmRequest_(iGmRequest *d, iSocket *socket) {
         d->state = finished_GmRequestState;
         notify = iTrue;
     }
+    endBody_GmRequest_(d);
     unlock_Mutex(d->mtx);
     if (notify) {
         iNotifyAudience(d, finished, GmRequestFinished);
@@ -503,6 +538,7 @@ static void gopherError_GmRequest_(iGmRequest *d, iSocket *socket, int error, co
     d->resp->statusCode = tlsFailure_GmStatusCode;
     format_String(&d->resp->meta, "%s (errno %d)", msg, error);
     clear_Block(&d->resp->body);
+    endBody_GmRequest_(d);
     unlock_Mutex(d->mtx);
     iNotifyAudience(d, finished, GmRequestFinished);
 }
@@ -545,6 +581,11 @@ void init_GmRequest(iGmRequest *d, iGmCerts *certs) {
     d->updated  = NULL;
     d->finished = NULL;
     d->sendProgress = NULL;
+    d->sinkType    = memory_GmBodySinkType;
+    d->sinkFunc    = NULL;
+    d->sinkContext = NULL;
+    d->sinkFile    = NULL;
+    d->bodyOffset  = 0;
     d->state    = initialized_GmRequestState;
 }
 
@@ -564,6 +605,7 @@ void deinit_GmRequest(iGmRequest *d) {
         unlock_Mutex(d->mtx);
     }
     iReleasePtr(&d->req);
+    iReleasePtr(&d->sinkFile);
     delete_TitanData(d->titan);
     deinit_Gopher(&d->gopher);
     delete_Audience(d->finished);
@@ -612,6 +654,46 @@ void setSendProgressFunc_GmRequest(iGmRequest *d, iGmRequestProgressFunc func) {
     d->sendProgress = func;
 }
 
+static void writeBodyFile_GmRequest_(iAnyObject *file, iGmRequest *req, iRangecc data) {
+    iUnused(req);
+    writeData_File(file, data.start, size_Range(&data));
+}
+
+iBool setBodyFile_GmRequest(iGmRequest *d, const iString *path) {
+    iFile *file = new_File(path);
+    if (!open_File(file, writeOnly_FileMode)) {
+        iRelease(file);
+        return iFalse;
+    }
+    lock_Mutex(d->mtx);
+    resetBodySink_GmRequest_(d);
+    d->sinkType    = file_GmBodySinkType;
+    d->sinkFunc    = writeBodyFile_GmRequest_;
+    d->sinkContext = file;
+    d->sinkFile    = file;
+    /* Some or all of the body may have been received already. */
+    if (d->state == finished_GmRequestState || d->state == failure_GmRequestState) {
+        endBody_GmRequest_(d);
+    }
+    else {
+        flushBody_GmRequest_(d);
+    }
+    unlock_Mutex(d->mtx);
+    return iTrue;
+}
+
+void setBodyFunc_GmRequest(iGmRequest *d, iAnyObject *context, iGmRequestBodyFunc func) {
+    lock_Mutex(d->mtx);
+    resetBodySink_GmRequest_(d);
+    if (func) {
+        d->sinkType    = callback_GmBodySinkType;
+        d->sinkFunc    = func;
+        d->sinkContext = context;
+        flushBody_GmRequest_(d);
+    }
+    unlock_Mutex(d->mtx);
+}
+
 static void bytesSent_GmRequest_(iGmRequest *d, iTlsRequest *req, size_t sent, size_t toSend) {
     iUnused(req);
     if (d->sendProgress) {
@@ -652,6 +734,7 @@ void submit_GmRequest(iGmRequest *d) {
     set_Atomic(&d->allowUpdate, iTrue);
     iGmResponse *resp = d->resp;
     clear_GmResponse(resp);
+    d->bodyOffset = 0;
 #if !defined (NDEBUG)
     printf("[GmRequest] URL: %s\n", cstr_String(&d->url)); fflush(stdout);
 #endif
@@ -981,6 +1064,26 @@ void unlockResponse_GmRequest(iGmRequest *d) {
     }
 }
 
+iRangecc bodyView_GmRequest(const iGmRequest *d, size_t offset) {
+    /* The returned range points directly to the response body, so it remains valid only
+       while the response is locked. */
+    iAssert(d->isRespLocked);
+    iRangecc view = range_Block(&d->resp->body);
+    if (offset > d->bodyOffset) {
+        view.start += iMin(offset - d->bodyOffset, size_Range(&view));
+    }
+    return view;
+}
+
+void consumeBody_GmRequest(iGmRequest *d, size_t size) {
+    /* The reader has taken the beginning of the body, so it doesn't need to be kept around. */
+    iAssert(d->isRespLocked);
+    iBlock *body = &d->resp->body;
+    size = iMin(size, size_Block(body));
+    remove_Block(body, 0, size);
+    d->bodyOffset += size;
+}
+
 uint32_t id_GmRequest(const iGmRequest *d) {
     return d ? d->id : 0;
 }
@@ -1016,10 +1119,16 @@ const iBlock *body_GmRequest(const iGmRequest *d) {
 
 size_t bodySize_GmRequest(const iGmRequest *d) {
     size_t size;
-    iGuardMutex(d->mtx, size = size_Block(&d->resp->body));
+    iGuardMutex(d->mtx, size = d->bodyOffset + size_Block(&d->resp->body));
     return size;
 }
 
+enum iGmBodySinkType bodySink_GmRequest(const iGmRequest *d) {
+    enum iGmBodySinkType type;
+    iGuardMutex(d->mtx, type = d->sinkType);
+    return type;
+}
+
 const iString *url_GmRequest(const iGmRequest *d) {
     return &d->url;
 }
@@ -67,6 +67,19 @@ iDeclareAudienceGetter(GmRequest, updated)
 iDeclareAudienceGetter(GmRequest, finished)
     
 typedef void (*iGmRequestProgressFunc)(iGmRequest *, size_t current, size_t total);
+typedef void (*iGmRequestBodyFunc)    (iAnyObject *context, iGmRequest *, iRangecc data);
+
+/* The body sink determines where received body data goes. By default, the whole body is
+   kept in memory in the response. The other sinks are given each part of the body as it
+   arrives, and afterwards `iGmResponse.body` only holds data that has not been passed on.
+   Sink functions are called on the network thread with the response locked. A sink can be
+   set once the response header has been received; data already in memory is passed on
+   immediately. Filtered responses always stay in memory because hooks need the whole body. */
+enum iGmBodySinkType {
+    memory_GmBodySinkType,
+    file_GmBodySinkType,
+    callback_GmBodySinkType,
+};
 
 void                enableFilters_GmRequest     (iGmRequest *, iBool enable);
 void                setUrl_GmRequest            (iGmRequest *, const iString *url);
@@ -74,18 +87,24 @@ void                setIdentity_GmRequest       (iGmRequest *, const iGmIdentity
 void                setTitanData_GmRequest      (iGmRequest *, const iString *mime,
                                                  const iBlock *payload, const iString *token);
 void                setSendProgressFunc_GmRequest(iGmRequest *, iGmRequestProgressFunc func);
+iBool               setBodyFile_GmRequest       (iGmRequest *, const iString *path);
+void                setBodyFunc_GmRequest       (iGmRequest *, iAnyObject *context,
+                                                 iGmRequestBodyFunc func);
 void                submit_GmRequest            (iGmRequest *);
 void                cancel_GmRequest            (iGmRequest *);
 
 iGmResponse *       lockResponse_GmRequest      (iGmRequest *);
 void                unlockResponse_GmRequest    (iGmRequest *);
+iRangecc            bodyView_GmRequest          (const iGmRequest *, size_t offset); /* response locked; no copy */
+void                consumeBody_GmRequest       (iGmRequest *, size_t size); /* response locked */
 
 uint32_t            id_GmRequest                (const iGmRequest *); /* unique ID */
 iBool               isFinished_GmRequest        (const iGmRequest *);
 enum iGmStatusCode  status_GmRequest            (const iGmRequest *);
 const iString *     meta_GmRequest              (const iGmRequest *);
 const iBlock  *     body_GmRequest              (const iGmRequest *);
-size_t              bodySize_GmRequest          (const iGmRequest *);
+size_t              bodySize_GmRequest          (const iGmRequest *); /* total received */
+enum iGmBodySinkType bodySink_GmRequest         (const iGmRequest *);
 const iString *     url_GmRequest               (const iGmRequest *);
 
 int                 certFlags_GmRequest         (const iGmRequest *);
@@ -23,6 +23,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "history.h"
 #include "ui/root.h"
 #include "app.h"
+#include "contentcache.h"
 
 #include <the_Foundation/file.h>
 #include <the_Foundation/mutex.h>
@@ -174,13 +175,7 @@ void serialize_History(const iHistory *d, iStream *outs) {
         serialize_String(&item->url, outs);
         write32_Stream(outs, item->normScrollY * 1.0e6f);
         writeU16_Stream(outs, item->flags.openedFromSidebar ? iBit(1) : 0);
-        if (item->cachedResponse) {
-            write8_Stream(outs, 1);
-            serialize_GmResponse(item->cachedResponse, outs);
-        }
-        else {
-            write8_Stream(outs, 0);
-        }
+        write8_Stream(outs, 0); /* cached responses are in the ContentCache */
     }
     unlock_Mutex(d->mtx);
 }
@@ -203,8 +198,12 @@ void deserialize_History(iHistory *d, iStream *ins) {
             }
         }
         if (read8_Stream(ins)) {
+            /* Older state files have the cached responses inline. */
             item.cachedResponse = new_GmResponse();
             deserialize_GmResponse(item.cachedResponse, ins);
+            if (!contains_ContentCache(contentCache_App(), &item.url)) {
+                store_ContentCache(contentCache_App(), &item.url, item.cachedResponse);
+            }
         }
         pushBack_Array(&d->recent, &item);
     }
@@ -386,6 +385,7 @@ void setCachedResponse_History(iHistory *d, const iGmResponse *response) {
         item->cachedResponse = NULL;
         if (category_GmStatusCode(response->statusCode) == categorySuccess_GmStatusCode) {
             item->cachedResponse = copy_GmResponse(response);
+            store_ContentCache(contentCache_App(), &item->url, response);
         }
     }
     unlock_Mutex(d->mtx);
@@ -451,36 +451,6 @@ void invalidateCachedLayout_History(iHistory *d) {
     unlock_Mutex(d->mtx);
 }
 
-size_t pruneLeastImportant_History(iHistory *d) {
-    size_t delta  = 0;
-    size_t chosen = iInvalidPos;
-    double score  = 0.0f;
-    iTime now;
-    initCurrent_Time(&now);
-    lock_Mutex(d->mtx);
-    iConstForEach(Array, i, &d->recent) {
-        const iRecentUrl *url = i.value;
-        if (url->cachedResponse) {
-            const double urlScore =
-                cacheSize_RecentUrl(url) *
-                pow(secondsSince_Time(&now, &url->cachedResponse->when) / 60.0, 1.25);
-            if (urlScore > score) {
-                chosen = index_ArrayConstIterator(&i);
-                score  = urlScore;
-            }
-        }
-    }
-    if (chosen != iInvalidPos) {
-        iRecentUrl *url = at_Array(&d->recent, chosen);
-        delta = cacheSize_RecentUrl(url);
-        delete_GmResponse(url->cachedResponse);
-        url->cachedResponse = NULL;
-        iReleasePtr(&url->cachedDoc);
-    }
-    unlock_Mutex(d->mtx);
-    return delta;
-}
-
 size_t pruneLeastImportantMemory_History(iHistory *d) {
     size_t delta  = 0;
     size_t chosen = iInvalidPos;
@@ -493,7 +463,7 @@ size_t pruneLeastImportantMemory_History(iHistory *d) {
         if (d->recentPos == size_Array(&d->recent) - index_ArrayConstIterator(&i) - 1) {
             continue; /* Not the current navigation position. */
         }
-        if (url->cachedDoc) {
+        if (url->cachedDoc || url->cachedResponse) {
             const double urlScore =
                 memorySize_RecentUrl(url) *
                 (url->cachedResponse
@@ -509,6 +479,9 @@ size_t pruneLeastImportantMemory_History(iHistory *d) {
         iRecentUrl *url = at_Array(&d->recent, chosen);
         const size_t before = memorySize_RecentUrl(url);
         iReleasePtr(&url->cachedDoc);
+        /* The response can be reloaded from the ContentCache. */
+        delete_GmResponse(url->cachedResponse);
+        url->cachedResponse = NULL;
         delta = before - memorySize_RecentUrl(url);
     }
     unlock_Mutex(d->mtx);
@@ -526,7 +499,8 @@ void invalidateTheme_History(iHistory *d) {
     unlock_Mutex(d->mtx);
 }
 
-const iStringArray *searchContents_History(const iHistory *d, const iRegExp *pattern) {
+const iStringArray *searchContents_History(const iHistory *d, const iRegExp *pattern,
+                                           const iStringSet *candidates) {
     iStringArray *urls = iClob(new_StringArray());
     lock_Mutex(d->mtx);
     iStringSet inserted;
@@ -534,10 +508,20 @@ const iStringArray *searchContents_History(const iHistory *d, const iRegExp *pat
     iReverseConstForEach(Array, i, &d->recent) {
         const iRecentUrl *url = i.value;
         const iGmResponse *resp = url->cachedResponse;
+        iGmResponse *diskResp = NULL;
+        if (!resp && candidates && contains_StringSet(candidates, canonicalUrl_String(&url->url))) {
+            /* Not kept in memory, e.g., visited in an earlier session. */
+            resp = diskResp = find_ContentCache(contentCache_App(), &url->url);
+        }
         if (resp && category_GmStatusCode(resp->statusCode) == categorySuccess_GmStatusCode) {
             if (indexOfCStrSc_String(&resp->meta, "text/", &iCaseInsensitive) == iInvalidPos) {
+                delete_GmResponse(diskResp);
                 continue;
             }
+            if (candidates && !contains_StringSet(candidates, canonicalUrl_String(&url->url))) {
+                delete_GmResponse(diskResp);
+                continue; /* search index says there is no match */
+            }
             iRegExpMatch m;
             init_RegExpMatch(&m);
             if (matchRange_RegExp(pattern, range_Block(&resp->body), &m)) {
@@ -571,6 +555,7 @@ const iStringArray *searchContents_History(const iHistory *d, const iRegExp *pat
                 deinit_String(&entry);
             }
         }
+        delete_GmResponse(diskResp);
     }
     deinit_StringSet(&inserted);
     unlock_Mutex(d->mtx);
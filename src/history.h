@@ -29,6 +29,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/string.h>
 #include <the_Foundation/stringarray.h>
+#include <the_Foundation/stringset.h>
 #include <the_Foundation/time.h>
 
 iDeclareType(RecentUrl)
@@ -73,7 +74,6 @@ iRecentUrl *mostRecentUrl_History       (iHistory *);
 iRecentUrl *findUrl_History             (iHistory *, const iString *url);
 
 void        clearCache_History                  (iHistory *);
-size_t      pruneLeastImportant_History         (iHistory *);
 size_t      pruneLeastImportantMemory_History   (iHistory *);
 void        invalidateTheme_History             (iHistory *); /* theme has changed, cached contents need updating */
 void        invalidateCachedLayout_History      (iHistory *);
@@ -81,7 +81,8 @@ void        invalidateCachedLayout_History      (iHistory *);
 iBool       atLatest_History            (const iHistory *);
 iBool       atOldest_History            (const iHistory *);
 
-const iStringArray *   searchContents_History   (const iHistory *, const iRegExp *pattern); /* chronologically ascending */
+const iStringArray *   searchContents_History   (const iHistory *, const iRegExp *pattern,
+                                                  const iStringSet *candidates); /* chronologically ascending */
 
 const iString *
             url_History                 (const iHistory *, size_t pos);
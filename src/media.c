@@ -35,8 +35,12 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #endif
 
 #include <the_Foundation/file.h>
+#include <the_Foundation/hash.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/stringlist.h>
+#include <the_Foundation/thread.h>
+#include <SDL_cpuinfo.h>
 #include <SDL_hints.h>
 #include <SDL_render.h>
 #include <SDL_timer.h>
@@ -44,14 +48,18 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 iDeclareType(GmMediaProps)
 
 struct Impl_GmMediaProps {
+    iHashNode node; /* key is the link ID */
     iGmLinkId linkId;
+    size_t    index; /* position in Media items */
     iString   mime;
     iString   url;
     iBool     isPermanent;
 };
 
 static void init_GmMediaProps_(iGmMediaProps *d) {
-    d->linkId = 0;
+    d->node.key = 0;
+    d->linkId   = 0;
+    d->index    = 0;
     init_String(&d->mime);
     init_String(&d->url);
     d->isPermanent = iFalse;
@@ -64,136 +72,436 @@ static void deinit_GmMediaProps_(iGmMediaProps *d) {
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(ImageDecoder)
+iDeclareType(ImageDecodeJob)
 iDeclareType(GmImage)
 
+/* Images are decoded, styled, and resized on worker threads. Only the texture is created
+   on the render thread, when the job is done. */
+
+struct Impl_ImageDecodeJob {
+    iBlock *         data;
+    iBool            isWebP;
+    iBool            isPreview; /* data is incomplete */
+    enum iImageStyle style;
+    iColor           colors[3]; /* background, paragraph, preformatted */
+    iInt2            maxSize;
+    /* Results: */
+    iInt2            texSize;
+    uint8_t *        pixels;
+    iBool            isDone;
+    iBool            isCancelled;
+};
+
+static void delete_ImageDecodeJob_(iImageDecodeJob *d) {
+    delete_Block(d->data);
+    free(d->pixels);
+    free(d);
+}
+
+enum iImageDecoderLimits {
+    maxThreads_ImageDecoder = 2,
+};
+
+struct Impl_ImageDecoder {
+    iMutex *   mtx;
+    iCondition jobsAvailable;
+    iPtrArray  queue;
+    iBool      quit;
+    size_t     numThreads;
+    iThread *  threads[maxThreads_ImageDecoder];
+};
+
+static iImageDecoder *decoder_;
+
 struct Impl_GmImage {
-    iGmMediaProps props;
-    iBlock        partialData; /* cleared when image is converted to texture */
-    iInt2         size;
-    size_t        numBytes;
-    SDL_Texture * texture;
+    iGmMediaProps     props;
+    iBlock            partialData; /* cleared when image is converted to texture */
+    iInt2             size;
+    size_t            numBytes;
+    size_t            previewBytes; /* amount of partial data in the latest preview */
+    SDL_Texture *     texture;
+    iImageDecodeJob * decodeJob;
 };
 
+static void cancelDecoding_GmImage_(iGmImage *d);
+
 void init_GmImage(iGmImage *d, const iBlock *data) {
     init_GmMediaProps_(&d->props);
-    initCopy_Block(&d->partialData, data);
-    d->size     = zero_I2();
-    d->numBytes = 0;
-    d->texture  = NULL;
+    if (data) {
+        initCopy_Block(&d->partialData, data);
+    }
+    else {
+        init_Block(&d->partialData, 0);
+    }
+    d->size      = zero_I2();
+    d->numBytes     = 0;
+    d->previewBytes = 0;
+    d->texture      = NULL;
+    d->decodeJob    = NULL;
 }
 
 void deinit_GmImage(iGmImage *d) {
+    cancelDecoding_GmImage_(d);
     deinit_Block(&d->partialData);
     SDL_DestroyTexture(d->texture);
     deinit_GmMediaProps_(&d->props);
 }
 
-static void applyImageStyle_(enum iImageStyle style, iInt2 size, uint8_t *imgData) {
+static void applyImageStyle_(enum iImageStyle style, const iColor *colors, iInt2 size,
+                             uint8_t *imgData) {
     if (style == original_ImageStyle) {
         return;
     }
-    uint8_t *pos       = imgData;
-    size_t   numPixels = size.x * size.y;
-    float    brighten  = 0.0f;
+    /* All the styles map a pixel based on its HSL luminance only, i.e., the sum of its
+       largest and smallest color component. The mapping is precomputed for each sum. */
+    uint8_t lut[511][3];
     if (style == bgFg_ImageStyle) {
-        iColor dark  = get_Color(tmBackground_ColorId);
-        iColor light = get_Color(tmParagraph_ColorId);
+        iColor dark  = colors[0];
+        iColor light = colors[1];
         if (hsl_Color(dark).lum > hsl_Color(light).lum) {
             iSwap(iColor, dark, light);
-        }        
-        while (numPixels-- > 0) {
-            iHSLColor hsl = hsl_Color((iColor){ pos[0], pos[1], pos[2], 255 });
-            const float s = 1.0f - hsl.lum;
-            const float t = hsl.lum;
-            pos[0] = dark.r * s + light.r * t;
-            pos[1] = dark.g * s + light.g * t;
-            pos[2] = dark.b * s + light.b * t;
-            pos += 4;
-        }        
-        return;
+        }
+        for (int sum = 0; sum < 511; sum++) {
+            const float t = sum / 510.0f;
+            const float s = 1.0f - t;
+            lut[sum][0] = dark.r * s + light.r * t;
+            lut[sum][1] = dark.g * s + light.g * t;
+            lut[sum][2] = dark.b * s + light.b * t;
+        }
     }
-    iColor colorize = (iColor){ 255, 255, 255, 255 };
-    if (style != grayscale_ImageStyle) {
-        colorize = get_Color(style == textColorized_ImageStyle ? tmParagraph_ColorId
-                                                               : tmPreformatted_ColorId);
-        /* Compensate for change in mid-tones. */
-        const int colMax = iMax(iMax(colorize.r, colorize.g), colorize.b);
-        brighten = iClamp(1.0f - (colorize.r + colorize.g + colorize.b) / (colMax * 3), 0.0f, 0.5f);
+    else {
+        iColor colorize = (iColor){ 255, 255, 255, 255 };
+        float  brighten = 0.0f;
+        if (style != grayscale_ImageStyle) {
+            colorize = colors[style == textColorized_ImageStyle ? 1 : 2];
+            /* Compensate for change in mid-tones. */
+            const int colMax = iMax(iMax(colorize.r, colorize.g), colorize.b);
+            brighten = iClamp(1.0f - (colorize.r + colorize.g + colorize.b) / (colMax * 3), 0.0f, 0.5f);
+        }
+        const iHSLColor hslColorize = hsl_Color(colorize);
+        for (int sum = 0; sum < 511; sum++) {
+            iHSLColor out = { hslColorize.hue, hslColorize.sat, sum / 510.0f, 1.0f };
+            out.lum = powf(out.lum, 1.0f + brighten * 2);
+            iColor outRgb = rgb_HSLColor(out);
+            lut[sum][0] = powf(outRgb.r / 255.0f, 1.0f - brighten * 0.75f) * 255;
+            lut[sum][1] = powf(outRgb.g / 255.0f, 1.0f - brighten * 0.75f) * 255;
+            lut[sum][2] = powf(outRgb.b / 255.0f, 1.0f - brighten * 0.75f) * 255;
+        }
     }
-    iHSLColor hslColorize = hsl_Color(colorize);
+    uint8_t *pos       = imgData;
+    size_t   numPixels = (size_t) size.x * size.y;
     while (numPixels-- > 0) {
-        iHSLColor hsl = hsl_Color((iColor){ pos[0], pos[1], pos[2], 255 });
-        iHSLColor out = { hslColorize.hue, hslColorize.sat, hsl.lum, 1.0f };
-        out.lum = powf(out.lum, 1.0f + brighten * 2);
-        iColor outRgb = rgb_HSLColor(out);
-        pos[0] = powf(outRgb.r / 255.0f, 1.0f - brighten * 0.75f) * 255;
-        pos[1] = powf(outRgb.g / 255.0f, 1.0f - brighten * 0.75f) * 255;
-        pos[2] = powf(outRgb.b / 255.0f, 1.0f - brighten * 0.75f) * 255;
+        const int r = pos[0], g = pos[1], b = pos[2];
+        const int hi = r > g ? (r > b ? r : b) : (g > b ? g : b);
+        const int lo = r < g ? (r < b ? r : b) : (g < b ? g : b);
+        const uint8_t *mapped = lut[hi + lo];
+        pos[0] = mapped[0];
+        pos[1] = mapped[1];
+        pos[2] = mapped[2];
         pos += 4;
     }
 }
 
-void makeTexture_GmImage(iGmImage *d) {
-    iBlock *data     = &d->partialData;
-    d->numBytes      = size_Block(data);
-    uint8_t *imgData = NULL;
-    if (cmp_String(&d->props.mime, "image/webp") == 0) {
 #if defined (LAGRANGE_ENABLE_WEBP)
-        imgData = WebPDecodeRGBA(constData_Block(data), size_Block(data), &d->size.x, &d->size.y);
+static uint8_t *decodePartialWebP_(const iBlock *data, iInt2 *size_out) {
+    /* Rows that have not been received yet are left transparent. */
+    uint8_t *     imgData = NULL;
+    WebPIDecoder *idec    = WebPINewRGB(MODE_RGBA, NULL, 0, 0);
+    if (!idec) {
+        return NULL;
+    }
+    const VP8StatusCode status = WebPIAppend(idec, constData_Block(data), size_Block(data));
+    if (status == VP8_STATUS_OK || status == VP8_STATUS_SUSPENDED) {
+        int lastY = 0, width = 0, height = 0, stride = 0;
+        const uint8_t *rgba = WebPIDecGetRGB(idec, &lastY, &width, &height, &stride);
+        if (rgba && lastY > 0) {
+            imgData = calloc((size_t) width * height, 4);
+            for (int y = 0; y < lastY; y++) {
+                memcpy(imgData + (size_t) y * width * 4, rgba + (size_t) y * stride, width * 4);
+            }
+            *size_out = init_I2(width, height);
+        }
+    }
+    WebPIDelete(idec);
+    return imgData;
+}
+#endif
+
+static void decode_ImageDecodeJob_(iImageDecodeJob *d) {
+    const iBlock *data    = d->data;
+    uint8_t *     imgData = NULL;
+    iInt2         size    = zero_I2();
+    if (d->isWebP) {
+#if defined (LAGRANGE_ENABLE_WEBP)
+        if (d->isPreview) {
+            imgData = decodePartialWebP_(data, &size);
+        }
+        else {
+            imgData = WebPDecodeRGBA(constData_Block(data), size_Block(data), &size.x, &size.y);
+        }
 #endif        
     }
     else {
+        /* stb_image decodes truncated JPEGs, too: the missing part of a baseline image is
+           left blank, and a progressive one is produced from the scans received so far. */
         imgData = stbi_load_from_memory(
-            constData_Block(data), size_Block(data), &d->size.x, &d->size.y, NULL, 4);
-        if (!imgData) {
+            constData_Block(data), size_Block(data), &size.x, &size.y, NULL, 4);
+        if (!imgData && !d->isPreview) {
             fprintf(stderr, "[media] image load failed: %s\n", stbi_failure_reason());
         }
     }
     if (!imgData) {
-        d->size    = zero_I2();
-        d->texture = NULL;
+        return;
+    }
+    /* TODO: Save some memory by checking if the alpha channel is actually in use. */
+    /* Resize down to min(maximum texture size, window size). */
+    iInt2 scaled = size;
+    if (scaled.x > d->maxSize.x) {
+        scaled.y = scaled.y * d->maxSize.x / scaled.x;
+        scaled.x = d->maxSize.x;
+    }
+    if (scaled.y > d->maxSize.y) {
+        scaled.x = scaled.x * d->maxSize.y / scaled.y;
+        scaled.y = d->maxSize.y;
+    }
+    if (!isEqual_I2(scaled, size)) {
+        uint8_t *scaledImgData = malloc(scaled.x * scaled.y * 4);
+        stbir_resize_uint8(imgData, size.x, size.y, 4 * size.x,
+                           scaledImgData, scaled.x, scaled.y, scaled.x * 4, 4);
+        free(imgData);
+        imgData = scaledImgData;
+    }
+    /* Styling is done at the final resolution. */
+    applyImageStyle_(d->style, d->colors, scaled, imgData);
+    d->pixels  = imgData;
+    d->texSize = scaled;
+}
+
+static iThreadResult worker_ImageDecoder_(iThread *thread) {
+    iImageDecoder *d = userData_Thread(thread);
+    lock_Mutex(d->mtx);
+    while (!d->quit) {
+        if (isEmpty_PtrArray(&d->queue)) {
+            wait_Condition(&d->jobsAvailable, d->mtx);
+            continue;
+        }
+        iImageDecodeJob *job;
+        take_PtrArray(&d->queue, 0, (void **) &job);
+        unlock_Mutex(d->mtx);
+        decode_ImageDecodeJob_(job);
+        lock_Mutex(d->mtx);
+        if (job->isCancelled) {
+            delete_ImageDecodeJob_(job);
+        }
+        else {
+            job->isDone = iTrue;
+            postCommand_App("media.decoded");
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return 0;
+}
+
+static iImageDecoder *new_ImageDecoder_(void) {
+    iImageDecoder *d = iMalloc(ImageDecoder);
+    d->mtx = new_Mutex();
+    init_Condition(&d->jobsAvailable);
+    init_PtrArray(&d->queue);
+    d->quit       = iFalse;
+    d->numThreads = iClamp(SDL_GetCPUCount() - 1, 1, maxThreads_ImageDecoder);
+    for (size_t i = 0; i < d->numThreads; i++) {
+        d->threads[i] = new_Thread(worker_ImageDecoder_);
+        setUserData_Thread(d->threads[i], d);
+        start_Thread(d->threads[i]);
+    }
+    return d;
+}
+
+void deinit_ImageDecoder(void) {
+    iImageDecoder *d = decoder_;
+    if (d) {
+        iGuardMutex(d->mtx, {
+            d->quit = iTrue;
+            broadcast_Condition(&d->jobsAvailable);
+        });
+        for (size_t i = 0; i < d->numThreads; i++) {
+            join_Thread(d->threads[i]);
+            iRelease(d->threads[i]);
+        }
+        iForEach(PtrArray, i, &d->queue) {
+            delete_ImageDecodeJob_(i.ptr);
+        }
+        deinit_PtrArray(&d->queue);
+        deinit_Condition(&d->jobsAvailable);
+        delete_Mutex(d->mtx);
+        free(d);
+        decoder_ = NULL;
+    }
+}
+
+static void cancelDecoding_GmImage_(iGmImage *d) {
+    iImageDecodeJob *job = d->decodeJob;
+    if (!job) {
+        return;
+    }
+    d->decodeJob = NULL;
+    iGuardMutex(decoder_->mtx, {
+        const size_t pos = indexOf_PtrArray(&decoder_->queue, job);
+        if (pos != iInvalidPos) {
+            take_PtrArray(&decoder_->queue, pos, (void **) &job);
+            delete_ImageDecodeJob_(job);
+        }
+        else if (job->isDone) {
+            delete_ImageDecodeJob_(job);
+        }
+        else {
+            /* The worker deletes it when finished. */
+            job->isCancelled = iTrue;
+        }
+    });
+}
+
+static iBool readImageSize_GmImage_(iGmImage *d, iBool isWebP) {
+    const iBlock *data = &d->partialData;
+    d->size = zero_I2();
+    if (isWebP) {
+#if defined (LAGRANGE_ENABLE_WEBP)
+        return WebPGetInfo(constData_Block(data), size_Block(data), &d->size.x, &d->size.y) != 0;
+#else
+        return iFalse;
+#endif
+    }
+    return stbi_info_from_memory(
+               constData_Block(data), size_Block(data), &d->size.x, &d->size.y, NULL) != 0;
+}
+
+static void submitDecoding_GmImage_(iGmImage *d, iBool isWebP, iBool isPreview) {
+    const iBlock *   data = &d->partialData;
+    iImageDecodeJob *job  = iMalloc(ImageDecodeJob);
+    iZap(*job);
+    job->data      = new_Block(size_Block(data));
+    memcpy(data_Block(job->data), constData_Block(data), size_Block(data));
+    job->isWebP    = isWebP;
+    job->isPreview = isPreview;
+    job->style     = prefs_App()->imageStyle;
+    job->colors[0] = get_Color(tmBackground_ColorId);
+    job->colors[1] = get_Color(tmParagraph_ColorId);
+    job->colors[2] = get_Color(tmPreformatted_ColorId);
+    /* Resize down to min(maximum texture size, window size). */ {
+        const iWindow *window = get_Window();
+        SDL_Rect dispRect;
+        SDL_GetDisplayBounds(SDL_GetWindowDisplayIndex(window->win), &dispRect);
+        job->maxSize = min_I2(isEqual_I2(maxTextureSize_Window(window), zero_I2()) ?
+                              d->size : maxTextureSize_Window(window),
+                              coord_Window(window, dispRect.w, dispRect.h));
+    }
+    if (!decoder_) {
+        decoder_ = new_ImageDecoder_();
+    }
+    iGuardMutex(decoder_->mtx, {
+        pushBack_PtrArray(&decoder_->queue, job);
+        signal_Condition(&decoder_->jobsAvailable);
+    });
+    d->decodeJob = job;
+}
+
+enum iImagePreviewLimits {
+    minBytes_ImagePreview = 16 * 1024,
+};
+
+static iBool isPreviewable_GmImage_(const iGmImage *d) {
+    if (cmp_String(&d->props.mime, "image/jpeg") == 0) {
+        return iTrue;
+    }
+#if defined (LAGRANGE_ENABLE_WEBP)
+    if (cmp_String(&d->props.mime, "image/webp") == 0) {
+        return iTrue;
+    }
+#endif
+    return iFalse;
+}
+
+static void appendReceived_GmImage_(iGmImage *d, const iBlock *received) {
+    /* `received` is the request body that the network thread keeps appending to. Sharing it
+       would make each of those appends copy the entire body, so just the new bytes are
+       copied here. */
+    size_t numOld = size_Block(&d->partialData);
+    if (numOld > size_Block(received)) {
+        clear_Block(&d->partialData);
+        numOld = 0;
+    }
+    appendData_Block(&d->partialData,
+                     constBegin_Block(received) + numOld,
+                     size_Block(received) - numOld);
+}
+
+static void updatePreview_GmImage_(iGmImage *d) {
+    /* Decode a preview of the partially received image. A new preview is made when the
+       previous one is done and the amount of data has grown by half. */
+    const size_t numBytes = size_Block(&d->partialData);
+    if (d->decodeJob || !isPreviewable_GmImage_(d) || numBytes < minBytes_ImagePreview ||
+        numBytes < d->previewBytes * 3 / 2) {
+        return;
+    }
+    d->previewBytes = numBytes;
+    submitDecoding_GmImage_(d, cmp_String(&d->props.mime, "image/webp") == 0, iTrue);
+}
+
+void makeTexture_GmImage(iGmImage *d) {
+    /* The size is read from the image header right away so the document can be laid out
+       while the pixels are being decoded. A preview texture remains visible until the
+       final one is ready. */
+    iBlock *data = &d->partialData;
+    const iBool isWebP = cmp_String(&d->props.mime, "image/webp") == 0;
+    cancelDecoding_GmImage_(d);
+    d->numBytes = size_Block(data);
+    if (readImageSize_GmImage_(d, isWebP) && d->size.x > 0 && d->size.y > 0) {
+        submitDecoding_GmImage_(d, isWebP, iFalse);
     }
     else {
-        applyImageStyle_(prefs_App()->imageStyle, d->size, imgData);        
-        /* TODO: Save some memory by checking if the alpha channel is actually in use. */
-        iWindow *window  = get_Window();
-        iInt2    texSize = d->size;
-        /* Resize down to min(maximum texture size, window size). */ {
-            SDL_Rect dispRect;
-            SDL_GetDisplayBounds(SDL_GetWindowDisplayIndex(window->win), &dispRect);
-            const iInt2 maxSize = min_I2(isEqual_I2(maxTextureSize_Window(window), zero_I2()) ?
-                                         texSize : maxTextureSize_Window(window),
-                                         coord_Window(window, dispRect.w, dispRect.h));
-            iInt2 scaled = d->size;
-            if (scaled.x > maxSize.x) {
-                scaled.y = scaled.y * maxSize.x / scaled.x;
-                scaled.x = maxSize.x;
-            }
-            if (scaled.y > maxSize.y) {
-                scaled.x = scaled.x * maxSize.y / scaled.y;
-                scaled.y = maxSize.y;
-            }
-            if (!isEqual_I2(scaled, d->size)) {
-                uint8_t *scaledImgData = malloc(scaled.x * scaled.y * 4);
-                stbir_resize_uint8(imgData, d->size.x, d->size.y, 4 * d->size.x,
-                                   scaledImgData, scaled.x, scaled.y, scaled.x * 4, 4);
-                free(imgData);
-                imgData = scaledImgData;
-                texSize = scaled;
-                /* We keep d->size for the UI. */
-            }
+        if (!isWebP) {
+            fprintf(stderr, "[media] image load failed: %s\n", stbi_failure_reason());
         }
+        d->size = zero_I2();
+        SDL_DestroyTexture(d->texture);
+        d->texture = NULL;
+    }
+    clear_Block(data);
+}
+
+static iBool finishDecoding_GmImage_(iGmImage *d) {
+    iImageDecodeJob *job = d->decodeJob;
+    if (!job) {
+        return iFalse;
+    }
+    iBool isDone;
+    iGuardMutex(decoder_->mtx, { isDone = job->isDone; });
+    if (!isDone) {
+        return iFalse;
+    }
+    d->decodeJob = NULL;
+    if (job->pixels || !job->isPreview) {
+        SDL_DestroyTexture(d->texture);
+        d->texture = NULL;
+    }
+    if (job->pixels) {
         /* Create the texture. */
-        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(
-            imgData, texSize.x, texSize.y, 32, texSize.x * 4, SDL_PIXELFORMAT_ABGR8888);
+        SDL_Surface *surface = SDL_CreateRGBSurfaceWithFormatFrom(job->pixels,
+                                                                  job->texSize.x,
+                                                                  job->texSize.y,
+                                                                  32,
+                                                                  job->texSize.x * 4,
+                                                                  SDL_PIXELFORMAT_ABGR8888);
         /* TODO: In multiwindow case, all windows must have the same shared renderer?
            Or at least a shared context. */
         SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1"); /* linear scaling */
-        d->texture = SDL_CreateTextureFromSurface(renderer_Window(window), surface);
+        d->texture = SDL_CreateTextureFromSurface(renderer_Window(get_Window()), surface);
         SDL_FreeSurface(surface);
-        free(imgData);
+        /* We keep d->size for the UI. */
     }
-    clear_Block(data);
+    delete_ImageDecodeJob_(job);
+    return iTrue;
 }
 
 iDefineTypeConstructionArgs(GmImage, (const iBlock *data), data)
@@ -230,25 +538,10 @@ struct Impl_GmDownload {
     uint32_t      rateStartTime;
     size_t        rateNumBytes;
     float         currentRate;
-    iString *     path;
-    iFile *       file;
+    iString *     path; /* the request writes the data here */
+    iBool         isFinished;
 };
 
-static iBool openFile_GmDownload_(iGmDownload *d) {
-    iAssert(!isEmpty_String(&d->props.url));
-    d->path = copy_String(downloadPathForUrl_App(&d->props.url, &d->props.mime));
-    d->file = new_File(d->path);
-    if (!open_File(d->file, writeOnly_FileMode)) {
-        return iFalse;
-    }
-    return iTrue;
-}
-
-static void closeFile_GmDownload_(iGmDownload *d) {
-    d->currentRate = (float) (d->numBytes / elapsedSeconds_Time(&d->startTime));
-    iReleasePtr(&d->file);
-}
-
 void init_GmDownload(iGmDownload *d) {
     init_GmMediaProps_(&d->props);
     initCurrent_Time(&d->startTime);
@@ -257,26 +550,28 @@ void init_GmDownload(iGmDownload *d) {
     d->rateNumBytes  = 0;
     d->currentRate   = 0.0f;
     d->path          = NULL;
-    d->file          = NULL;
+    d->isFinished    = iFalse;
 }
 
 void deinit_GmDownload(iGmDownload *d) {
-    closeFile_GmDownload_(d);
     deinit_GmMediaProps_(&d->props);
     delete_String(d->path);
 }
 
-static void writeToFile_GmDownload_(iGmDownload *d, const iBlock *data) {
+static void updateProgress_GmDownload_(iGmDownload *d, uint64_t numBytes, iBool isFinished) {
     const static unsigned rateInterval_ = 1000;
-    iAssert(d->file);
-    writeData_File(d->file,
-                   constBegin_Block(data) + d->numBytes,
-                   size_Block(data) - d->numBytes);
-    const size_t newBytes = size_Block(data) - d->numBytes;
-    d->numBytes = size_Block(data);
+    if (d->isFinished) {
+        return;
+    }
+    const size_t newBytes = (size_t) (numBytes > d->numBytes ? numBytes - d->numBytes : 0);
+    d->numBytes = numBytes;
     d->rateNumBytes += newBytes;
     const uint32_t now = SDL_GetTicks();
-    if (now - d->rateStartTime > rateInterval_) {
+    if (isFinished) {
+        d->currentRate = (float) (d->numBytes / elapsedSeconds_Time(&d->startTime));
+        d->isFinished  = iTrue;
+    }
+    else if (now - d->rateStartTime > rateInterval_) {
         const double elapsed = (double) (now - d->rateStartTime) / 1000.0;
         d->rateStartTime     = now;
         d->currentRate       = (float) (d->rateNumBytes / elapsed);
@@ -290,7 +585,7 @@ iDefineTypeConstruction(GmDownload)
 
 struct Impl_Media {
     iPtrArray items[max_MediaType];
-    /* TODO: Add a hash to quickly look up a link's media. */
+    iHash     links[max_MediaType]; /* GmMediaProps of the items, keyed by link ID */
 };
 
 iDefineTypeConstruction(Media)
@@ -298,16 +593,38 @@ iDefineTypeConstruction(Media)
 void init_Media(iMedia *d) {
     iForIndices(i, d->items) {
         init_PtrArray(&d->items[i]);
+        init_Hash(&d->links[i]);
     }
 }
 
 void deinit_Media(iMedia *d) {
     clear_Media(d);
     iForIndices(i, d->items) {
+        deinit_Hash(&d->links[i]);
         deinit_PtrArray(&d->items[i]);
     }
 }
 
+static void insert_Media_(iMedia *d, enum iMediaType type, iGmMediaProps *props) {
+    /* Media items begin with their GmMediaProps. */
+    props->node.key = props->linkId;
+    props->index    = size_PtrArray(&d->items[type]);
+    pushBack_PtrArray(&d->items[type], props);
+    insert_Hash(&d->links[type], &props->node);
+}
+
+static void *take_Media_(iMedia *d, iMediaId mediaId) {
+    iPtrArray *    items = &d->items[mediaId.type];
+    iGmMediaProps *props;
+    take_PtrArray(items, index_MediaId(mediaId), (void **) &props);
+    remove_Hash(&d->links[mediaId.type], props->linkId);
+    /* The following items moved down by one. */
+    for (size_t i = index_MediaId(mediaId); i < size_PtrArray(items); i++) {
+        ((iGmMediaProps *) at_PtrArray(items, i))->index = i;
+    }
+    return props;
+}
+
 void clear_Media(iMedia *d) {
     iForEach(PtrArray, i, &d->items[image_MediaType]) {
         deinit_GmImage(i.ptr);
@@ -320,6 +637,7 @@ void clear_Media(iMedia *d) {
     }
     iForIndices(type, d->items) {
         clear_PtrArray(&d->items[type]);
+        clear_Hash(&d->links[type]);
     }
 }
 
@@ -331,6 +649,9 @@ size_t memorySize_Media(const iMedia *d) {
             const iInt2 texSize = size_SDLTexture(img->texture);
             memSize += 4 * texSize.x * texSize.y; /* RGBA */
         }
+        else if (img->decodeJob) {
+            memSize += img->numBytes;
+        }
         else {
             memSize += size_Block(&img->partialData);
         }
@@ -356,7 +677,8 @@ iBool setUrl_Media(iMedia *d, iGmLinkId linkId, enum iMediaType mediaType, const
         iGmDownload *dl = NULL;
         if (isNew) {
             dl = new_GmDownload();
-            pushBack_PtrArray(&d->items[download_MediaType], dl);
+            dl->props.linkId = linkId;
+            insert_Media_(d, download_MediaType, &dl->props);
         }
         else {
             dl = at_PtrArray(&d->items[download_MediaType], index_MediaId(existing));
@@ -382,22 +704,30 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
     if (existing.type == image_MediaType) {
         iGmImage *img;
         if (isDeleting) {
-            take_PtrArray(&d->items[image_MediaType], existingIndex, (void **) &img);
+            img = take_Media_(d, existing);
             delete_GmImage(img);
         }
         else {
             img = at_PtrArray(&d->items[image_MediaType], existingIndex);
             iAssert(equal_String(&img->props.mime, mime)); /* MIME cannot change */
-            set_Block(&img->partialData, data);
+            if (isPartial) {
+                appendReceived_GmImage_(img, data);
+            }
+            else {
+                set_Block(&img->partialData, data);
+            }
             if (!isPartial) {
                 makeTexture_GmImage(img);
             }
+            else {
+                updatePreview_GmImage_(img);
+            }
         }
     }
     else if (existing.type == audio_MediaType) {
         iGmAudio *audio;
         if (isDeleting) {
-            take_PtrArray(&d->items[audio_MediaType], existingIndex, (void **) &audio);
+            audio = take_Media_(d, existing);
             delete_GmAudio(audio);
         }
         else {
@@ -414,48 +744,47 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
         }
     }
     else if (existing.type == download_MediaType) {
-        iGmDownload *dl;
+        /* The request writes the data to the file (see `beginDownload_Media`). */
         if (isDeleting) {
-            take_PtrArray(&d->items[download_MediaType], existingIndex, (void **) &dl);
+            iGmDownload *dl = take_Media_(d, existing);
             delete_GmDownload(dl);
         }
-        else {
-            dl = at_PtrArray(&d->items[download_MediaType], existingIndex);
-            if (isEmpty_String(&dl->props.mime)) {
-                set_String(&dl->props.mime, mime);
-            }
-            if (!dl->file) {
-                openFile_GmDownload_(dl);
-            }
-            writeToFile_GmDownload_(dl, data);
-            if (!isPartial) {
-                closeFile_GmDownload_(dl);
-            }
-        }
     }
     else if (!isDeleting) {
         if (startsWith_String(mime, "image/")) {
             /* Copy the image to a texture. */
-            iGmImage *img = new_GmImage(data);
-            img->props.linkId = linkId; /* TODO: use a hash? */
+            iGmImage *img = new_GmImage(isPartial ? NULL : data);
+            if (isPartial) {
+                appendReceived_GmImage_(img, data);
+            }
+            img->props.linkId = linkId;
             img->props.isPermanent = !allowHide;
             set_String(&img->props.mime, mime);
-            pushBack_PtrArray(&d->items[image_MediaType], img);
+            if (isPartial && (!readImageSize_GmImage_(img, cmp_String(mime, "image/webp") == 0) ||
+                              img->size.x <= 0 || img->size.y <= 0)) {
+                /* Wait until the header has been received; the size is needed for layout. */
+                delete_GmImage(img);
+                return iFalse;
+            }
+            insert_Media_(d, image_MediaType, &img->props);
             if (!isPartial) {
                 makeTexture_GmImage(img);
             }
+            else {
+                updatePreview_GmImage_(img);
+            }
             isNew = iTrue;
         }
         else if (startsWith_String(mime, "audio/")) {
             iGmAudio *audio = new_GmAudio();
-            audio->props.linkId = linkId; /* TODO: use a hash? */
+            audio->props.linkId = linkId;
             audio->props.isPermanent = !allowHide;
             set_String(&audio->props.mime, mime);
             updateSourceData_Player(audio->player, mime, data, replace_PlayerUpdate);
             if (!isPartial) {
                 updateSourceData_Player(audio->player, NULL, NULL, complete_PlayerUpdate);
             }
-            pushBack_PtrArray(&d->items[audio_MediaType], audio);
+            insert_Media_(d, audio_MediaType, &audio->props);
             /* Start playing right away. */
             start_Player(audio->player);
             postCommandf_App("media.player.started player:%p", audio->player);
@@ -465,31 +794,25 @@ iBool setData_Media(iMedia *d, iGmLinkId linkId, const iString *mime, const iBlo
     return isNew;
 }
 
-static iMediaId findMediaPtr_Media_(const iPtrArray *items, enum iMediaType mediaType, iGmLinkId linkId) {
-    iConstForEach(PtrArray, i, items) {
-        const iGmMediaProps *props = i.ptr;
-        if (props->linkId == linkId) {
-            return (iMediaId){
-                .type = mediaType,
-                .id = index_PtrArrayConstIterator(&i) + 1
-            };
+iMediaId findMediaForLink_Media(const iMedia *d, iGmLinkId linkId, enum iMediaType mediaType) {
+    for (int i = 0; i < max_MediaType; i++) {
+        if (mediaType == i || !mediaType) {
+            const iGmMediaProps *props = (const iGmMediaProps *) value_Hash(&d->links[i], linkId);
+            if (props) {
+                return (iMediaId){ .type = i, .id = props->index + 1 };
+            }
         }
     }
     return iInvalidMediaId;
 }
 
-iMediaId findMediaForLink_Media(const iMedia *d, iGmLinkId linkId, enum iMediaType mediaType) {
-    /* TODO: Use hashes, this will get very slow if there is a large number of media items. */
-    iMediaId mid = iInvalidMediaId;
-    for (int i = 0; i < max_MediaType; i++) {
-        if (mediaType == i || !mediaType) {
-            mid = findMediaPtr_Media_(&d->items[i], i, linkId);
-            if (mid.type) {
-                break;
-            }
+iBool isEmpty_Media(const iMedia *d) {
+    iForIndices(i, d->items) {
+        if (!isEmpty_PtrArray(&d->items[i])) {
+            return iFalse;
         }
     }
-    return mid;
+    return iTrue;
 }
 
 size_t numAudio_Media(const iMedia *d) {
@@ -506,6 +829,26 @@ iInt2 imageSize_Media(const iMedia *d, iMediaId imageId) {
     return zero_I2();
 }
 
+iBool isImageDecoding_Media(const iMedia *d, iMediaId imageId) {
+    iAssert(imageId.type == image_MediaType);
+    const size_t index = index_MediaId(imageId);
+    if (index < size_PtrArray(&d->items[image_MediaType])) {
+        const iGmImage *img = constAt_PtrArray(&d->items[image_MediaType], index);
+        return img->decodeJob != NULL || !isEmpty_Block(&img->partialData);
+    }
+    return iFalse;
+}
+
+iBool finishDecoding_Media(iMedia *d) {
+    iBool isChanged = iFalse;
+    iForEach(PtrArray, i, &d->items[image_MediaType]) {
+        if (finishDecoding_GmImage_(i.ptr)) {
+            isChanged = iTrue;
+        }
+    }
+    return isChanged;
+}
+
 SDL_Texture *imageTexture_Media(const iMedia *d, iMediaId imageId) {
     iAssert(imageId.type == image_MediaType);
     const size_t index = index_MediaId(imageId);
@@ -517,7 +860,6 @@ SDL_Texture *imageTexture_Media(const iMedia *d, iMediaId imageId) {
 }
 
 iBool info_Media(const iMedia *d, iMediaId mediaId, iGmMediaInfo *info_out) {
-    /* TODO: Use a hash. */
     const size_t index = index_MediaId(mediaId);
     switch (mediaId.type) {
         case image_MediaType:
@@ -582,6 +924,30 @@ void pauseAllPlayers_Media(const iMedia *d, iBool setPaused) {
     }
 }
 
+const iString *beginDownload_Media(iMedia *d, iGmLinkId linkId, const iString *mime) {
+    const iMediaId existing = findMediaForLink_Media(d, linkId, download_MediaType);
+    if (!existing.id) {
+        return NULL;
+    }
+    iGmDownload *dl = at_PtrArray(&d->items[download_MediaType], index_MediaId(existing));
+    if (!dl->path) {
+        iAssert(!isEmpty_String(&dl->props.url));
+        set_String(&dl->props.mime, mime);
+        dl->path = copy_String(downloadPathForUrl_App(&dl->props.url, &dl->props.mime));
+    }
+    return dl->path;
+}
+
+void updateDownload_Media(iMedia *d, iGmLinkId linkId, uint64_t numBytes, iBool isFinished) {
+    const iMediaId existing = findMediaForLink_Media(d, linkId, download_MediaType);
+    if (existing.id) {
+        updateProgress_GmDownload_(
+            at_PtrArray(&d->items[download_MediaType], index_MediaId(existing)),
+            numBytes,
+            isFinished);
+    }
+}
+
 void downloadStats_Media(const iMedia *d, iMediaId downloadId, const iString **path_out,
                          float *bytesPerSecond_out, iBool *isFinished_out) {
     iAssert(downloadId.type == download_MediaType);
@@ -595,7 +961,7 @@ void downloadStats_Media(const iMedia *d, iMediaId downloadId, const iString **p
             *path_out = dl->path;
         }
         *bytesPerSecond_out = dl->currentRate;
-        *isFinished_out = (dl->path && !dl->file);
+        *isFinished_out = dl->isFinished;
     }
 }
 
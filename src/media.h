@@ -72,6 +72,7 @@ iBool           setUrl_Media            (iMedia *, uint16_t linkId, enum iMediaT
 iBool           setData_Media           (iMedia *, uint16_t linkId, const iString *mime, const iBlock *data, int flags);
 
 size_t          memorySize_Media        (const iMedia *);
+iBool           isEmpty_Media           (const iMedia *);
 iMediaId        findMediaForLink_Media  (const iMedia *, uint16_t linkId, enum iMediaType mediaType);
 
 iMediaId        id_Media        (const iMedia *, uint16_t linkId, enum iMediaType type);
@@ -99,14 +100,20 @@ iLocalDef iBool downloadInfo_Media(const iMedia *d, uint16_t mediaId, iGmMediaIn
 
 iInt2           imageSize_Media         (const iMedia *, iMediaId imageId);
 SDL_Texture *   imageTexture_Media      (const iMedia *, iMediaId imageId);
+iBool           isImageDecoding_Media   (const iMedia *, iMediaId imageId); /* or still being received */
+iBool           finishDecoding_Media    (iMedia *); /* creates textures of decoded images */
 
 size_t          numAudio_Media          (const iMedia *);
 iPlayer *       audioPlayer_Media       (const iMedia *, iMediaId audioId);
 void            pauseAllPlayers_Media   (const iMedia *, iBool setPaused);
 
+const iString * beginDownload_Media     (iMedia *, uint16_t linkId, const iString *mime); /* returns file path */
+void            updateDownload_Media    (iMedia *, uint16_t linkId, uint64_t numBytes, iBool isFinished);
 void            downloadStats_Media     (const iMedia *, iMediaId downloadId, const iString **path_out,
                                          float *bytesPerSecond_out, iBool *isFinished_out);
 
+void            deinit_ImageDecoder     (void); /* stops the image decoding threads */
+
 /*----------------------------------------------------------------------------------------------*/
 
 iDeclareType(GmRequest)
@@ -0,0 +1,391 @@
+/* Copyright 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#include "searchindex.h"
+
+#include <the_Foundation/array.h>
+#include <the_Foundation/mutex.h>
+#include <the_Foundation/ptrarray.h>
+#include <the_Foundation/sortedarray.h>
+
+/* Only the beginning of long documents is indexed. */
+static const size_t maxIndexedSize_SearchIndex_ = 256 * 1024;
+
+iDeclareType(SearchDoc)
+iDeclareType(SearchGram)
+
+struct Impl_SearchDoc {
+    uint32_t id;
+    int      type;
+    iString  key;
+    iArray   grams; /* uint64_t, sorted and unique */
+};
+
+static iSearchDoc *new_SearchDoc_(uint32_t id, int type, const iString *key) {
+    iSearchDoc *d = iMalloc(SearchDoc);
+    d->id   = id;
+    d->type = type;
+    initCopy_String(&d->key, key);
+    init_Array(&d->grams, sizeof(uint64_t));
+    return d;
+}
+
+static void delete_SearchDoc_(iSearchDoc *d) {
+    if (d) {
+        deinit_Array(&d->grams);
+        deinit_String(&d->key);
+        free(d);
+    }
+}
+
+static int cmpKey_SearchDocPtr_(const void *a, const void *b) {
+    const iSearchDoc *x = *(const iSearchDoc **) a, *y = *(const iSearchDoc **) b;
+    if (x->type != y->type) {
+        return x->type < y->type ? -1 : 1;
+    }
+    return cmpString_String(&x->key, &y->key);
+}
+
+struct Impl_SearchGram {
+    uint64_t      gram; /* three 21-bit characters */
+    iSortedArray *docs; /* uint32_t document IDs */
+};
+
+static int cmp_SearchGram_(const void *a, const void *b) {
+    const uint64_t x = ((const iSearchGram *) a)->gram, y = ((const iSearchGram *) b)->gram;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static int cmpId_(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+static int cmpGram_(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+iLocalDef uint64_t gram_(const iChar *chars) {
+    return ((uint64_t) (chars[0] & 0x1fffff) << 42) | ((uint64_t) (chars[1] & 0x1fffff) << 21) |
+           (chars[2] & 0x1fffff);
+}
+
+iLocalDef iChar gramChar_(uint64_t gram, int index) {
+    return (iChar) ((gram >> (42 - 21 * index)) & 0x1fffff);
+}
+
+static void lowerChars_(iRangecc text, iArray *chars) {
+    /* Text is case-insensitive and whitespace separates words. */
+    iString *str   = newRange_String(text);
+    iString *lower = lower_String(str);
+    iConstForEach(String, i, lower) {
+        const iChar ch = isSpace_Char(i.value) ? ' ' : i.value;
+        pushBack_Array(chars, &ch);
+    }
+    delete_String(lower);
+    delete_String(str);
+}
+
+static void extractGrams_(iRangecc text, iArray *grams) {
+    iArray chars;
+    init_Array(&chars, sizeof(iChar));
+    lowerChars_(text, &chars);
+    const iChar *ch = constData_Array(&chars);
+    for (size_t i = 0; i + 2 < size_Array(&chars); i++) {
+        if (ch[i] != ' ' && ch[i + 1] != ' ' && ch[i + 2] != ' ') {
+            const uint64_t gram = gram_(ch + i);
+            pushBack_Array(grams, &gram);
+        }
+    }
+    deinit_Array(&chars);
+    /* Make it a set. */
+    sort_Array(grams, cmpGram_);
+    size_t unique = 0;
+    for (size_t i = 0; i < size_Array(grams); i++) {
+        const uint64_t gram = value_Array(grams, i, uint64_t);
+        if (unique == 0 || value_Array(grams, unique - 1, uint64_t) != gram) {
+            *(uint64_t *) at_Array(grams, unique++) = gram;
+        }
+    }
+    resize_Array(grams, unique);
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+struct Impl_SearchIndex {
+    iMutex *     mtx;
+    iPtrArray    docs;    /* indexed by document ID, NULL if unused */
+    iArray       freeIds; /* uint32_t */
+    iSortedArray keys;    /* SearchDoc pointers ordered by type and key */
+    iSortedArray grams;   /* SearchGrams ordered by trigram */
+};
+
+iDefineTypeConstruction(SearchIndex)
+
+void init_SearchIndex(iSearchIndex *d) {
+    d->mtx = new_Mutex();
+    init_PtrArray(&d->docs);
+    init_Array(&d->freeIds, sizeof(uint32_t));
+    init_SortedArray(&d->keys, sizeof(iSearchDoc *), cmpKey_SearchDocPtr_);
+    init_SortedArray(&d->grams, sizeof(iSearchGram), cmp_SearchGram_);
+}
+
+void deinit_SearchIndex(iSearchIndex *d) {
+    iForEach(Array, i, &d->grams.values) {
+        delete_SortedArray(((iSearchGram *) i.value)->docs);
+    }
+    deinit_SortedArray(&d->grams);
+    deinit_SortedArray(&d->keys);
+    iForEach(PtrArray, j, &d->docs) {
+        delete_SearchDoc_(j.ptr);
+    }
+    deinit_PtrArray(&d->docs);
+    deinit_Array(&d->freeIds);
+    delete_Mutex(d->mtx);
+}
+
+static size_t findDoc_SearchIndex_(const iSearchIndex *d, int type, const iString *key) {
+    iSearchDoc  doc  = { .type = type, .key = *key };
+    iSearchDoc *pDoc = &doc;
+    size_t      pos;
+    if (locate_SortedArray(&d->keys, &pDoc, &pos)) {
+        return pos;
+    }
+    return iInvalidPos;
+}
+
+static void removeDoc_SearchIndex_(iSearchIndex *d, size_t keyPos) {
+    iSearchDoc *doc = *(iSearchDoc **) at_SortedArray(&d->keys, keyPos);
+    iConstForEach(Array, i, &doc->grams) {
+        size_t pos;
+        iSearchGram key = { .gram = *(const uint64_t *) i.value };
+        if (locate_SortedArray(&d->grams, &key, &pos)) {
+            iSearchGram *gram = at_SortedArray(&d->grams, pos);
+            size_t idPos;
+            if (locate_SortedArray(gram->docs, &doc->id, &idPos)) {
+                remove_Array(&gram->docs->values, idPos);
+            }
+            if (isEmpty_Array(&gram->docs->values)) {
+                delete_SortedArray(gram->docs);
+                remove_Array(&d->grams.values, pos);
+            }
+        }
+    }
+    remove_Array(&d->keys.values, keyPos);
+    set_PtrArray(&d->docs, doc->id, NULL);
+    pushBack_Array(&d->freeIds, &doc->id);
+    delete_SearchDoc_(doc);
+}
+
+void set_SearchIndex(iSearchIndex *d, enum iSearchIndexType type, const iString *key,
+                     iRangecc text) {
+    if (size_Range(&text) > maxIndexedSize_SearchIndex_) {
+        text.end = text.start + maxIndexedSize_SearchIndex_;
+    }
+    iArray grams;
+    init_Array(&grams, sizeof(uint64_t));
+    extractGrams_(text, &grams); /* before locking, this may take a while */
+    lock_Mutex(d->mtx);
+    const size_t oldPos = findDoc_SearchIndex_(d, type, key);
+    if (oldPos != iInvalidPos) {
+        removeDoc_SearchIndex_(d, oldPos);
+    }
+    uint32_t id;
+    if (!isEmpty_Array(&d->freeIds)) {
+        id = value_Array(&d->freeIds, size_Array(&d->freeIds) - 1, uint32_t);
+        popBack_Array(&d->freeIds);
+    }
+    else {
+        id = size_PtrArray(&d->docs);
+        pushBack_PtrArray(&d->docs, NULL);
+    }
+    iSearchDoc *doc = new_SearchDoc_(id, type, key);
+    iSwap(iArray, doc->grams, grams);
+    set_PtrArray(&d->docs, id, doc);
+    insert_SortedArray(&d->keys, &doc);
+    iConstForEach(Array, i, &doc->grams) {
+        iSearchGram gram = { .gram = *(const uint64_t *) i.value };
+        size_t pos;
+        if (locate_SortedArray(&d->grams, &gram, &pos)) {
+            gram = *(iSearchGram *) at_SortedArray(&d->grams, pos);
+        }
+        else {
+            gram.docs = new_SortedArray(sizeof(uint32_t), cmpId_);
+            insert_SortedArray(&d->grams, &gram);
+        }
+        insert_SortedArray(gram.docs, &id);
+    }
+    unlock_Mutex(d->mtx);
+    deinit_Array(&grams);
+}
+
+void remove_SearchIndex(iSearchIndex *d, enum iSearchIndexType type, const iString *key) {
+    iGuardMutex(d->mtx, {
+        const size_t pos = findDoc_SearchIndex_(d, type, key);
+        if (pos != iInvalidPos) {
+            removeDoc_SearchIndex_(d, pos);
+        }
+    });
+}
+
+void clear_SearchIndex(iSearchIndex *d, enum iSearchIndexType type) {
+    lock_Mutex(d->mtx);
+    for (size_t i = size_SortedArray(&d->keys); i > 0; i--) {
+        const iSearchDoc *doc = *(const iSearchDoc **) at_SortedArray(&d->keys, i - 1);
+        if (doc->type == type) {
+            removeDoc_SearchIndex_(d, i - 1);
+        }
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static void intersect_(iArray *ids, const iSortedArray *docs) {
+    /* Keeps the `ids` that are also in `docs`. */
+    size_t kept = 0;
+    for (size_t i = 0; i < size_Array(ids); i++) {
+        const uint32_t id = value_Array(ids, i, uint32_t);
+        size_t pos;
+        if (locate_SortedArray(docs, &id, &pos)) {
+            *(uint32_t *) at_Array(ids, kept++) = id;
+        }
+    }
+    resize_Array(ids, kept);
+}
+
+static void wordCandidates_SearchIndex_(const iSearchIndex *d, const iChar *word, size_t len,
+                                        iArray *ids_out) {
+    iAssert(len > 0);
+    if (len >= 3) {
+        /* All the trigrams of the word must be present. Start with the rarest one. */
+        iPtrArray postings;
+        init_PtrArray(&postings);
+        for (size_t i = 0; i + 2 < len; i++) {
+            iSearchGram key = { .gram = gram_(word + i) };
+            size_t pos;
+            if (!locate_SortedArray(&d->grams, &key, &pos)) {
+                deinit_PtrArray(&postings);
+                return; /* no matches */
+            }
+            pushBack_PtrArray(&postings, ((const iSearchGram *) at_SortedArray(&d->grams, pos))->docs);
+        }
+        size_t rarest = 0;
+        iConstForEach(PtrArray, p, &postings) {
+            if (size_SortedArray(p.ptr) < size_SortedArray(constAt_PtrArray(&postings, rarest))) {
+                rarest = index_PtrArrayConstIterator(&p);
+            }
+        }
+        const iSortedArray *first = constAt_PtrArray(&postings, rarest);
+        pushBackN_Array(ids_out, constData_Array(&first->values), size_SortedArray(first));
+        iConstForEach(PtrArray, q, &postings) {
+            if (q.ptr != first) {
+                intersect_(ids_out, q.ptr);
+            }
+        }
+        deinit_PtrArray(&postings);
+        return;
+    }
+    /* Short words may appear anywhere inside a trigram. */
+    iSortedArray found;
+    init_SortedArray(&found, sizeof(uint32_t), cmpId_);
+    iConstForEach(Array, i, &d->grams.values) {
+        const iSearchGram *gram = i.value;
+        iBool isMatch = iFalse;
+        for (size_t j = 0; j + len <= 3 && !isMatch; j++) {
+            isMatch = (gramChar_(gram->gram, j) == word[0] &&
+                       (len == 1 || gramChar_(gram->gram, j + 1) == word[1]));
+        }
+        if (isMatch) {
+            iConstForEach(Array, k, &gram->docs->values) {
+                insert_SortedArray(&found, k.value);
+            }
+        }
+    }
+    pushBackN_Array(ids_out, constData_Array(&found.values), size_SortedArray(&found));
+    deinit_SortedArray(&found);
+}
+
+const iStringSet *query_SearchIndex(const iSearchIndex *d, enum iSearchIndexType type,
+                                    const iString *terms) {
+    iStringSet *keys = iClob(new_StringSet());
+    iArray chars;
+    init_Array(&chars, sizeof(iChar));
+    lowerChars_(range_String(terms), &chars);
+    iArray ids;
+    init_Array(&ids, sizeof(uint32_t));
+    iBool isFirst = iTrue;
+    lock_Mutex(d->mtx);
+    const iChar *ch = constData_Array(&chars);
+    for (size_t pos = 0; pos < size_Array(&chars); ) {
+        if (ch[pos] == ' ') {
+            pos++;
+            continue;
+        }
+        size_t len = 0;
+        while (pos + len < size_Array(&chars) && ch[pos + len] != ' ') {
+            len++;
+        }
+        /* Each word must appear in the document. */
+        iArray wordIds;
+        init_Array(&wordIds, sizeof(uint32_t));
+        wordCandidates_SearchIndex_(d, ch + pos, len, &wordIds);
+        if (isFirst) {
+            iSwap(iArray, ids, wordIds);
+            isFirst = iFalse;
+        }
+        else {
+            /* Both are sorted. */
+            size_t kept = 0, j = 0;
+            for (size_t i = 0; i < size_Array(&ids); i++) {
+                const uint32_t id = value_Array(&ids, i, uint32_t);
+                while (j < size_Array(&wordIds) && value_Array(&wordIds, j, uint32_t) < id) {
+                    j++;
+                }
+                if (j < size_Array(&wordIds) && value_Array(&wordIds, j, uint32_t) == id) {
+                    *(uint32_t *) at_Array(&ids, kept++) = id;
+                }
+            }
+            resize_Array(&ids, kept);
+        }
+        deinit_Array(&wordIds);
+        if (isEmpty_Array(&ids)) {
+            break;
+        }
+        pos += len;
+    }
+    iConstForEach(Array, i, &ids) {
+        const iSearchDoc *doc = constAt_PtrArray(&d->docs, *(const uint32_t *) i.value);
+        if (doc && doc->type == type) {
+            insert_StringSet(keys, &doc->key);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    deinit_Array(&ids);
+    deinit_Array(&chars);
+    return keys;
+}
+
+size_t numDocuments_SearchIndex(const iSearchIndex *d) {
+    size_t count = 0;
+    iGuardMutex(d->mtx, count = size_SortedArray(&d->keys));
+    return count;
+}
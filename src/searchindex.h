@@ -0,0 +1,51 @@
+/* Copyright 2021 Jaakko Keränen <jaakko.keranen@iki.fi>
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met:
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer.
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution.
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON
+ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
+
+#pragma once
+
+#include <the_Foundation/range.h>
+#include <the_Foundation/stringset.h>
+
+/* Inverted index of character trigrams for looking up text without scanning all of it.
+   Each indexed document has a type and a key, such as a URL. A query returns the keys of
+   the documents that contain every trigram of the search terms, so the caller only needs
+   to check the actual matches among these candidates. Thread-safe. */
+
+iDeclareType(SearchIndex)
+iDeclareTypeConstruction(SearchIndex)
+
+enum iSearchIndexType {
+    bookmark_SearchIndexType, /* key is the bookmark ID in hexadecimal */
+    feedEntry_SearchIndexType,
+    visited_SearchIndexType,
+    content_SearchIndexType,
+    max_SearchIndexType
+};
+
+void    set_SearchIndex         (iSearchIndex *, enum iSearchIndexType type, const iString *key,
+                                 iRangecc text); /* replaces previously indexed text */
+void    remove_SearchIndex      (iSearchIndex *, enum iSearchIndexType type, const iString *key);
+void    clear_SearchIndex       (iSearchIndex *, enum iSearchIndexType type);
+
+const iStringSet *  query_SearchIndex       (const iSearchIndex *, enum iSearchIndexType type,
+                                             const iString *terms); /* returns collected keys */
+size_t              numDocuments_SearchIndex(const iSearchIndex *);
@@ -23,25 +23,237 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "command.h"
 #include "app.h"
 
+#include <the_Foundation/sortedarray.h>
 #include <the_Foundation/string.h>
 #include <ctype.h>
 
+#define maxArgs_DispatchedCommand_   16
+#define maxNesting_DispatchedCommand_ 4
+
+iDeclareType(CommandArg)
+iDeclareType(DispatchedCommand)
+
+struct Impl_CommandArg {
+    iRangecc    label;
+    const char *value;
+};
+
+struct Impl_DispatchedCommand {
+    const char *cmd;
+    size_t      len;
+    int         id;         /* zero if the name has not been interned */
+    iBool       hasArgs;    /* contains a colon */
+    iBool       isComplete; /* all the arguments fit in the table */
+    size_t      numArgs;
+    iCommandArg args[maxArgs_DispatchedCommand_];
+};
+
+static _Thread_local iDispatchedCommand dispatched_[maxNesting_DispatchedCommand_];
+static _Thread_local int                numDispatched_;
+
+static int findId_Command_(const char *cmd);
+
+void beginDispatch_Command(const char *cmd) {
+    if (numDispatched_++ >= maxNesting_DispatchedCommand_) {
+        return; /* Nested too deep, these will just be scanned. */
+    }
+    iDispatchedCommand *d = &dispatched_[numDispatched_ - 1];
+    d->cmd        = cmd;
+    d->len        = strlen(cmd);
+    d->id         = findId_Command_(cmd);
+    d->hasArgs    = (strchr(cmd, ':') != NULL);
+    d->isComplete = iTrue;
+    d->numArgs    = 0;
+    /* Each " label:" is recorded in order, so the first match is the same one that
+       strstr() would find. */
+    for (const char *pos = strchr(cmd, ' '); pos; pos = strchr(pos + 1, ' ')) {
+        const char *end = pos + 1;
+        while (*end && *end != ':' && *end != ' ') {
+            end++;
+        }
+        if (*end != ':' || end == pos + 1) {
+            continue;
+        }
+        if (d->numArgs == maxArgs_DispatchedCommand_) {
+            d->isComplete = iFalse;
+            break;
+        }
+        d->args[d->numArgs++] = (iCommandArg){ { pos + 1, end }, end + 1 };
+    }
+}
+
+void endDispatch_Command(void) {
+    iAssert(numDispatched_ > 0);
+    numDispatched_--;
+}
+
+static const iDispatchedCommand *dispatched_Command_(const char *cmd) {
+    for (int i = iMin(numDispatched_, maxNesting_DispatchedCommand_) - 1; i >= 0; i--) {
+        if (dispatched_[i].cmd == cmd) {
+            return &dispatched_[i];
+        }
+    }
+    return NULL;
+}
+
 iBool equal_Command(const char *cmdWithArgs, const char *cmd) {
+    const iDispatchedCommand *d = dispatched_Command_(cmdWithArgs);
+    if (d) {
+        const size_t len = strlen(cmd);
+        if (d->hasArgs) {
+            return len < d->len && cmdWithArgs[len] == ' ' && !memcmp(cmdWithArgs, cmd, len);
+        }
+        return len == d->len && !memcmp(cmdWithArgs, cmd, len);
+    }
     if (strchr(cmdWithArgs, ':')) {
         return startsWith_CStr(cmdWithArgs, cmd) && cmdWithArgs[strlen(cmd)] == ' ';
     }
     return equal_CStr(cmdWithArgs, cmd);
 }
 
-static const iString *tokenString_(const char *label) {
-    return collectNewFormat_String(" %s:", label);
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(CommandName)
+iDeclareType(CommandSubscriber)
+
+struct Impl_CommandName {
+    iRangecc name; /* kept for the lifetime of the app */
+    int      id;
+};
+
+struct Impl_CommandSubscriber {
+    int                 id;
+    iAnyObject *        context;
+    iCommandHandlerFunc handler;
+};
+
+static iSortedArray *names_;
+static iSortedArray *subscribers_; /* sorted by ID */
+
+static int cmp_CommandName_(const void *a, const void *b) {
+    const iRangecc x = ((const iCommandName *) a)->name;
+    const iRangecc y = ((const iCommandName *) b)->name;
+    const size_t   xn = size_Range(&x), yn = size_Range(&y);
+    const int      cmp = memcmp(x.start, y.start, iMin(xn, yn));
+    return cmp ? cmp : xn < yn ? -1 : xn > yn ? 1 : 0;
+}
+
+static int cmp_CommandSubscriber_(const void *a, const void *b) {
+    const iCommandSubscriber *x = a, *y = b;
+    if (x->id != y->id) {
+        return x->id < y->id ? -1 : 1;
+    }
+    const uintptr_t xc = (uintptr_t) x->context, yc = (uintptr_t) y->context;
+    return xc < yc ? -1 : xc > yc ? 1 : 0;
+}
+
+static iRangecc name_Command_(const char *cmd) {
+    const char *end = strchr(cmd, ' ');
+    return (iRangecc){ cmd, end ? end : cmd + strlen(cmd) };
+}
+
+static int findId_Command_(const char *cmd) {
+    size_t pos;
+    if (names_ && locate_SortedArray(names_, &(iCommandName){ name_Command_(cmd), 0 }, &pos)) {
+        return ((const iCommandName *) at_SortedArray(names_, pos))->id;
+    }
+    return 0;
+}
+
+int id_Command(const char *cmd) {
+    int id = findId_Command_(cmd);
+    if (!id) {
+        if (!names_) {
+            names_ = new_SortedArray(sizeof(iCommandName), cmp_CommandName_);
+        }
+        const iRangecc name = name_Command_(cmd);
+        const size_t   len  = size_Range(&name);
+        char *         copy = malloc(len);
+        memcpy(copy, name.start, len);
+        id = (int) size_SortedArray(names_) + 1;
+        insert_SortedArray(names_, &(iCommandName){ { copy, copy + len }, id });
+    }
+    return id;
+}
+
+void subscribe_Command(const char *cmd, iAnyObject *context, iCommandHandlerFunc handler) {
+    if (!subscribers_) {
+        subscribers_ = new_SortedArray(sizeof(iCommandSubscriber), cmp_CommandSubscriber_);
+    }
+    insert_SortedArray(subscribers_, &(iCommandSubscriber){ id_Command(cmd), context, handler });
+}
+
+void unsubscribe_Command(iAnyObject *context) {
+    if (!subscribers_) {
+        return;
+    }
+    for (size_t i = size_SortedArray(subscribers_); i-- > 0; ) {
+        if (((const iCommandSubscriber *) at_SortedArray(subscribers_, i))->context == context) {
+            remove_Array(&subscribers_->values, i);
+        }
+    }
+}
+
+iBool route_Command(const char *cmd) {
+    const iDispatchedCommand *dispatched = dispatched_Command_(cmd);
+    const int id = (dispatched ? dispatched->id : findId_Command_(cmd));
+    if (!id || !subscribers_) {
+        return iFalse;
+    }
+    size_t pos;
+    locate_SortedArray(subscribers_, &(iCommandSubscriber){ id, NULL, NULL }, &pos);
+    if (pos == size_SortedArray(subscribers_) ||
+        ((const iCommandSubscriber *) at_SortedArray(subscribers_, pos))->id != id) {
+        return iFalse;
+    }
+    /* Handlers may subscribe or unsubscribe, so call the ones that remain. */
+    iArray *called = new_Array(sizeof(iCommandSubscriber));
+    for (; pos < size_SortedArray(subscribers_); pos++) {
+        const iCommandSubscriber *sub = at_SortedArray(subscribers_, pos);
+        if (sub->id != id) break;
+        pushBack_Array(called, sub);
+    }
+    iConstForEach(Array, i, called) {
+        const iCommandSubscriber *sub = i.value;
+        size_t subPos;
+        if (locate_SortedArray(subscribers_, sub, &subPos) && sub->handler(sub->context, cmd)) {
+            break;
+        }
+    }
+    delete_Array(called);
+    return iTrue;
+}
+
+static const char *findLabel_(const char *cmd, const char *label) {
+    /* Returns the position of the value. */
+    const size_t labelLen = strlen(label);
+    const iDispatchedCommand *d = dispatched_Command_(cmd);
+    if (d && d->isComplete) {
+        for (size_t i = 0; i < d->numArgs; i++) {
+            const iCommandArg *arg = &d->args[i];
+            if (size_Range(&arg->label) == labelLen && !memcmp(arg->label.start, label, labelLen)) {
+                return arg->value;
+            }
+        }
+        return NULL;
+    }
+    char tok[64];
+    if (labelLen + 3 > sizeof(tok)) {
+        const char *ptr = strstr(cmd, cstrCollect_String(newFormat_String(" %s:", label)));
+        return ptr ? ptr + labelLen + 2 : NULL;
+    }
+    tok[0] = ' ';
+    memcpy(tok + 1, label, labelLen);
+    tok[labelLen + 1] = ':';
+    tok[labelLen + 2] = 0;
+    const char *ptr = strstr(cmd, tok);
+    return ptr ? ptr + labelLen + 2 : NULL;
 }
 
 int argLabel_Command(const char *cmd, const char *label) {
-    const iString *tok = tokenString_(label);
-    const char *ptr = strstr(cmd, cstr_String(tok));
+    const char *ptr = findLabel_(cmd, label);
     if (ptr) {
-        return atoi(ptr + size_String(tok));
+        return atoi(ptr);
     }
     return 0;
 }
@@ -51,37 +263,30 @@ int arg_Command(const char *cmd) {
 }
 
 uint32_t argU32Label_Command(const char *cmd, const char *label) {
-    const iString *tok = tokenString_(label);
-    const char *ptr = strstr(cmd, cstr_String(tok));
+    const char *ptr = findLabel_(cmd, label);
     if (ptr) {
-        return strtoul(ptr + size_String(tok), NULL, 10);
+        return strtoul(ptr, NULL, 10);
     }
     return 0;
 }
 
 float argfLabel_Command(const char *cmd, const char *label) {
-    const iString *tok = tokenString_(label);
-    const char *ptr = strstr(cmd, cstr_String(tok));
+    const char *ptr = findLabel_(cmd, label);
     if (ptr) {
-        return strtof(ptr + size_String(tok), NULL);
+        return strtof(ptr, NULL);
     }
     return 0.0f;
 }
 
 float argf_Command(const char *cmd) {
-    const char *ptr = strstr(cmd, " arg:");
-    if (ptr) {
-        return strtof(ptr + 5, NULL);
-    }
-    return 0;
+    return argfLabel_Command(cmd, "arg");
 }
 
 void *pointerLabel_Command(const char *cmd, const char *label) {
-    const iString *tok = tokenString_(label);
-    const char *ptr = strstr(cmd, cstr_String(tok));
+    const char *ptr = findLabel_(cmd, label);
     if (ptr) {
         void *val = NULL;
-        sscanf(ptr + size_String(tok), "%p", &val);
+        sscanf(ptr, "%p", &val);
         return val;
     }
     return NULL;
@@ -92,12 +297,7 @@ void *pointer_Command(const char *cmd) {
 }
 
 const char *suffixPtr_Command(const char *cmd, const char *label) {
-    const iString *tok = tokenString_(label);
-    const char *ptr = strstr(cmd, cstr_String(tok));
-    if (ptr) {
-        return ptr + size_String(tok);
-    }
-    return NULL;
+    return findLabel_(cmd, label);
 }
 
 iString *suffix_Command(const char *cmd, const char *label) {
@@ -118,10 +318,10 @@ iRangecc range_Command(const char *cmd, const char *label) {
 }
 
 iInt2 dir_Command(const char *cmd) {
-    const char *ptr = strstr(cmd, " dir:");
+    const char *ptr = findLabel_(cmd, "dir");
     if (ptr) {
         iInt2 dir;
-        sscanf(ptr + 5, "%d%d", &dir.x, &dir.y);
+        sscanf(ptr, "%d%d", &dir.x, &dir.y);
         return dir;
     }
     return zero_I2();
@@ -129,9 +329,9 @@ iInt2 dir_Command(const char *cmd) {
 
 iInt2 coord_Command(const char *cmd) {
     iInt2 coord = zero_I2();
-    const char *ptr = strstr(cmd, " coord:");
+    const char *ptr = findLabel_(cmd, "coord");
     if (ptr) {
-        sscanf(ptr + 7, "%d%d", &coord.x, &coord.y);
+        sscanf(ptr, "%d%d", &coord.x, &coord.y);
     }
     return coord;
 }
@@ -28,6 +28,23 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 iBool       equal_Command           (const char *commandWithArgs, const char *command);
 
+/* The command being dispatched is parsed once so that the lookups below don't need to scan
+   the string in every handler. Calls must be paired; the string must remain valid until
+   the dispatch ends. */
+void        beginDispatch_Command   (const char *commandWithArgs);
+void        endDispatch_Command     (void);
+
+/* Commands are identified by their interned name. Notifications that only a few objects
+   care about can be routed to subscribers instead of being broadcast to the widget tree.
+   Once a command has subscribers, it is delivered only to them (regardless of the root it
+   was posted to), until one returns true. Main thread only. */
+typedef iBool (*iCommandHandlerFunc)(iAnyObject *context, const char *commandWithArgs);
+
+int         id_Command              (const char *command); /* arguments are ignored */
+void        subscribe_Command       (const char *command, iAnyObject *context, iCommandHandlerFunc handler);
+void        unsubscribe_Command     (iAnyObject *context); /* all of the context's subscriptions */
+iBool       route_Command           (const char *commandWithArgs); /* true if subscribers exist */
+
 int         arg_Command             (const char *); /* arg: */
 float       argf_Command            (const char *); /* arg: */
 int         argLabel_Command        (const char *, const char *label);
@@ -30,6 +30,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "banner.h"
 #include "bookmarks.h"
 #include "command.h"
+#include "contentcache.h"
 #include "defs.h"
 #include "gempub.h"
 #include "gmcerts.h"
@@ -68,6 +69,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/ptrset.h>
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/stringarray.h>
+#include <the_Foundation/thread.h>
 #include <SDL_clipboard.h>
 #include <SDL_timer.h>
 #include <SDL_render.h>
@@ -198,10 +200,39 @@ static void visBufInvalidated_(iVisBuf *d, size_t index) {
 
 /*----------------------------------------------------------------------------------------------*/
 
+iDeclareType(LayoutJob)
+
+/* Large documents are laid out in a background thread when the width changes. A copy of
+   the document is laid out while the old layout remains visible. */
+struct Impl_LayoutJob {
+    iThread *    thread;
+    iGmDocument *doc; /* copy being laid out */
+    iText *      text;
+    int          width;
+    int          canvasWidth;
+};
+
+static const size_t minBackgroundLayoutSize_LayoutJob_ = 128 * 1024; /* bytes of source */
+
+static void init_LayoutJob(iLayoutJob *d) {
+    iZap(*d);
+}
+
+static void deinit_LayoutJob(iLayoutJob *d) {
+    iRelease(d->thread);
+    iRelease(d->doc);
+}
+
+iDefineTypeConstruction(LayoutJob)
+
+/*----------------------------------------------------------------------------------------------*/
+
 static void animate_DocumentWidget_             (void *ticker);
 static void animateMedia_DocumentWidget_        (iDocumentWidget *d);
 static void updateSideIconBuf_DocumentWidget_   (const iDocumentWidget *d);
 static void prerender_DocumentWidget_           (iAny *);
+static void prewarmGlyphs_DocumentWidget_       (iAny *);
+static iBool handleRoutedCommand_DocumentWidget_(iAnyObject *, const char *);
 static void scrollBegan_DocumentWidget_         (iAnyObject *, int, uint32_t);
 
 static const int smoothDuration_DocumentWidget_(enum iScrollType type) {
@@ -231,6 +262,7 @@ enum iDocumentWidgetFlag {
     urlChanged_DocumentWidgetFlag            = iBit(13),
     openedFromSidebar_DocumentWidgetFlag     = iBit(14),
     drawDownloadCounter_DocumentWidgetFlag   = iBit(15),
+    pendingRestore_DocumentWidgetFlag        = iBit(16), /* restored state not yet loaded */
 };
 
 enum iDocumentLinkOrdinalMode {
@@ -278,10 +310,11 @@ struct Impl_DocumentWidget {
     enum iGmStatusCode sourceStatus;
     iString        sourceHeader;
     iString        sourceMime;
-    iBlock         sourceContent; /* original content as received, for saving; set on request finish */
+    iBlock         sourceContent; /* original content as received so far */
     iTime          sourceTime;
     iGempub *      sourceGempub; /* NULL unless the page is Gempub content */
     iGmDocument *  doc;
+    iLayoutJob *   layoutJob; /* relayout of `doc` in a background thread */
     iBanner *      banner;
     
     /* Rendering: */
@@ -304,6 +337,7 @@ struct Impl_DocumentWidget {
     iVisBufMeta *  visBufMeta;
     iGmRunRange    renderRuns;
     iPtrSet *      invalidRuns;
+    size_t         prewarmedGlyphs; /* position in the document's glyph set */
     
     /* Widget structure: */    
     iScrollWidget *scroll;
@@ -323,6 +357,9 @@ void init_DocumentWidget(iDocumentWidget *d) {
     iWidget *w = as_Widget(d);
     init_Widget(w);
     setId_Widget(w, format_CStr("document%03d", ++docEnum_));
+    subscribe_Command("media.updated", d, handleRoutedCommand_DocumentWidget_);
+    subscribe_Command("media.finished", d, handleRoutedCommand_DocumentWidget_);
+    subscribe_Command("media.decoded", d, handleRoutedCommand_DocumentWidget_);
     setFlags_Widget(w, hover_WidgetFlag | noBackground_WidgetFlag, iTrue);
     if (deviceType_App() != desktop_AppDeviceType) {
         setFlags_Widget(w, leftEdgeDraggable_WidgetFlag | rightEdgeDraggable_WidgetFlag |
@@ -342,6 +379,7 @@ void init_DocumentWidget(iDocumentWidget *d) {
     d->isRequestUpdated = iFalse;
     d->media            = new_ObjectList();
     d->doc              = new_GmDocument();
+    d->layoutJob        = NULL;
     d->banner           = new_Banner();
     setOwner_Banner(d->banner, d);
     d->redirectCount    = 0;
@@ -368,6 +406,7 @@ void init_DocumentWidget(iDocumentWidget *d) {
         }
     }
     d->invalidRuns = new_PtrSet();
+    d->prewarmedGlyphs = 0;
     init_Anim(&d->sideOpacity, 0);
     init_Anim(&d->altTextOpacity, 0);
     d->sourceStatus = none_GmStatusCode;
@@ -418,9 +457,15 @@ void cancelAllRequests_DocumentWidget(iDocumentWidget *d) {
 
 void deinit_DocumentWidget(iDocumentWidget *d) {
     cancelAllRequests_DocumentWidget(d);
+    if (d->layoutJob) {
+        join_Thread(d->layoutJob->thread);
+        delete_LayoutJob(d->layoutJob);
+    }
     pauseAllPlayers_Media(media_GmDocument(d->doc), iTrue);
     removeTicker_App(animate_DocumentWidget_, d);
     removeTicker_App(prerender_DocumentWidget_, d);
+    removeTicker_App(prewarmGlyphs_DocumentWidget_, d);
+    unsubscribe_Command(d);
     remove_Periodic(periodic_App(), d);
     delete_Translation(d->translation);
     delete_DrawBufs(d->drawBufs);
@@ -1144,6 +1189,8 @@ static void replaceDocument_DocumentWidget_(iDocumentWidget *d, iGmDocument *new
     pauseAllPlayers_Media(media_GmDocument(d->doc), iTrue);
     iRelease(d->doc);
     d->doc = ref_Object(newDoc);
+    /* Images decoded while the document was not shown are still waiting for textures. */
+    finishDecoding_Media(media_GmDocument(d->doc));
     documentWasChanged_DocumentWidget_(d);
 }
 
@@ -1517,8 +1564,9 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d,
         return;
     }
     const iBool isRequestFinished = isFinished_GmRequest(d->request);
-    /* TODO: Do document update in the background. However, that requires a text metrics calculator
-       that does not try to cache the glyph bitmaps. */
+    /* Note: Appended content is laid out incrementally. Width changes of large documents are
+       laid out in the background (see `startBackgroundLayout_DocumentWidget_`). The body is
+       read from `sourceContent`, which the caller has updated. */
     const enum iGmStatusCode statusCode = response->statusCode;
     if (category_GmStatusCode(statusCode) != categoryInput_GmStatusCode) {
         iBool setSource = iTrue;
@@ -1530,7 +1578,7 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d,
         clear_String(&d->sourceMime);
         d->sourceTime = response->when;
         d->drawBufs->flags |= updateTimestampBuf_DrawBufsFlag;
-        initBlock_String(&str, &response->body); /* Note: Body may be megabytes in size. */
+        initBlock_String(&str, &d->sourceContent); /* Note: Body may be megabytes in size. */
         if (isSuccess_GmStatusCode(statusCode)) {
             /* Check the MIME type. */
             iRangecc charset = range_CStr("utf-8");
@@ -1544,7 +1592,7 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d,
                 trim_Rangecc(&param);
                 /* Detect fontpacks even if the server doesn't use the right media type. */
                 if (isRequestFinished && equal_Rangecc(param, "application/octet-stream")) {
-                    if (detect_FontPack(&response->body)) {
+                    if (detect_FontPack(&d->sourceContent)) {
                         param = range_CStr(mimeType_FontPack);
                     }
                 }
@@ -1609,7 +1657,7 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d,
                     if (equal_Rangecc(param, mimeType_FontPack)) {
                         /* Show some information about fontpacks, and set up footer actions. */
                         iArchive *zip = iClob(new_Archive());
-                        if (openData_Archive(zip, &response->body)) {
+                        if (openData_Archive(zip, &d->sourceContent)) {
                             iFontPack *fp = new_FontPack();
                             setUrl_FontPack(fp, d->mod.url);
                             setStandalone_FontPack(fp, iTrue);
@@ -1676,7 +1724,7 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d,
                         setData_Media(media_GmDocument(d->doc),
                                       imgLinkId,
                                       mimeStr,
-                                      &response->body,
+                                      &d->sourceContent,
                                       !isRequestFinished ? partialData_MediaFlag : 0);
                         redoLayout_GmDocument(d->doc);
                     }
@@ -1685,7 +1733,7 @@ static void updateDocument_DocumentWidget_(iDocumentWidget *d,
                         setData_Media(media_GmDocument(d->doc),
                                       imgLinkId,
                                       mimeStr,
-                                      &response->body,
+                                      &d->sourceContent,
                                       !isRequestFinished ? partialData_MediaFlag : 0);
                         refresh_Widget(d);
                         setSource = iFalse;
@@ -1745,6 +1793,7 @@ static void fetch_DocumentWidget_(iDocumentWidget *d) {
                       d,
                       cstr_String(d->mod.url));
     clear_ObjectList(d->media);
+    clear_Block(&d->sourceContent);
     d->certFlags = 0;
     setLinkNumberMode_DocumentWidget_(d, iFalse);
     d->flags &= ~drawDownloadCounter_DocumentWidgetFlag;
@@ -1789,21 +1838,31 @@ static void parseUser_DocumentWidget_(iDocumentWidget *d) {
     setRange_String(d->titleUser, urlUser_String(d->mod.url));
 }
 
-static void cacheRunGlyphs_(void *data, const iGmRun *run) {
-    iUnused(data);
-    if (!isEmpty_Range(&run->text)) {
-        cache_Text(run->font, run->text);
+enum { prewarmBatch_DocumentWidget_ = 128 }; /* glyphs rasterized per frame */
+
+static void prewarmGlyphs_DocumentWidget_(iAny *context) {
+    if (current_Root() == NULL) {
+        return; /* pending destruction */
+    }
+    iDocumentWidget *d = context;
+    const iSortedArray *glyphs = glyphs_GmDocument(d->doc);
+    if (!isExposed_Window(get_Window()) || d->prewarmedGlyphs >= size_SortedArray(glyphs)) {
+        return;
+    }
+    d->prewarmedGlyphs =
+        cacheGlyphSet_Text(glyphs, d->prewarmedGlyphs, prewarmBatch_DocumentWidget_);
+    if (d->prewarmedGlyphs < size_SortedArray(glyphs)) {
+        addTicker_App(prewarmGlyphs_DocumentWidget_, d);
     }
 }
 
-static void cacheDocumentGlyphs_DocumentWidget_(const iDocumentWidget *d) {
+static void cacheDocumentGlyphs_DocumentWidget_(iDocumentWidget *d) {
     if (isFinishedLaunching_App() && isExposed_Window(get_Window())) {
-        /* Just cache the top of the document, since this is what we usually need. */
-        int maxY = height_Widget(&d->widget) * 2;
-        if (maxY == 0) {
-            maxY = size_GmDocument(d->doc).y;
-        }
-        render_GmDocument(d->doc, (iRangei){ 0, maxY }, cacheRunGlyphs_, NULL);
+        /* The layout collected the glyphs used from the top of the document down. The first
+           batch is rasterized right away and the rest one batch per frame, instead of one
+           glyph at a time while drawing. */
+        d->prewarmedGlyphs = 0;
+        prewarmGlyphs_DocumentWidget_(d);
     }
 }
 
@@ -1917,7 +1976,22 @@ static iBool updateFromHistory_DocumentWidget_(iDocumentWidget *d) {
             d, recent->normScrollY, recent->cachedResponse, recent->cachedDoc);
         return iTrue;
     }
-    else if (!isEmpty_String(d->mod.url)) {
+    /* The content may have been cached by another tab or in an earlier session. */
+    iGmResponse *cached = find_ContentCache(contentCache_App(), d->mod.url);
+    if (cached) {
+        if (recent) {
+            iChangeFlags(d->flags,
+                         openedFromSidebar_DocumentWidgetFlag,
+                         recent->flags.openedFromSidebar);
+        }
+        updateFromCachedResponse_DocumentWidget_(d,
+                                                 recent ? recent->normScrollY : 0.0f,
+                                                 cached,
+                                                 recent ? recent->cachedDoc : NULL);
+        delete_GmResponse(cached);
+        return iTrue;
+    }
+    if (!isEmpty_String(d->mod.url)) {
         fetch_DocumentWidget_(d);
     }
     if (recent) {
@@ -2111,6 +2185,15 @@ static const char *humanReadableStatusCode_(enum iGmStatusCode code) {
     return format_CStr("%d ", code);
 }
 
+static void takeReceivedBody_DocumentWidget_(iDocumentWidget *d) {
+    /* Note: Response must be locked. Only the newly received part of the body is copied, and
+       the request can then drop it. This way the request holds no more than what arrives
+       between two updates, and the content is not copied again on every update. */
+    const iRangecc received = bodyView_GmRequest(d->request, size_Block(&d->sourceContent));
+    appendData_Block(&d->sourceContent, received.start, size_Range(&received));
+    consumeBody_GmRequest(d->request, size_Range(&received));
+}
+
 static void checkResponse_DocumentWidget_(iDocumentWidget *d) {
     if (!d->request) {
         return;
@@ -2120,6 +2203,9 @@ static void checkResponse_DocumentWidget_(iDocumentWidget *d) {
         return;
     }
     iGmResponse *resp = lockResponse_GmRequest(d->request);
+    if (isSuccess_GmStatusCode(statusCode)) {
+        takeReceivedBody_DocumentWidget_(d);
+    }
     if (d->state == fetching_RequestState) {
         d->state = receivedPartialResponse_RequestState;
         updateTrust_DocumentWidget_(d, resp);
@@ -2341,7 +2427,30 @@ static iBool isDownloadRequest_DocumentWidget(const iDocumentWidget *d, const iM
     return findMediaForLink_Media(constMedia_GmDocument(d->doc), req->linkId, download_MediaType).type != 0;
 }
 
+static void updateDownload_DocumentWidget_(iDocumentWidget *d, const iMediaRequest *req,
+                                           const iGmResponse *resp) {
+    /* Note: Response must be locked. The request writes the body directly to the file, so it
+       is never held in memory in full. */
+    iMedia *media = media_GmDocument(d->doc);
+    if (bodySink_GmRequest(req->req) == memory_GmBodySinkType) {
+        const iString *path = beginDownload_Media(media, req->linkId, &resp->meta);
+        if (path && !setBodyFile_GmRequest(req->req, path)) {
+            fprintf(stderr, "[DocumentWidget] failed to open %s for writing\n", cstr_String(path));
+        }
+    }
+    updateDownload_Media(media, req->linkId, bodySize_GmRequest(req->req),
+                         isFinished_GmRequest(req->req));
+}
+
 static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
+    if (equal_Command(cmd, "media.decoded")) {
+        /* An image has been decoded in the background; it may be one of ours. */
+        if (finishDecoding_Media(media_GmDocument(d->doc))) {
+            invalidate_DocumentWidget_(d);
+            refresh_Widget(as_Widget(d));
+        }
+        return iFalse;
+    }
     iMediaRequest *req = pointerLabel_Command(cmd, "request");
     iBool isOurRequest = iFalse;
     /* This request may already be deleted so treat the pointer with caution. */
@@ -2355,24 +2464,35 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
         return iFalse;
     }
     if (equal_Command(cmd, "media.updated")) {
-        /* Pass new data to media players. */
+        /* Pass new data to media players and image previews. */
         const enum iGmStatusCode code = status_GmRequest(req->req);
         if (isSuccess_GmStatusCode(code)) {
             iGmResponse *resp = lockResponse_GmRequest(req->req);
-            if (isDownloadRequest_DocumentWidget(d, req) ||
-                startsWith_String(&resp->meta, "audio/")) {
-                /* TODO: Use a helper? This is same as below except for the partialData flag. */
-                if (setData_Media(media_GmDocument(d->doc),
-                                  req->linkId,
-                                  &resp->meta,
-                                  &resp->body,
-                                  partialData_MediaFlag | allowHide_MediaFlag)) {
-                    redoLayout_GmDocument(d->doc);
-                }
+            if (isDownloadRequest_DocumentWidget(d, req)) {
+                updateDownload_DocumentWidget_(d, req, resp);
                 updateVisible_DocumentWidget_(d);
                 invalidate_DocumentWidget_(d);
                 refresh_Widget(as_Widget(d));
             }
+            else if (startsWith_String(&resp->meta, "audio/") ||
+                     startsWith_String(&resp->meta, "image/")) {
+                /* TODO: Use a helper? This is same as below except for the partialData flag. */
+                const iBool isNew = setData_Media(media_GmDocument(d->doc),
+                                                  req->linkId,
+                                                  &resp->meta,
+                                                  &resp->body,
+                                                  partialData_MediaFlag | allowHide_MediaFlag);
+                if (isNew) {
+                    redoLayout_GmDocument(d->doc);
+                }
+                /* An image preview is drawn once decoded ("media.decoded"), so only a new
+                   image affects the layout. */
+                if (isNew || !startsWith_String(&resp->meta, "image/")) {
+                    updateVisible_DocumentWidget_(d);
+                    invalidate_DocumentWidget_(d);
+                    refresh_Widget(as_Widget(d));
+                }
+            }
             unlockResponse_GmRequest(req->req);
         }
         /* Update the link's progress. */
@@ -2384,14 +2504,22 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
         const enum iGmStatusCode code = status_GmRequest(req->req);
         /* Give the media to the document for presentation. */
         if (isSuccess_GmStatusCode(code)) {
-            if (isDownloadRequest_DocumentWidget(d, req) ||
+            const iBool isDownload = isDownloadRequest_DocumentWidget(d, req);
+            if (isDownload ||
                 startsWith_String(meta_GmRequest(req->req), "image/") ||
                 startsWith_String(meta_GmRequest(req->req), "audio/")) {
-                setData_Media(media_GmDocument(d->doc),
-                              req->linkId,
-                              meta_GmRequest(req->req),
-                              body_GmRequest(req->req),
-                              allowHide_MediaFlag);
+                if (isDownload) {
+                    /* The sink may not be set yet if there were no updates. */
+                    updateDownload_DocumentWidget_(d, req, lockResponse_GmRequest(req->req));
+                    unlockResponse_GmRequest(req->req);
+                }
+                else {
+                    setData_Media(media_GmDocument(d->doc),
+                                  req->linkId,
+                                  meta_GmRequest(req->req),
+                                  body_GmRequest(req->req),
+                                  allowHide_MediaFlag);
+                }
                 redoLayout_GmDocument(d->doc);
                 iZap(d->visibleRuns); /* pointers invalidated */
                 updateVisible_DocumentWidget_(d);
@@ -2409,6 +2537,21 @@ static iBool handleMediaCommand_DocumentWidget_(iDocumentWidget *d, const char *
     return iFalse;
 }
 
+static iBool handleRoutedCommand_DocumentWidget_(iAnyObject *context, const char *cmd) {
+    /* Media notifications are routed directly to documents, not via the widget tree. */
+    iDocumentWidget *d = context;
+    iRoot *root = as_Widget(d)->root;
+    if (!root) {
+        return iFalse; /* not in a window */
+    }
+    iRoot *oldRoot = current_Root();
+    setCurrent_Window(root->window);
+    setCurrent_Root(root);
+    const iBool wasUsed = handleMediaCommand_DocumentWidget_(d, cmd);
+    setCurrent_Root(oldRoot);
+    return wasUsed;
+}
+
 static void allocVisBuffer_DocumentWidget_(const iDocumentWidget *d) {
     const iWidget *w         = constAs_Widget(d);
     const iBool    isVisible = isVisible_Widget(w);
@@ -2513,12 +2656,50 @@ static const int homeRowKeys_[] = {
     't', 'y',
 };
 
+static iThreadResult layout_LayoutJob_(iThread *thread) {
+    iDocumentWidget *d   = userData_Thread(thread);
+    iLayoutJob      *job = d->layoutJob;
+    setCurrent_Text(job->text); /* measuring only */
+    setWidth_GmDocument(job->doc, job->width, job->canvasWidth);
+    setCurrent_Text(NULL);
+    postCommand_Widget(d, "document.layout.finished");
+    return 0;
+}
+
+static iBool startBackgroundLayout_DocumentWidget_(iDocumentWidget *d, int width) {
+    if (d->layoutJob) {
+        return iTrue; /* the width is checked again when the job finishes */
+    }
+    if (size_String(source_GmDocument(d->doc)) < minBackgroundLayoutSize_LayoutJob_ ||
+        isLayoutCached_GmDocument(d->doc, width, width_Widget(d))) {
+        return iFalse;
+    }
+    iGmDocument *copy = newLayoutCopy_GmDocument(d->doc);
+    if (!copy) {
+        return iFalse;
+    }
+    iLayoutJob *job  = new_LayoutJob();
+    job->doc         = copy;
+    job->text        = current_Text();
+    job->width       = width;
+    job->canvasWidth = width_Widget(d);
+    job->thread      = new_Thread(layout_LayoutJob_);
+    setUserData_Thread(job->thread, d);
+    d->layoutJob = job;
+    start_Thread(job->thread);
+    return iTrue;
+}
+
 static iBool updateDocumentWidthRetainingScrollPosition_DocumentWidget_(iDocumentWidget *d,
                                                                         iBool keepCenter) {
     const int newWidth = documentWidth_DocumentWidget_(d);
     if (newWidth == size_GmDocument(d->doc).x && !keepCenter /* not a font change */) {
         return iFalse;
     }
+    if (!keepCenter && startBackgroundLayout_DocumentWidget_(d, newWidth)) {
+        /* The current layout remains visible until the new one is ready. */
+        return iFalse;
+    }
     /* Font changes (i.e., zooming) will keep the view centered, otherwise keep the top
        of the visible area fixed. */
     const iGmRun *run     = keepCenter ? middleRun_DocumentWidget_(d) : d->visibleRuns.start;
@@ -2550,6 +2731,42 @@ static iBool updateDocumentWidthRetainingScrollPosition_DocumentWidget_(iDocumen
     return iTrue;
 }
 
+static void finishBackgroundLayout_DocumentWidget_(iDocumentWidget *d) {
+    iLayoutJob *job = d->layoutJob;
+    join_Thread(job->thread);
+    d->layoutJob = NULL;
+    if (job->width == documentWidth_DocumentWidget_(d)) {
+        const iGmRun *run     = d->visibleRuns.start;
+        const char *  runLoc  = (run ? run->text.start : NULL);
+        const int     voffset = (run ? visibleRange_DocumentWidget_(d).start -
+                                           top_Rect(run->visBounds) : 0);
+        if (takeLayout_GmDocument(d->doc, job->doc)) {
+            /* Link states may have changed while the copy was being laid out. */
+            updateVisitedLinks_GmDocument(d->doc);
+            updateOpenURLs_GmDocument(d->doc);
+            setWidth_Banner(d->banner, job->width);
+            documentRunsInvalidated_DocumentWidget_(d);
+            if (runLoc && (run = findRunAtLoc_GmDocument(d->doc, runLoc)) != NULL) {
+                scrollTo_DocumentWidget_(d,
+                                         top_Rect(run->visBounds) +
+                                             lineHeight_Text(paragraph_FontId) + voffset,
+                                         iFalse);
+            }
+            resetWideRuns_DocumentWidget_(d);
+            updateVisible_DocumentWidget_(d);
+            invalidate_DocumentWidget_(d);
+            refresh_Widget(d);
+        }
+    }
+    delete_LayoutJob(job);
+    /* The width may have changed again, or the document was laid out in the meantime. */
+    if (updateDocumentWidthRetainingScrollPosition_DocumentWidget_(d, iFalse)) {
+        updateVisible_DocumentWidget_(d);
+        invalidate_DocumentWidget_(d);
+        refresh_Widget(d);
+    }
+}
+
 static iBool handlePinch_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
     if (equal_Command(cmd, "pinch.began")) {
         d->pinchZoomInitial = d->pinchZoomPosted = prefs_App()->zoomPercent;
@@ -2631,6 +2848,7 @@ static iBool handleSwipe_DocumentWidget_(iDocumentWidget *d, const char *cmd) {
                     preceding_History(d->mod.history, recent);
                     if (recent->cachedDoc) {
                         iChangeRef(swipeIn->doc, recent->cachedDoc);
+                        finishDecoding_Media(media_GmDocument(swipeIn->doc));
                         updateScrollMax_DocumentWidget_(d);
                         setValue_Anim(&swipeIn->scrollY.pos,
                                       pageHeight_DocumentWidget_(d) * recent->normScrollY, 0);
@@ -2752,6 +2970,12 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         invalidateVisibleLinks_DocumentWidget_(d);
         return iFalse;
     }
+    if (equalWidget_Command(cmd, w, "document.layout.finished")) {
+        if (d->layoutJob) {
+            finishBackgroundLayout_DocumentWidget_(d);
+        }
+        return iTrue;
+    }
     if (equal_Command(cmd, "document.render")) /* `Periodic` makes direct dispatch to here */ {
 //        printf("%u: document.render\n", SDL_GetTicks());
         if (SDL_GetTicks() - d->drawBufs->lastRenderTime > 150) {
@@ -2818,6 +3042,8 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
     else if (equal_Command(cmd, "tabs.changed")) {
         setLinkNumberMode_DocumentWidget_(d, iFalse);
         if (cmp_String(id_Widget(w), suffixPtr_Command(cmd, "id")) == 0) {
+            /* Tab may be shown for the first time since the session was restored. */
+            loadRestored_DocumentWidget(d);
             /* Set palette for our document. */
             updateTheme_DocumentWidget_(d);
             updateTrust_DocumentWidget_(d, NULL);
@@ -3059,7 +3285,6 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
     }
     else if (equalWidget_Command(cmd, w, "document.request.finished") &&
              id_GmRequest(d->request) == argU32Label_Command(cmd, "reqid")) {
-        set_Block(&d->sourceContent, body_GmRequest(d->request));
         if (!isSuccess_GmStatusCode(status_GmRequest(d->request))) {
             /* TODO: Why is this here? Can it be removed? */
             format_String(&d->sourceHeader,
@@ -3083,8 +3308,12 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
             if (!equal_Rangecc(urlScheme_String(d->mod.url), "about") &&
                 (startsWithCase_String(meta_GmRequest(d->request), "text/") ||
                  !cmp_String(&d->sourceMime, mimeType_Gempub))) {
-                setCachedResponse_History(d->mod.history, lockResponse_GmRequest(d->request));
+                /* The request no longer holds the body. */
+                iGmResponse *resp = copy_GmResponse(lockResponse_GmRequest(d->request));
                 unlockResponse_GmRequest(d->request);
+                set_Block(&resp->body, &d->sourceContent);
+                setCachedResponse_History(d->mod.history, resp);
+                delete_GmResponse(resp);
             }
         }
         iReleasePtr(&d->request);
@@ -3133,9 +3362,6 @@ static iBool handleCommand_DocumentWidget_(iDocumentWidget *d, const char *cmd)
         }
         return iTrue;
     }
-    else if (equal_Command(cmd, "media.updated") || equal_Command(cmd, "media.finished")) {
-        return handleMediaCommand_DocumentWidget_(d, cmd);
-    }
     else if (equal_Command(cmd, "media.player.started")) {
         /* When one media player starts, pause the others that may be playing. */
         const iPlayer *startedPlr = pointerLabel_Command(cmd, "player");
@@ -4396,6 +4622,9 @@ static void drawRun_DrawContext_(void *context, const iGmRun *run) {
             SDL_RenderCopy(d->paint.dst->render, tex, NULL,
                            &(SDL_Rect){ dst.pos.x, dst.pos.y, dst.size.x, dst.size.y });
         }
+        else if (isImageDecoding_Media(media_GmDocument(d->widget->doc), mediaId_GmRun(run))) {
+            fillRect_Paint(&d->paint, dst, tmBackground_ColorId);
+        }
         else {
             drawRect_Paint(&d->paint, dst, tmQuoteIcon_ColorId);
             drawCentered_Text(uiLabel_FontId,
@@ -5259,7 +5488,17 @@ void serializeState_DocumentWidget(const iDocumentWidget *d, iStream *outs) {
 void deserializeState_DocumentWidget(iDocumentWidget *d, iStream *ins) {
     deserialize_PersistentDocumentState(&d->mod, ins);
     parseUser_DocumentWidget_(d);
-    updateFromHistory_DocumentWidget_(d);
+    /* Content is loaded when the tab is first shown, so restoring a session doesn't depend
+       on how many tabs there are. */
+    d->flags |= pendingRestore_DocumentWidgetFlag;
+    updateWindowTitle_DocumentWidget_(d);
+}
+
+void loadRestored_DocumentWidget(iDocumentWidget *d) {
+    if (d->flags & pendingRestore_DocumentWidgetFlag) {
+        d->flags &= ~pendingRestore_DocumentWidgetFlag;
+        updateFromHistory_DocumentWidget_(d);
+    }
 }
 
 static void setUrl_DocumentWidget_(iDocumentWidget *d, const iString *url) {
@@ -5274,6 +5513,7 @@ void setUrlFlags_DocumentWidget(iDocumentWidget *d, const iString *url, int setU
     iChangeFlags(d->flags, openedFromSidebar_DocumentWidgetFlag,
                  (setUrlFlags & openedFromSidebar_DocumentWidgetSetUrlFlag) != 0);
     const iBool isFromCache = (setUrlFlags & useCachedContentIfAvailable_DocumentWidgetSetUrlFlag) != 0;
+    d->flags &= ~pendingRestore_DocumentWidgetFlag;
     setLinkNumberMode_DocumentWidget_(d, iFalse);
     setUrl_DocumentWidget_(d, urlFragmentStripped_String(url));
     /* See if there a username in the URL. */
@@ -5285,7 +5525,7 @@ void setUrlFlags_DocumentWidget(iDocumentWidget *d, const iString *url, int setU
 
 void setUrlAndSource_DocumentWidget(iDocumentWidget *d, const iString *url, const iString *mime,
                                     const iBlock *source) {
-    d->flags &= ~openedFromSidebar_DocumentWidgetFlag;
+    d->flags &= ~(openedFromSidebar_DocumentWidgetFlag | pendingRestore_DocumentWidgetFlag);
     setLinkNumberMode_DocumentWidget_(d, iFalse);
     setUrl_DocumentWidget_(d, url);
     parseUser_DocumentWidget_(d);
@@ -5337,6 +5577,7 @@ void takeRequest_DocumentWidget(iDocumentWidget *d, iGmRequest *finishedRequest)
     d->state = fetching_RequestState;
     iAssert(d->request == NULL);
     d->request = finishedRequest;
+    clear_Block(&d->sourceContent); /* the whole body is still in the request */
     postCommand_Widget(d,
                        "document.request.finished doc:%p reqid:%u request:%p",
                        d,
@@ -36,6 +36,7 @@ void    cancelAllRequests_DocumentWidget(iDocumentWidget *);
 
 void    serializeState_DocumentWidget   (const iDocumentWidget *, iStream *outs);
 void    deserializeState_DocumentWidget (iDocumentWidget *, iStream *ins);
+void    loadRestored_DocumentWidget     (iDocumentWidget *); /* content of deserialized state */
 
 iDocumentWidget *   duplicate_DocumentWidget        (const iDocumentWidget *);
 iHistory *          history_DocumentWidget          (iDocumentWidget *);
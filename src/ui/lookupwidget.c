@@ -34,6 +34,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "listwidget.h"
 #include "lang.h"
 #include "lookup.h"
+#include "searchindex.h"
 #include "util.h"
 #include "visited.h"
 
@@ -48,6 +49,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 iDeclareType(LookupJob)
 
 struct Impl_LookupJob {
+    iString  words; /* for querying the search index */
     iRegExp *term;
     iTime now;
     iObjectList *docs;
@@ -55,6 +57,7 @@ struct Impl_LookupJob {
 };
 
 static void init_LookupJob(iLookupJob *d) {
+    init_String(&d->words);
     d->term = NULL;
     initCurrent_Time(&d->now);
     d->docs = NULL;
@@ -68,6 +71,7 @@ static void deinit_LookupJob(iLookupJob *d) {
     deinit_PtrArray(&d->results);
     iRelease(d->docs);
     iRelease(d->term);
+    deinit_String(&d->words);
 }
 
 iDefineTypeConstruction(LookupJob)
@@ -210,23 +214,33 @@ static float visitedRelevance_LookupJob_(const iLookupJob *d, const iVisitedUrl
     return iMax(h, p) / (age + 1); /* extra weight for recency */
 }
 
-static iBool matchBookmark_LookupJob_(void *context, const iBookmark *bm) {
-    return bookmarkRelevance_LookupJob_(context, bm) > 0;
-}
-
 static iBool matchIdentity_LookupJob_(void *context, const iGmIdentity *identity) {
     return identityRelevance_LookupJob_(context, identity) > 0;
 }
 
+static const iStringSet *candidates_LookupJob_(const iLookupJob *d,
+                                               enum iSearchIndexType type) {
+    /* Only the indexed documents containing all the words need to be matched and scored. */
+    return query_SearchIndex(searchIndex_App(), type, &d->words);
+}
+
 static void searchBookmarks_LookupJob_(iLookupJob *d) {
     /* Note: Called in a background thread. */
     /* TODO: Thread safety! What if a bookmark gets deleted while its being accessed here? */
-    iConstForEach(PtrArray, i, list_Bookmarks(bookmarks_App(), NULL, matchBookmark_LookupJob_, d)) {
-        const iBookmark *bm  = i.ptr;
+    iConstForEach(StringSet, i, candidates_LookupJob_(d, bookmark_SearchIndexType)) {
+        const iBookmark *bm =
+            get_Bookmarks(bookmarks_App(), strtoul(cstr_String(i.value), NULL, 16));
+        if (!bm) {
+            continue;
+        }
+        const float relevance = bookmarkRelevance_LookupJob_(d, bm);
+        if (relevance <= 0) {
+            continue;
+        }
         iLookupResult *  res = new_LookupResult();
         res->type            = bookmark_LookupResultType;
         res->when            = bm->when;
-        res->relevance       = bookmarkRelevance_LookupJob_(d, bm);
+        res->relevance       = relevance;
         res->icon            = bm->icon;
         set_String(&res->label, &bm->title);
         set_String(&res->url, &bm->url);
@@ -235,7 +249,8 @@ static void searchBookmarks_LookupJob_(iLookupJob *d) {
 }
 
 static void searchFeeds_LookupJob_(iLookupJob *d) {
-    iConstForEach(PtrArray, i, listEntries_Feeds()) {
+    iConstForEach(PtrArray, i,
+                  listIndexedEntries_Feeds(candidates_LookupJob_(d, feedEntry_SearchIndexType))) {
         const iFeedEntry *entry = i.ptr;
         const iBookmark *bm = get_Bookmarks(bookmarks_App(), entry->bookmarkId);
         if (!bm) {
@@ -259,7 +274,8 @@ static void searchFeeds_LookupJob_(iLookupJob *d) {
 static void searchVisited_LookupJob_(iLookupJob *d) {
     /* Note: Called in a background thread. */
     /* TODO: Thread safety! Visited URLs may be deleted while being accessed here. */
-    iConstForEach(PtrArray, i, list_Visited(visited_App(), 0)) {
+    iConstForEach(PtrArray, i,
+                  listUrls_Visited(visited_App(), candidates_LookupJob_(d, visited_SearchIndexType))) {
         const iVisitedUrl *vis = i.ptr;
         const float relevance = visitedRelevance_LookupJob_(d, vis);
         if (relevance > 0) {
@@ -277,9 +293,13 @@ static void searchVisited_LookupJob_(iLookupJob *d) {
 static void searchHistory_LookupJob_(iLookupJob *d) {
     /* Note: Called in a background thread. */
     size_t index = 0;
+    const iStringSet *urls = candidates_LookupJob_(d, content_SearchIndexType);
+    if (isEmpty_StringSet(urls)) {
+        return;
+    }
     iForEach(ObjectList, i, d->docs) {
         iConstForEach(StringArray, j,
-                      searchContents_History(history_DocumentWidget(i.object), d->term)) {
+                      searchContents_History(history_DocumentWidget(i.object), d->term, urls)) {
             const char *match = cstr_String(j.value);
             const size_t matchLen = argLabel_Command(match, "len");
             iRangecc text;
@@ -351,6 +371,7 @@ static iThreadResult worker_LookupWidget_(iThread *thread) {
             delete_String(pattern);
         }
         const size_t termLen = length_String(&d->pendingTerm); /* characters */
+        set_String(&job->words, &d->pendingTerm);
         clear_String(&d->pendingTerm);
         job->docs = d->pendingDocs;
         d->pendingDocs = NULL;
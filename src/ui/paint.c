@@ -44,11 +44,26 @@ void init_Paint(iPaint *d) {
     d->alpha     = 255;
 }
 
+void setRenderTarget_Paint(SDL_Renderer *render, SDL_Texture *target) {
+    /* The window's frame buffer acts as the default render target, so its clip rectangle
+       is kept intact when other textures are drawn to in the middle of a frame. */
+    iWindow     *win      = get_Window();
+    SDL_Texture *frameBuf = (win && win->render == render ? win->frameBuffer : NULL);
+    SDL_Texture *current  = SDL_GetRenderTarget(render);
+    if (frameBuf && current == frameBuf && target != frameBuf) {
+        SDL_RenderGetClipRect(render, &win->frameClip);
+    }
+    SDL_SetRenderTarget(render, target);
+    if (frameBuf && target == frameBuf && current != frameBuf) {
+        SDL_RenderSetClipRect(render, SDL_RectEmpty(&win->frameClip) ? NULL : &win->frameClip);
+    }
+}
+
 void beginTarget_Paint(iPaint *d, SDL_Texture *target) {
     SDL_Renderer *rend = renderer_Paint_(d);
     if (!d->setTarget) {
         d->oldTarget = SDL_GetRenderTarget(rend);
-        SDL_SetRenderTarget(rend, target);
+        setRenderTarget_Paint(rend, target);
         d->setTarget = target;
     }
     else {
@@ -58,7 +73,7 @@ void beginTarget_Paint(iPaint *d, SDL_Texture *target) {
 
 void endTarget_Paint(iPaint *d) {
     if (d->setTarget) {
-        SDL_SetRenderTarget(renderer_Paint_(d), d->oldTarget);
+        setRenderTarget_Paint(renderer_Paint_(d), d->oldTarget);
         d->oldTarget = NULL;
         d->setTarget = NULL;
     }
@@ -71,18 +86,26 @@ void setClip_Paint(iPaint *d, iRect rect) {
     }
     iRect targetRect = zero_Rect();
     SDL_Texture *target = SDL_GetRenderTarget(renderer_Paint_(d));
-    if (target) {
+    if (target && target != d->dst->frameBuffer) {
         SDL_QueryTexture(target, NULL, NULL, &targetRect.size.x, &targetRect.size.y);
         rect = intersect_Rect(rect, targetRect);
     }
     else {
         rect = intersect_Rect(rect, rect_Root(get_Root()));
+        if (target) {
+            /* Only the damaged area of the frame buffer is being redrawn. */
+            rect = intersect_Rect(rect, d->dst->drawArea);
+            if (isEmpty_Rect(rect)) {
+                rect = init_Rect(-1, -1, 1, 1); /* nothing visible */
+            }
+        }
     }
     SDL_RenderSetClipRect(renderer_Paint_(d), (const SDL_Rect *) &rect);
 }
 
 void unsetClip_Paint(iPaint *d) {
-    if (numRoots_Window(get_Window()) > 1) {
+    if (numRoots_Window(get_Window()) > 1 ||
+        (d->dst->frameBuffer && SDL_GetRenderTarget(renderer_Paint_(d)) == d->dst->frameBuffer)) {
         setClip_Paint(d, rect_Root(get_Root()));
         return;
     }
@@ -40,6 +40,7 @@ extern iInt2 origin_Paint; /* add this to all drawn positions so buffered graphi
 
 void    init_Paint          (iPaint *);
 
+void    setRenderTarget_Paint   (SDL_Renderer *, SDL_Texture *target);
 void    beginTarget_Paint   (iPaint *, SDL_Texture *target);
 void    endTarget_Paint     (iPaint *);
 
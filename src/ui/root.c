@@ -241,6 +241,21 @@ static iRoot *   activeRoot_     = NULL;
 
 iDefineTypeConstruction(Root)
 
+iDeclareType(WidgetIdNode)
+
+struct Impl_WidgetIdNode {
+    iHashNode node; /* key is the hash of the ID; colliding IDs share a node */
+    iPtrArray widgets;
+};
+
+static uint32_t hashId_Root_(const char *id) {
+    uint32_t hash = 2166136261u; /* FNV-1a */
+    for (const char *ch = id; *ch; ch++) {
+        hash = (hash ^ (uint8_t) *ch) * 16777619u;
+    }
+    return hash;
+}
+
 void init_Root(iRoot *d) {
     iZap(*d);
 }
@@ -249,6 +264,13 @@ void deinit_Root(iRoot *d) {
     iReleasePtr(&d->widget);
     delete_PtrArray(d->onTop);
     delete_PtrSet(d->pendingDestruction);
+    if (d->widgetIds) {
+        iForEach(Hash, i, d->widgetIds) {
+            deinit_PtrArray(&((iWidgetIdNode *) i.value)->widgets);
+            free(i.value);
+        }
+        delete_Hash(d->widgetIds);
+    }
 }
 
 void setCurrent_Root(iRoot *root) {
@@ -310,6 +332,70 @@ iPtrArray *onTop_Root(iRoot *d) {
     return d->onTop;
 }
 
+void registerId_Root(iRoot *d, iWidget *widget) {
+    const char *id = cstr_String(id_Widget(widget));
+    if (!*id) {
+        return;
+    }
+    if (!d->widgetIds) {
+        d->widgetIds = new_Hash();
+    }
+    const uint32_t key  = hashId_Root_(id);
+    iWidgetIdNode *node = (iWidgetIdNode *) value_Hash(d->widgetIds, key);
+    if (!node) {
+        node = iMalloc(WidgetIdNode);
+        node->node.key = key;
+        init_PtrArray(&node->widgets);
+        insert_Hash(d->widgetIds, &node->node);
+    }
+    pushBack_PtrArray(&node->widgets, widget);
+}
+
+void unregisterId_Root(iRoot *d, iWidget *widget) {
+    const char *id = cstr_String(id_Widget(widget));
+    if (!*id || !d->widgetIds) {
+        return;
+    }
+    const uint32_t key  = hashId_Root_(id);
+    iWidgetIdNode *node = (iWidgetIdNode *) value_Hash(d->widgetIds, key);
+    if (node) {
+        removeOne_PtrArray(&node->widgets, widget);
+        if (isEmpty_PtrArray(&node->widgets)) {
+            remove_Hash(d->widgetIds, key);
+            deinit_PtrArray(&node->widgets);
+            free(node);
+        }
+    }
+}
+
+iAnyObject *findRegistered_Root(const iRoot *d, const iWidget *parent, const char *id,
+                                iBool *isAmbiguous) {
+    /* Returns the registered widget with the given ID that is `parent` or one of its
+       descendants. If there are several such widgets, the caller must determine which one
+       comes first in the tree. */
+    *isAmbiguous = iFalse;
+    if (!d->widgetIds) {
+        return NULL;
+    }
+    const iWidgetIdNode *node = (const iWidgetIdNode *) value_Hash(d->widgetIds, hashId_Root_(id));
+    if (!node) {
+        return NULL;
+    }
+    iWidget *found = NULL;
+    iConstForEach(PtrArray, i, &node->widgets) {
+        iWidget *w = i.ptr;
+        if (cmp_String(id_Widget(w), id) || (w != parent && !hasParent_Widget(w, parent))) {
+            continue;
+        }
+        if (found) {
+            *isAmbiguous = iTrue;
+            return NULL;
+        }
+        found = w;
+    }
+    return found;
+}
+
 static iBool handleRootCommands_(iWidget *root, const char *cmd) {
     iUnused(root);
     if (equal_Command(cmd, "menu.open")) {
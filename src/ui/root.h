@@ -2,6 +2,7 @@
 
 #include "widget.h"
 #include "color.h"
+#include <the_Foundation/hash.h>
 #include <the_Foundation/ptrset.h>
 #include <the_Foundation/vec2.h>
 
@@ -12,6 +13,7 @@ struct Impl_Root {
     iWindow *  window;
     iPtrArray *onTop; /* order is important; last one is topmost */
     iPtrSet *  pendingDestruction;
+    iHash *    widgetIds; /* WidgetIdNode: widgets indexed by ID */
     iBool      pendingArrange;
     int        loadAnimTimer;
     iColor     tmPalette[tmMax_ColorId]; /* theme-specific palette */
@@ -29,6 +31,10 @@ iRoot *     get_Root                            (void); /* assert != NULL */
 iAnyObject *findWidget_Root                     (const char *id); /* under current Root */
 
 iPtrArray * onTop_Root                          (iRoot *);
+void        registerId_Root                     (iRoot *, iWidget *widget);
+void        unregisterId_Root                   (iRoot *, iWidget *widget);
+iAnyObject *findRegistered_Root                 (const iRoot *, const iWidget *parent, const char *id,
+                                                 iBool *isAmbiguous);
 void        destroyPending_Root                 (iRoot *);
 
 void        updateMetrics_Root                  (iRoot *);
@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include "defs.h"
 #include "bookmarks.h"
 #include "command.h"
+#include "contentcache.h"
 #include "documentwidget.h"
 #include "feeds.h"
 #include "gmcerts.h"
@@ -1074,6 +1075,7 @@ iBool handleBookmarkEditorCommands_SidebarWidget_(iWidget *editor, const char *c
             if (!folder || !hasParent_Bookmark(folder, id_Bookmark(bm))) {
                 bm->parentId = folder ? id_Bookmark(folder) : 0;
             }
+            reindex_Bookmarks(bookmarks_App(), id_Bookmark(bm));
             postCommand_App("bookmarks.changed");
         }
         setupSheetTransition_Mobile(editor, iFalse);
@@ -1478,10 +1480,11 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             }
             return iTrue;
         }
-        else if (equal_Command(cmd, "feeds.update.finished")) {
+        else if (equal_Command(cmd, "feeds.update.finished") || equal_Command(cmd, "feeds.loaded")) {
             d->numUnreadEntries = argLabel_Command(cmd, "unread");
             checkModeButtonLayout_SidebarWidget_(d);
-            if (d->mode == feeds_SidebarMode) {
+            if (d->mode == feeds_SidebarMode &&
+                (argLabel_Command(cmd, "changed") || equal_Command(cmd, "feeds.loaded"))) {
                 updateItems_SidebarWidget_(d);
             }
         }
@@ -1661,6 +1664,7 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
         else if (isCommand_Widget(w, ev, "history.delete")) {
             if (d->contextItem && !isEmpty_String(&d->contextItem->url)) {
                 removeUrl_Visited(visited_App(), &d->contextItem->url);
+                remove_ContentCache(contentCache_App(), &d->contextItem->url);
                 updateItems_SidebarWidget_(d);
                 scrollOffset_ListWidget(d->list, 0);
             }
@@ -1696,6 +1700,7 @@ static iBool processEvent_SidebarWidget_(iSidebarWidget *d, const SDL_Event *ev)
             }
             else {
                 clear_Visited(visited_App());
+                clear_ContentCache(contentCache_App()); /* page contents are history, too */
                 updateItems_SidebarWidget_(d);
                 scrollOffset_ListWidget(d->list, 0);
             }
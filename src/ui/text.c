@@ -34,8 +34,8 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/array.h>
 #include <the_Foundation/file.h>
 #include <the_Foundation/fileinfo.h>
-#include <the_Foundation/hash.h>
 #include <the_Foundation/math.h>
+#include <the_Foundation/mutex.h>
 #include <the_Foundation/stringlist.h>
 #include <the_Foundation/regexp.h>
 #include <the_Foundation/path.h>
@@ -43,7 +43,9 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #include <the_Foundation/vec2.h>
 
 #include <SDL_surface.h>
+#include <SDL_cpuinfo.h>
 #include <SDL_hints.h>
+#include <SDL_thread.h>
 #include <SDL_version.h>
 #include <stdarg.h>
 
@@ -79,8 +81,9 @@ enum iGlyphFlag {
 };
 
 struct Impl_Glyph {
-    iHashNode node;
+    uint32_t index; /* in the font */
     int flags;
+    int cachePage; /* where the rasterized glyph is */
     iFont *font; /* may come from symbols/emoji */
     iRect rect[2]; /* zero and half pixel offset */
     iInt2 d[2];
@@ -88,8 +91,9 @@ struct Impl_Glyph {
 };
 
 void init_Glyph(iGlyph *d, uint32_t glyphIndex) {
-    d->node.key   = glyphIndex;
+    d->index      = glyphIndex;
     d->flags      = 0;
+    d->cachePage  = 0;
     d->font       = NULL;
     d->rect[0]    = zero_Rect();
     d->rect[1]    = zero_Rect();
@@ -101,7 +105,7 @@ void deinit_Glyph(iGlyph *d) {
 }
 
 static uint32_t index_Glyph_(const iGlyph *d) {
-    return d->node.key;
+    return d->index;
 }
 
 iLocalDef iBool isRasterized_Glyph_(const iGlyph *d, int hoff) {
@@ -125,33 +129,105 @@ static iGlyph *glyph_Font_(iFont *d, iChar ch);
 
 iDeclareType(GlyphTable)
 
+enum iGlyphTablePage {
+    pageBits_GlyphTable  = 8,
+    pageSize_GlyphTable  = 1 << pageBits_GlyphTable,
+    pageMask_GlyphTable  = pageSize_GlyphTable - 1,
+    numRecent_GlyphTable = 8,
+};
+
+iDeclareType(RecentGlyphIndex)
+
+struct Impl_RecentGlyphIndex {
+    iChar    ch; /* zero if unused */
+    uint32_t glyphIndex;
+};
+
 struct Impl_GlyphTable {
-    iHash          glyphs; /* key is glyph index in the font */
-    /* TODO: `glyphs` does not need to be a Hash.
-       We could lazily allocate an array with glyphCount elements instead. */
-    uint32_t       indexTable[128 - 32]; /* quick ASCII lookup */
+    /* Glyphs are found via a two-level table indexed by glyph index. Pages are allocated
+       when a glyph in their range is first needed. */
+    size_t                 numPages;
+    iGlyph ***             pages;
+    uint32_t               indexTable[128 - 32]; /* quick ASCII lookup */
+    iRecentGlyphIndex      recent[numRecent_GlyphTable]; /* most recently used first */
 };
 
 static void clearGlyphs_GlyphTable_(iGlyphTable *d) {
     if (d) {
-        iForEach(Hash, i, &d->glyphs) {
-            delete_Glyph((iGlyph *) i.value);
+        for (size_t i = 0; i < d->numPages; i++) {
+            iGlyph **page = d->pages[i];
+            if (page) {
+                for (size_t j = 0; j < pageSize_GlyphTable; j++) {
+                    if (page[j]) {
+                        delete_Glyph(page[j]);
+                    }
+                }
+                free(page);
+                d->pages[i] = NULL;
+            }
         }
-        clear_Hash(&d->glyphs);
     }
 }
 
-static void init_GlyphTable(iGlyphTable *d) {
-    init_Hash(&d->glyphs);
+static void init_GlyphTable(iGlyphTable *d, size_t numGlyphs) {
+    d->numPages = (iMax(numGlyphs, 1) + pageSize_GlyphTable - 1) / pageSize_GlyphTable;
+    d->pages    = calloc(d->numPages, sizeof(iGlyph **));
     memset(d->indexTable, 0xff, sizeof(d->indexTable));
+    iZap(d->recent);
 }
 
 static void deinit_GlyphTable(iGlyphTable *d) {
     clearGlyphs_GlyphTable_(d);
-    deinit_Hash(&d->glyphs);
+    free(d->pages);
 }
 
-iDefineTypeConstruction(GlyphTable)
+static iGlyph **glyphSlot_GlyphTable_(iGlyphTable *d, uint32_t glyphIndex) {
+    /* Returns NULL if the index is out of range for the font. */
+    const size_t pageIndex = glyphIndex >> pageBits_GlyphTable;
+    if (pageIndex >= d->numPages) {
+        return NULL;
+    }
+    if (!d->pages[pageIndex]) {
+        d->pages[pageIndex] = calloc(pageSize_GlyphTable, sizeof(iGlyph *));
+    }
+    return &d->pages[pageIndex][glyphIndex & pageMask_GlyphTable];
+}
+
+static void removeCachePage_GlyphTable_(iGlyphTable *d, int cachePage) {
+    if (d) {
+        for (size_t i = 0; i < d->numPages; i++) {
+            iGlyph **page = d->pages[i];
+            if (page) {
+                for (size_t j = 0; j < pageSize_GlyphTable; j++) {
+                    if (page[j] && page[j]->cachePage == cachePage) {
+                        delete_Glyph(page[j]);
+                        page[j] = NULL;
+                    }
+                }
+            }
+        }
+    }
+}
+
+static iBool findRecent_GlyphTable_(iGlyphTable *d, iChar ch, uint32_t *glyphIndex_out) {
+    for (size_t i = 0; i < numRecent_GlyphTable; i++) {
+        if (d->recent[i].ch == ch) {
+            const iRecentGlyphIndex found = d->recent[i];
+            memmove(d->recent + 1, d->recent, sizeof(d->recent[0]) * i);
+            d->recent[0] = found;
+            *glyphIndex_out = found.glyphIndex;
+            return iTrue;
+        }
+    }
+    return iFalse;
+}
+
+static void addRecent_GlyphTable_(iGlyphTable *d, iChar ch, uint32_t glyphIndex) {
+    memmove(d->recent + 1, d->recent, sizeof(d->recent[0]) * (numRecent_GlyphTable - 1));
+    d->recent[0] = (iRecentGlyphIndex){ ch, glyphIndex };
+}
+
+iDefineTypeConstructionArgs(GlyphTable, (size_t numGlyphs), numGlyphs)
 
 struct Impl_Font {
     const iFontSpec *fontSpec;
@@ -220,32 +296,142 @@ static void deinit_Font(iFont *d) {
     delete_GlyphTable(d->table);
 }
 
-static uint32_t glyphIndex_Font_(iFont *d, iChar ch) {
-    /* TODO: Add a small cache of ~5 most recently found indices. */
-    const size_t entry = ch - 32;
+static _Thread_local iBool isMeasureOnly_; /* not the render thread: glyphs are not cached */
+
+static iGlyphTable *table_Font_(iFont *d) {
     if (!d->table) {
-        d->table = new_GlyphTable();
+        d->table = new_GlyphTable(d->fontFile->stbInfo.numGlyphs);
+    }
+    return d->table;
+}
+
+static uint32_t glyphIndex_Font_(iFont *d, iChar ch) {
+    if (isMeasureOnly_) {
+        /* Glyph tables are owned by the render thread. */
+        return findGlyphIndex_FontFile(d->fontFile, ch);
     }
-    iGlyphTable *table = d->table;
+    const size_t entry = ch - 32;
+    iGlyphTable *table = table_Font_(d);
     if (entry < iElemCount(table->indexTable)) {
         if (table->indexTable[entry] == ~0u) {
             table->indexTable[entry] = findGlyphIndex_FontFile(d->fontFile, ch);
         }
         return table->indexTable[entry];
     }
-    return findGlyphIndex_FontFile(d->fontFile, ch);
+    uint32_t glyphIndex;
+    if (!findRecent_GlyphTable_(table, ch, &glyphIndex)) {
+        glyphIndex = findGlyphIndex_FontFile(d->fontFile, ch);
+        addRecent_GlyphTable_(table, ch, glyphIndex);
+    }
+    return glyphIndex;
 }
 
 /*----------------------------------------------------------------------------------------------*/
 
 iDeclareType(Text)
+iDeclareType(TextState)
 iDeclareType(CacheRow)
+iDeclareType(GlyphCachePage)
+iDeclareType(GlyphRasterizer)
 
 struct Impl_CacheRow {
     int   height;
     iInt2 pos;
 };
 
+enum { maxCachePages_Text_ = 4 };
+
+/* The glyph cache consists of several textures. When all of them are full, the least
+   recently drawn page is cleared and reused. */
+struct Impl_GlyphCachePage {
+    SDL_Texture *texture;
+    iArray       rows;
+    int          bottom;
+    uint32_t     lastUsed;
+};
+
+#if defined (LAGRANGE_ENABLE_HARFBUZZ)
+iDeclareType(ShapedRun)
+
+enum iShapeCacheLimits {
+    size_ShapeCache     = 1024, /* direct-mapped by key hash */
+    maxInput_ShapeCache = 1024, /* longer runs are shaped every time */
+};
+
+/* Result of shaping one attributed run. Clusters are relative to the start of the run,
+   so the same text can be found regardless of where it appears in a paragraph. */
+struct Impl_ShapedRun {
+    const iFont *        font;
+    uint32_t             hash;
+    iBool                isArabic;
+    unsigned int         inputLen;
+    uint32_t *           input; /* codepoints followed by the clusters */
+    unsigned int         glyphCount;
+    hb_glyph_info_t *    glyphInfo;
+    hb_glyph_position_t *glyphPos;
+};
+
+static void deinit_ShapedRun_(iShapedRun *d) {
+    free(d->input);
+    free(d->glyphInfo);
+    free(d->glyphPos);
+    iZap(*d);
+}
+#endif
+
+/* Text attributes that get modified while measuring or drawing. Each measuring thread
+   has its own copy. */
+struct Impl_TextState {
+    iRegExp *      ansiEscape;
+    int            ansiFlags;
+    int            baseFontId; /* base attributes (for restoring via escapes) */
+    int            baseFgColorId;
+    iBool          missingGlyphs; /* true if a glyph couldn't be found */
+    iSortedArray * glyphCollector; /* records glyphs processed while measuring */
+#if defined (LAGRANGE_ENABLE_HARFBUZZ)
+    hb_buffer_t *  hbBuf; /* reused for all shaping */
+    iShapedRun *   shapeCache; /* allocated when first needed */
+#endif
+};
+
+static void init_TextState_(iTextState *d) {
+    d->ansiEscape    = new_RegExp("[[()][?]?([0-9;AB]*?)([ABCDEFGHJKSTfhilmn])", 0);
+    d->ansiFlags     = allowAll_AnsiFlag;
+    d->baseFontId    = -1;
+    d->baseFgColorId = -1;
+    d->missingGlyphs = iFalse;
+    d->glyphCollector = NULL;
+#if defined (LAGRANGE_ENABLE_HARFBUZZ)
+    d->hbBuf         = NULL;
+    d->shapeCache    = NULL;
+#endif
+}
+
+static void clearShapeCache_TextState_(iTextState *d) {
+#if defined (LAGRANGE_ENABLE_HARFBUZZ)
+    if (d->shapeCache) {
+        for (size_t i = 0; i < size_ShapeCache; i++) {
+            deinit_ShapedRun_(&d->shapeCache[i]);
+        }
+        free(d->shapeCache);
+        d->shapeCache = NULL;
+    }
+#else
+    iUnused(d);
+#endif
+}
+
+static void deinit_TextState_(iTextState *d) {
+    clearShapeCache_TextState_(d);
+#if defined (LAGRANGE_ENABLE_HARFBUZZ)
+    if (d->hbBuf) {
+        hb_buffer_destroy(d->hbBuf);
+        d->hbBuf = NULL;
+    }
+#endif
+    iReleasePtr(&d->ansiEscape);
+}
+
 struct Impl_Text {
 //    enum iTextFont contentFont;
 //    enum iTextFont headingFont;
@@ -253,23 +439,162 @@ struct Impl_Text {
     iArray         fonts; /* fonts currently selected for use (incl. all styles/sizes) */
     int            overrideFontId; /* always checked for glyphs first, regardless of which font is used */
     SDL_Renderer * render;
-    SDL_Texture *  cache;
-    iInt2          cacheSize;
+    iGlyphCachePage cachePages[maxCachePages_Text_];
+    int            numCachePages;
+    int            cachePage; /* where new glyphs are placed */
+    iInt2          cacheSize; /* of each page */
+    size_t         cachePageCapacity; /* number of content-sized glyphs that fit on a page */
     int            cacheRowAllocStep;
-    int            cacheBottom;
-    iArray         cacheRows;
+    uint32_t       cacheUseCount;
+    uint32_t       cacheEvictions;
+    iColor         cacheColorMod; /* current modulation of all pages, applied to new ones too */
+    uint8_t        cacheAlphaMod;
+    SDL_BlendMode  cacheBlendMode;
     SDL_Palette *  grayscale;
     SDL_Palette *  blackAndWhite; /* unsmoothed glyph palette */
-    iRegExp *      ansiEscape;
-    int            ansiFlags;
-    int            baseFontId; /* base attributes (for restoring via escapes) */
-    int            baseFgColorId;
-    iBool          missingGlyphs; /* true if a glyph couldn't be found */
+    iTextState     state; /* used on the render thread */
+    SDL_threadID   renderThread;
+    iMutex *       fontsMutex; /* held by other threads during each measurement */
+    uint32_t       fontsGeneration; /* incremented when fonts are reset */
+    iGlyphRasterizer *rasterizer; /* created when first needed */
 };
 
 iDefineTypeConstructionArgs(Text, (SDL_Renderer *render), render)
 
-static iText  *activeText_;
+static _Thread_local iText     *activeText_;
+static _Thread_local iTextState measureState_; /* for threads other than the render thread */
+static _Thread_local uint32_t   measureFontsGeneration_; /* fonts that `measureState_` refers to */
+
+iLocalDef iTextState *state_Text_(void) {
+    return isMeasureOnly_ ? &measureState_ : &activeText_->state;
+}
+
+/*----------------------------------------------------------------------------------------------*/
+
+iDeclareType(RasterJob)
+
+/* One glyph bitmap to rasterize. Only stb_truetype is called in the worker threads;
+   SDL surfaces and textures are handled by the render thread. */
+struct Impl_RasterJob {
+    iGlyph * glyph;
+    int      hoff;
+    uint8_t *bmp;
+    int      width;
+    int      height;
+};
+
+enum iGlyphRasterizerLimits {
+    maxThreads_GlyphRasterizer      = 4,
+    minParallelJobs_GlyphRasterizer = 16, /* fewer are rasterized on the calling thread */
+};
+
+struct Impl_GlyphRasterizer {
+    iMutex *    mtx;
+    iCondition  jobsAvailable;
+    iCondition  jobsDone;
+    iArray *    jobs; /* owned by the render thread, which waits until all are done */
+    size_t      nextJob;
+    size_t      numPending;
+    iBool       quit;
+    size_t      numThreads;
+    iThread *   threads[maxThreads_GlyphRasterizer];
+};
+
+static void rasterize_RasterJob_(iRasterJob *d) {
+    const iFont *font = d->glyph->font;
+    d->bmp = rasterizeGlyph_FontFile(font->fontFile, font->xScale, font->yScale, d->hoff * 0.5f,
+                                     index_Glyph_(d->glyph), &d->width, &d->height);
+}
+
+static iBool processNextJob_GlyphRasterizer_(iGlyphRasterizer *d) {
+    /* Mutex must be locked. */
+    if (!d->jobs || d->nextJob >= size_Array(d->jobs)) {
+        return iFalse;
+    }
+    iRasterJob *job = at_Array(d->jobs, d->nextJob++);
+    unlock_Mutex(d->mtx);
+    rasterize_RasterJob_(job);
+    lock_Mutex(d->mtx);
+    if (--d->numPending == 0) {
+        signal_Condition(&d->jobsDone);
+    }
+    return iTrue;
+}
+
+static iThreadResult worker_GlyphRasterizer_(iThread *thread) {
+    iGlyphRasterizer *d = userData_Thread(thread);
+    lock_Mutex(d->mtx);
+    while (!d->quit) {
+        if (!processNextJob_GlyphRasterizer_(d)) {
+            wait_Condition(&d->jobsAvailable, d->mtx);
+        }
+    }
+    unlock_Mutex(d->mtx);
+    return 0;
+}
+
+static iGlyphRasterizer *new_GlyphRasterizer_(void) {
+    iGlyphRasterizer *d = iMalloc(GlyphRasterizer);
+    d->mtx = new_Mutex();
+    init_Condition(&d->jobsAvailable);
+    init_Condition(&d->jobsDone);
+    d->jobs       = NULL;
+    d->nextJob    = 0;
+    d->numPending = 0;
+    d->quit       = iFalse;
+    /* The render thread also participates. */
+    d->numThreads = iClamp(SDL_GetCPUCount() - 1, 1, maxThreads_GlyphRasterizer);
+    for (size_t i = 0; i < d->numThreads; i++) {
+        d->threads[i] = new_Thread(worker_GlyphRasterizer_);
+        setUserData_Thread(d->threads[i], d);
+        start_Thread(d->threads[i]);
+    }
+    return d;
+}
+
+static void delete_GlyphRasterizer_(iGlyphRasterizer *d) {
+    if (d) {
+        iGuardMutex(d->mtx, {
+            d->quit = iTrue;
+            broadcast_Condition(&d->jobsAvailable);
+        });
+        for (size_t i = 0; i < d->numThreads; i++) {
+            join_Thread(d->threads[i]);
+            iRelease(d->threads[i]);
+        }
+        deinit_Condition(&d->jobsDone);
+        deinit_Condition(&d->jobsAvailable);
+        delete_Mutex(d->mtx);
+        free(d);
+    }
+}
+
+static void rasterize_GlyphRasterizer_(iGlyphRasterizer *d, iArray *jobs) {
+    lock_Mutex(d->mtx);
+    d->jobs       = jobs;
+    d->nextJob    = 0;
+    d->numPending = size_Array(jobs);
+    broadcast_Condition(&d->jobsAvailable);
+    while (processNextJob_GlyphRasterizer_(d)) {}
+    while (d->numPending > 0) {
+        wait_Condition(&d->jobsDone, d->mtx);
+    }
+    d->jobs = NULL;
+    unlock_Mutex(d->mtx);
+}
+
+static void rasterizeJobs_Text_(iText *d, iArray *jobs) {
+    if (size_Array(jobs) < minParallelJobs_GlyphRasterizer) {
+        iForEach(Array, i, jobs) {
+            rasterize_RasterJob_(i.value);
+        }
+        return;
+    }
+    if (!d->rasterizer) {
+        d->rasterizer = new_GlyphRasterizer_();
+    }
+    rasterize_GlyphRasterizer_(d->rasterizer, jobs);
+}
 
 static void setupFontVariants_Text_(iText *d, const iFontSpec *spec, int baseId) {
 #if defined (iPlatformMobile)
@@ -355,8 +680,41 @@ static int maxGlyphHeight_Text_(const iText *d) {
     return 4 * d->contentFontSize * fontSize_UI;
 }
 
+static void resetRows_GlyphCachePage_(iGlyphCachePage *d, const iText *text) {
+    const int textSize = text->contentFontSize * fontSize_UI;
+    clear_Array(&d->rows);
+    /* Allocate initial (empty) rows. These will be assigned actual locations in the cache
+       once at least one glyph is stored. */
+    for (int h = text->cacheRowAllocStep;
+         h <= 5 * textSize + text->cacheRowAllocStep;
+         h += text->cacheRowAllocStep) {
+        pushBack_Array(&d->rows, &(iCacheRow){ .height = 0 });
+    }
+    d->bottom = 0;
+}
+
+static void init_GlyphCachePage_(iGlyphCachePage *d, const iText *text) {
+    init_Array(&d->rows, sizeof(iCacheRow));
+    resetRows_GlyphCachePage_(d, text);
+    d->lastUsed = text->cacheUseCount;
+    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
+    d->texture = SDL_CreateTexture(text->render,
+                                   SDL_PIXELFORMAT_RGBA4444,
+                                   SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
+                                   text->cacheSize.x,
+                                   text->cacheSize.y);
+    SDL_SetTextureBlendMode(d->texture, text->cacheBlendMode);
+    SDL_SetTextureColorMod(
+        d->texture, text->cacheColorMod.r, text->cacheColorMod.g, text->cacheColorMod.b);
+    SDL_SetTextureAlphaMod(d->texture, text->cacheAlphaMod);
+}
+
+static void deinit_GlyphCachePage_(iGlyphCachePage *d) {
+    deinit_Array(&d->rows);
+    SDL_DestroyTexture(d->texture);
+}
+
 static void initCache_Text_(iText *d) {
-    init_Array(&d->cacheRows, sizeof(iCacheRow));
     const int textSize = d->contentFontSize * fontSize_UI;
     iAssert(textSize > 0);
     const iInt2 cacheDims = init_I2(16, 40);
@@ -367,27 +725,65 @@ static void initCache_Text_(iText *d) {
         d->cacheSize.y = renderInfo.max_texture_height;
         d->cacheSize.x = renderInfo.max_texture_width;
     }
+    d->cachePageCapacity = (size_t) (d->cacheSize.x / iMax(textSize, fontSize_UI)) *
+                           (size_t) (d->cacheSize.y / iMax(textSize, fontSize_UI));
     d->cacheRowAllocStep = iMax(2, textSize / 6);
-    /* Allocate initial (empty) rows. These will be assigned actual locations in the cache
-       once at least one glyph is stored. */
-    for (int h = d->cacheRowAllocStep;
-         h <= 5 * textSize + d->cacheRowAllocStep;
-         h += d->cacheRowAllocStep) {
-        pushBack_Array(&d->cacheRows, &(iCacheRow){ .height = 0 });
-    }
-    d->cacheBottom = 0;
-    SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "0");
-    d->cache = SDL_CreateTexture(d->render,
-                                 SDL_PIXELFORMAT_RGBA4444,
-                                 SDL_TEXTUREACCESS_STATIC | SDL_TEXTUREACCESS_TARGET,
-                                 d->cacheSize.x,
-                                 d->cacheSize.y);
-    SDL_SetTextureBlendMode(d->cache, SDL_BLENDMODE_BLEND);
+    d->cacheUseCount     = 0;
+    d->cacheEvictions    = 0;
+    d->cacheColorMod     = (iColor){ 255, 255, 255, 255 };
+    d->cacheAlphaMod     = 255;
+    d->cacheBlendMode    = SDL_BLENDMODE_BLEND;
+    /* More pages are created as needed. */
+    init_GlyphCachePage_(&d->cachePages[0], d);
+    d->numCachePages = 1;
+    d->cachePage     = 0;
 }
 
 static void deinitCache_Text_(iText *d) {
-    deinit_Array(&d->cacheRows);
-    SDL_DestroyTexture(d->cache);
+    for (int i = 0; i < d->numCachePages; i++) {
+        deinit_GlyphCachePage_(&d->cachePages[i]);
+    }
+    d->numCachePages = 0;
+}
+
+static void nextCachePage_Text_(iText *d) {
+    /* The current page is full. Continue on a new page or reuse the one that was drawn from
+       least recently. Glyphs on the other pages remain valid. */
+    if (d->numCachePages < maxCachePages_Text_) {
+        init_GlyphCachePage_(&d->cachePages[d->numCachePages], d);
+        d->cachePage = d->numCachePages++;
+        return;
+    }
+    int lru = -1;
+    for (int i = 0; i < d->numCachePages; i++) {
+        if (i != d->cachePage &&
+            (lru < 0 || d->cachePages[i].lastUsed < d->cachePages[lru].lastUsed)) {
+            lru = i;
+        }
+    }
+    iForEach(Array, i, &d->fonts) {
+        removeCachePage_GlyphTable_(((iFont *) i.value)->table, lru);
+    }
+    resetRows_GlyphCachePage_(&d->cachePages[lru], d);
+    d->cachePage = lru;
+    d->cacheEvictions++;
+#if !defined (NDEBUG)
+    printf("[Text] glyph cache page %d evicted\n", lru); fflush(stdout);
+#endif
+}
+
+static void setCacheColorMod_Text_(iText *d, iColor clr) {
+    d->cacheColorMod = clr;
+    for (int i = 0; i < d->numCachePages; i++) {
+        SDL_SetTextureColorMod(d->cachePages[i].texture, clr.r, clr.g, clr.b);
+    }
+}
+
+static void setCacheBlendMode_Text_(iText *d, SDL_BlendMode mode) {
+    d->cacheBlendMode = mode;
+    for (int i = 0; i < d->numCachePages; i++) {
+        SDL_SetTextureBlendMode(d->cachePages[i].texture, mode);
+    }
 }
 
 void init_Text(iText *d, SDL_Renderer *render) {
@@ -395,10 +791,12 @@ void init_Text(iText *d, SDL_Renderer *render) {
     activeText_ = d;
     init_Array(&d->fonts, sizeof(iFont));
     d->contentFontSize = contentScale_Text_;
-    d->ansiEscape      = new_RegExp("[[()][?]?([0-9;AB]*?)([ABCDEFGHJKSTfhilmn])", 0);
-    d->baseFontId      = -1;
-    d->baseFgColorId   = -1;
+    init_TextState_(&d->state);
     d->render          = render;
+    d->renderThread    = SDL_ThreadID();
+    d->fontsMutex      = new_Mutex();
+    d->fontsGeneration = 0;
+    d->rasterizer      = NULL;
     /* A grayscale palette for rasterized glyphs. */ {
         SDL_Color colors[256];
         for (int i = 0; i < 256; ++i) {
@@ -423,29 +821,70 @@ void init_Text(iText *d, SDL_Renderer *render) {
 void deinit_Text(iText *d) {
     SDL_FreePalette(d->blackAndWhite);
     SDL_FreePalette(d->grayscale);
+    lock_Mutex(d->fontsMutex);
     deinitFonts_Text_(d);
+    unlock_Mutex(d->fontsMutex);
     deinitCache_Text_(d);
+    delete_GlyphRasterizer_(d->rasterizer);
     d->render = NULL;
-    iRelease(d->ansiEscape);
+    deinit_TextState_(&d->state);
     deinit_Array(&d->fonts);
+    delete_Mutex(d->fontsMutex);
 }
 
 void setCurrent_Text(iText *d) {
+    if (isMeasureOnly_) {
+        deinit_TextState_(&measureState_);
+        isMeasureOnly_ = iFalse;
+    }
     activeText_ = d;
+    if (d && SDL_ThreadID() != d->renderThread) {
+        /* Other threads can only measure text. The fonts are locked separately for each
+           measurement (see lockFonts_Text_), so the render thread can reset them while
+           a long layout is in progress. */
+        init_TextState_(&measureState_);
+        iGuardMutex(d->fontsMutex, measureFontsGeneration_ = d->fontsGeneration);
+        isMeasureOnly_ = iTrue;
+    }
+}
+
+static void lockFonts_Text_(void) {
+    if (isMeasureOnly_) {
+        iText *d = activeText_;
+        lock_Mutex(d->fontsMutex);
+        if (measureFontsGeneration_ != d->fontsGeneration) {
+            /* Shaped runs refer to fonts that no longer exist. */
+            clearShapeCache_TextState_(&measureState_);
+            measureFontsGeneration_ = d->fontsGeneration;
+        }
+    }
+}
+
+static void unlockFonts_Text_(void) {
+    if (isMeasureOnly_) {
+        unlock_Mutex(activeText_->fontsMutex);
+    }
+}
+
+iText *current_Text(void) {
+    return activeText_;
 }
 
 void setOpacity_Text(float opacity) {
-    SDL_SetTextureAlphaMod(activeText_->cache, iClamp(opacity, 0.0f, 1.0f) * 255 + 0.5f);
+    activeText_->cacheAlphaMod = iClamp(opacity, 0.0f, 1.0f) * 255 + 0.5f;
+    for (int i = 0; i < activeText_->numCachePages; i++) {
+        SDL_SetTextureAlphaMod(activeText_->cachePages[i].texture, activeText_->cacheAlphaMod);
+    }
 }
 
 void setBaseAttributes_Text(int fontId, int fgColorId) {
-    iText *d = activeText_;
+    iTextState *d = state_Text_();
     d->baseFontId    = fontId;
     d->baseFgColorId = fgColorId;
 }
 
 void setAnsiFlags_Text(int ansiFlags) {
-    activeText_->ansiFlags = ansiFlags;
+    state_Text_()->ansiFlags = ansiFlags;
 }
 
 void setDocumentFontSize_Text(iText *d, float fontSizeFactor) {
@@ -457,29 +896,25 @@ void setDocumentFontSize_Text(iText *d, float fontSizeFactor) {
     }
 }
 
-static void resetCache_Text_(iText *d) {
-    deinitCache_Text_(d);
-    iForEach(Array, i, &d->fonts) {
-        clearGlyphs_GlyphTable_(((iFont *) i.value)->table);
-    }
-    initCache_Text_(d);
-}
-
 void resetFonts_Text(iText *d) {
+    lock_Mutex(d->fontsMutex);
+    /* Shaping results refer to the fonts. Measuring threads clear their own caches when
+       they see the generation change. */
+    d->fontsGeneration++;
+    clearShapeCache_TextState_(&d->state);
     deinitFonts_Text_(d);
     deinitCache_Text_(d);
     initCache_Text_(d);
     initFonts_Text_(d);
+    unlock_Mutex(d->fontsMutex);
 }
 
 static SDL_Palette *glyphPalette_(void) {
     return prefs_App()->fontSmoothing ? activeText_->grayscale : activeText_->blackAndWhite;
 }
 
-static SDL_Surface *rasterizeGlyph_Font_(const iFont *d, uint32_t glyphIndex, float xShift) {
-    int w, h;
-    uint8_t *bmp = rasterizeGlyph_FontFile(d->fontFile, d->xScale, d->yScale, xShift, glyphIndex,
-                                           &w, &h);
+static SDL_Surface *glyphSurface_(uint8_t *bmp, int w, int h) {
+    /* Takes ownership of `bmp`. */
     SDL_Surface *surface8 =
         SDL_CreateRGBSurfaceWithFormatFrom(bmp, w, h, 8, w, SDL_PIXELFORMAT_INDEX8);
     SDL_SetSurfaceBlendMode(surface8, SDL_BLENDMODE_NONE);
@@ -497,40 +932,37 @@ static SDL_Surface *rasterizeGlyph_Font_(const iFont *d, uint32_t glyphIndex, fl
 }
 
 iLocalDef iCacheRow *cacheRow_Text_(iText *d, int height) {
-    return at_Array(&d->cacheRows, (height - 1) / d->cacheRowAllocStep);
+    return at_Array(&d->cachePages[d->cachePage].rows, (height - 1) / d->cacheRowAllocStep);
 }
 
 static iInt2 assignCachePos_Text_(iText *d, iInt2 size) {
+    iGlyphCachePage *page = &d->cachePages[d->cachePage];
     iCacheRow *cur = cacheRow_Text_(d, size.y);
     if (cur->height == 0) {
         /* Begin a new row height. */
         cur->height = (1 + (size.y - 1) / d->cacheRowAllocStep) * d->cacheRowAllocStep;
-        cur->pos.y = d->cacheBottom;
-        d->cacheBottom = cur->pos.y + cur->height;
+        cur->pos.y = page->bottom;
+        page->bottom = cur->pos.y + cur->height;
     }
     iAssert(cur->height >= size.y);
-    /* TODO: Automatically enlarge the cache if running out of space?
-       Maybe make it paged, but beware of texture swapping too often inside a text string. */
     if (cur->pos.x + size.x > d->cacheSize.x) {
         /* Does not fit on this row, advance to a new location in the cache. */
-        cur->pos.y = d->cacheBottom;
+        cur->pos.y = page->bottom;
         cur->pos.x = 0;
-        d->cacheBottom += cur->height;
-        iAssert(d->cacheBottom <= d->cacheSize.y);
+        page->bottom += cur->height;
+        iAssert(page->bottom <= d->cacheSize.y);
     }
     const iInt2 assigned = cur->pos;
     cur->pos.x += size.x;
     return assigned;
 }
 
-static void allocate_Font_(iFont *d, iGlyph *glyph, int hoff) {
+static void measure_Font_(const iFont *d, iGlyph *glyph, int hoff) {
     iRect *glRect = &glyph->rect[hoff];
     int    x0, y0, x1, y1;
     measureGlyph_FontFile(d->fontFile, index_Glyph_(glyph), d->xScale, d->yScale, hoff * 0.5f,
                           &x0, &y0, &x1, &y1);
-    glRect->size = init_I2(x1 - x0, y1 - y0);
-    /* Determine placement in the glyph cache texture, advancing in rows. */
-    glRect->pos    = assignCachePos_Text_(activeText_, glRect->size);
+    glRect->size   = init_I2(x1 - x0, y1 - y0);
     glyph->d[hoff] = init_I2(x0, y0);
     glyph->d[hoff].y += d->vertOffset;
     if (hoff == 0) { /* hoff==1 uses same metrics as `glyph` */
@@ -540,6 +972,12 @@ static void allocate_Font_(iFont *d, iGlyph *glyph, int hoff) {
     }
 }
 
+static void allocate_Font_(iFont *d, iGlyph *glyph, int hoff) {
+    measure_Font_(d, glyph, hoff);
+    /* Determine placement in the glyph cache texture, advancing in rows. */
+    glyph->rect[hoff].pos = assignCachePos_Text_(activeText_, glyph->rect[hoff].size);
+}
+
 iLocalDef iFont *characterFont_Font_(iFont *d, iChar ch, uint32_t *glyphIndex) {
     if (isVariationSelector_Char(ch)) {
         return d;
@@ -580,36 +1018,49 @@ iLocalDef iFont *characterFont_Font_(iFont *d, iChar ch, uint32_t *glyphIndex) {
         }
     }
     if (!*glyphIndex) {
-        activeText_->missingGlyphs = iTrue;
+        state_Text_()->missingGlyphs = iTrue;
         fprintf(stderr, "failed to find %08x (%lc)\n", ch, (int)ch); fflush(stderr);
     }
     return d;
 }
 
+static iGlyph *measuredGlyph_Font_(iFont *d, uint32_t glyphIndex) {
+    /* Metrics-only glyphs are not stored anywhere. A few of them remain valid at a time
+       so callers can compare adjacent glyphs. */
+    static _Thread_local iGlyph measured[4];
+    static _Thread_local unsigned next;
+    iGlyph *glyph = &measured[next++ % iElemCount(measured)];
+    init_Glyph(glyph, glyphIndex);
+    glyph->font = d;
+    measure_Font_(d, glyph, 0);
+    measure_Font_(d, glyph, 1);
+    return glyph;
+}
+
 static iGlyph *glyphByIndex_Font_(iFont *d, uint32_t glyphIndex) {
-    if (!d->table) {
-        d->table = new_GlyphTable();
-    }   
-    iGlyph* glyph = NULL;
-    void *  node = value_Hash(&d->table->glyphs, glyphIndex);
-    if (node) {
-        glyph = node;
-    }
-    else {
-        /* If the cache is running out of space, clear it and we'll recache what's needed currently. */
-        if (activeText_->cacheBottom > activeText_->cacheSize.y - maxGlyphHeight_Text_(activeText_)) {
-#if !defined (NDEBUG)
-            printf("[Text] glyph cache is full, clearing!\n"); fflush(stdout);
-#endif
-            resetCache_Text_(activeText_);
+    if (isMeasureOnly_) {
+        return measuredGlyph_Font_(d, glyphIndex);
+    }
+    iGlyph **slot = glyphSlot_GlyphTable_(table_Font_(d), glyphIndex);
+    if (!slot) {
+        glyphIndex = 0; /* .notdef */
+        slot       = glyphSlot_GlyphTable_(d->table, glyphIndex);
+    }
+    iGlyph *glyph = *slot;
+    if (!glyph) {
+        /* If the cache page is running out of space, continue on another page. */
+        if (activeText_->cachePages[activeText_->cachePage].bottom >
+            activeText_->cacheSize.y - maxGlyphHeight_Text_(activeText_)) {
+            nextCachePage_Text_(activeText_);
         }
-        glyph       = new_Glyph(glyphIndex);
-        glyph->font = d;
+        glyph            = new_Glyph(glyphIndex);
+        glyph->font      = d;
+        glyph->cachePage = activeText_->cachePage;
         /* New glyphs are always allocated at least. This reserves a position in the cache
            and updates the glyph metrics. */
         allocate_Font_(d, glyph, 0);
         allocate_Font_(d, glyph, 1);
-        insert_Hash(&d->table->glyphs, &glyph->node);
+        *glyphSlot_GlyphTable_(d->table, glyphIndex) = glyph; /* a page may have been evicted */
     }
     return glyph;
 }
@@ -859,9 +1310,9 @@ static void prepare_AttributedText_(iAttributedText *d, int overrideBaseDir, iCh
             /* Do a regexp match in the source text. */
             iRegExpMatch m;
             init_RegExpMatch(&m);
-            if (match_RegExp(activeText_->ansiEscape, srcPos, d->source.end - srcPos, &m)) {
+            if (match_RegExp(state_Text_()->ansiEscape, srcPos, d->source.end - srcPos, &m)) {
                 finishRun_AttributedText_(d, &run, pos - 1);
-                const int ansi = activeText_->ansiFlags;
+                const int ansi = state_Text_()->ansiFlags;
                 if (ansi && capturedRange_RegExpMatch(&m, 2).start[0] ==
                                 'm' /* Select Graphic Rendition */) {
                     const iRangecc sequence = capturedRange_RegExpMatch(&m, 1);
@@ -1013,128 +1464,127 @@ void deinit_AttributedText(iAttributedText *d) {
 
 /*----------------------------------------------------------------------------------------------*/
 
-iDeclareType(RasterGlyph)
+static size_t maxCollectedGlyphs_Text_(void) {
+    /* Prewarming is limited to one glyph cache page, so the other pages can keep the glyphs
+       that are currently being drawn. */
+    return activeText_->cachePageCapacity;
+}
 
-struct Impl_RasterGlyph {
-    iGlyph *glyph;
-    int     hoff;
-    iRect   rect;
-};
+static void collectGlyph_Text_(const iFont *font, uint32_t glyphIndex) {
+    const uint64_t key = ((uint64_t) fontId_Text_(font) << 32) | glyphIndex;
+    iSortedArray *glyphs = state_Text_()->glyphCollector;
+    size_t pos;
+    /* Text is measured from top to bottom, so the collected glyphs are the ones needed first. */
+    if (size_SortedArray(glyphs) < maxCollectedGlyphs_Text_() &&
+        !locate_SortedArray(glyphs, &key, &pos)) {
+        insert_SortedArray(glyphs, &key);
+    }
+}
+
+static int cmpGlyphIndex_(const void *a, const void *b) {
+    const uint32_t x = *(const uint32_t *) a, y = *(const uint32_t *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
 
 static void cacheGlyphs_Font_(iFont *d, const iArray *glyphIndices) {
-    /* TODO: Make this an object so it can be used sequentially without reallocating buffers. */
-    SDL_Surface *buf     = NULL;
-    const iInt2  bufSize = init_I2(iMin(512, d->height * iMin(2 * size_Array(glyphIndices), 20)),
-                                   d->height * 4 / 3);
-    int          bufX    = 0;
-    iArray *     rasters = NULL;
-    SDL_Texture *oldTarget = NULL;
-    iBool        isTargetChanged = iFalse;
+    iAssert(!isMeasureOnly_);
     iAssert(isExposed_Window(get_Window()));
-    /* We'll flush the buffered rasters periodically until everything is cached. */
-    size_t index = 0;
-    while (index < size_Array(glyphIndices)) {
-        for (; index < size_Array(glyphIndices); index++) {
-            const uint32_t glyphIndex = constValue_Array(glyphIndices, index, uint32_t);
-            const int lastCacheBottom = activeText_->cacheBottom;
-            iGlyph *glyph = glyphByIndex_Font_(d, glyphIndex);
-            if (activeText_->cacheBottom < lastCacheBottom) {
-                /* The cache was reset due to running out of space. We need to restart from
-                   the beginning! */
-                bufX = 0;
-                if (rasters) {
-                    clear_Array(rasters);
-                }
-                index = 0;
-                break;
-            }
-            if (!isFullyRasterized_Glyph_(glyph)) {
-                /* Need to cache this. */
-                if (buf == NULL) {
-                    rasters = new_Array(sizeof(iRasterGlyph));
-                    buf     = SDL_CreateRGBSurfaceWithFormat(
-                                0, bufSize.x, bufSize.y,
-                                LAGRANGE_RASTER_DEPTH,
-                                LAGRANGE_RASTER_FORMAT);
-                    SDL_SetSurfaceBlendMode(buf, SDL_BLENDMODE_NONE);
-                    SDL_SetSurfacePalette(buf, glyphPalette_());
-                }
-                SDL_Surface *surfaces[2] = {
-                    !isRasterized_Glyph_(glyph, 0) ?
-                            rasterizeGlyph_Font_(glyph->font, index_Glyph_(glyph), 0) : NULL,
-                    !isRasterized_Glyph_(glyph, 1) ?
-                            rasterizeGlyph_Font_(glyph->font, index_Glyph_(glyph), 0.5f) : NULL
-                };
-                iBool outOfSpace = iFalse;
-                iForIndices(i, surfaces) {
-                    if (surfaces[i]) {
-                        const int w = surfaces[i]->w;
-                        const int h = surfaces[i]->h;
-                        if (bufX + w <= bufSize.x) {
-                            SDL_BlitSurface(surfaces[i],
-                                            NULL,
-                                            buf,
-                                            &(SDL_Rect){ bufX, 0, w, h });
-                            pushBack_Array(rasters,
-                                           &(iRasterGlyph){ glyph, i, init_Rect(bufX, 0, w, h) });
-                            bufX += w;
-                        }
-                        else {
-                            outOfSpace = iTrue;
-                            break;
-                        }
-                    }
-                }
-                iForIndices(i, surfaces) { /* cleanup */
-                    if (surfaces[i]) {
-                        if (surfaces[i]->flags & SDL_PREALLOC) {
-                            free(surfaces[i]->pixels);
-                        }
-                        SDL_FreeSurface(surfaces[i]);
-                    }
-                }
-                if (outOfSpace) {
-                    /* Redo this glyph. `index` does not get incremented. */
-                    break;
-                }
+    /* Each glyph is rasterized only once even if it appears multiple times. */
+    iArray indices;
+    init_Array(&indices, sizeof(uint32_t));
+    pushBackN_Array(&indices, constData_Array(glyphIndices), size_Array(glyphIndices));
+    sort_Array(&indices, cmpGlyphIndex_);
+    /* Find the glyphs that need rasterizing. This also assigns their cache positions. */
+    iArray jobs;
+    init_Array(&jobs, sizeof(iRasterJob));
+    uint32_t prevIndex = 0;
+    for (size_t index = 0; index < size_Array(&indices); ) {
+        const uint32_t glyphIndex = constValue_Array(&indices, index++, uint32_t);
+        if (index > 1 && glyphIndex == prevIndex) {
+            continue;
+        }
+        prevIndex = glyphIndex;
+        const uint32_t lastEvictions = activeText_->cacheEvictions;
+        iGlyph *glyph = glyphByIndex_Font_(d, glyphIndex);
+        if (activeText_->cacheEvictions != lastEvictions) {
+            /* A cache page was evicted, possibly with some of the pending glyphs.
+               We need to restart from the beginning! */
+            clear_Array(&jobs);
+            index = 0;
+            continue;
+        }
+        for (int hoff = 0; hoff < 2; hoff++) {
+            if (!isRasterized_Glyph_(glyph, hoff)) {
+                pushBack_Array(&jobs, &(iRasterJob){ .glyph = glyph, .hoff = hoff });
             }
         }
-        /* Finished or the buffer is full, copy the glyphs to the cache texture. */
-        if (!isEmpty_Array(rasters)) {
-            SDL_Texture *bufTex = SDL_CreateTextureFromSurface(activeText_->render, buf);
-            SDL_SetTextureBlendMode(bufTex, SDL_BLENDMODE_NONE);
-            if (!isTargetChanged) {
-                isTargetChanged = iTrue;
-                oldTarget = SDL_GetRenderTarget(activeText_->render);
-                SDL_SetRenderTarget(activeText_->render, activeText_->cache);
+    }
+    deinit_Array(&indices);
+    if (isEmpty_Array(&jobs)) {
+        deinit_Array(&jobs);
+        return;
+    }
+    /* The bitmaps can be rasterized in parallel. */
+    rasterizeJobs_Text_(activeText_, &jobs);
+    /* Copy the bitmaps to the cache texture via a staging buffer, so each page gets
+       batches of glyphs in a single texture upload. */
+    iInt2 bufSize = init_I2(iMin(512, d->height * iMin(size_Array(&jobs), 20)),
+                            d->height * 4 / 3);
+    iConstForEach(Array, j, &jobs) {
+        /* Unusually large glyphs must fit as well. */
+        const iRasterJob *job = j.value;
+        bufSize = max_I2(bufSize, init_I2(job->width, job->height));
+    }
+    SDL_Surface *buf = SDL_CreateRGBSurfaceWithFormat(0, bufSize.x, bufSize.y,
+                                                          LAGRANGE_RASTER_DEPTH,
+                                                          LAGRANGE_RASTER_FORMAT);
+    SDL_Texture *oldTarget = SDL_GetRenderTarget(activeText_->render);
+    SDL_SetSurfaceBlendMode(buf, SDL_BLENDMODE_NONE);
+    SDL_SetSurfacePalette(buf, glyphPalette_());
+    size_t first = 0;
+    while (first < size_Array(&jobs)) {
+        int    bufX = 0;
+        size_t end  = first;
+        for (; end < size_Array(&jobs); end++) {
+            iRasterJob *job = at_Array(&jobs, end);
+            if (bufX > 0 && bufX + job->width > bufSize.x) {
+                break; /* buffer is full */
             }
-//            printf("copying %zu rasters from %p\n", size_Array(rasters), bufTex); fflush(stdout);
-            iConstForEach(Array, i, rasters) {
-                const iRasterGlyph *rg = i.value;
-//                iAssert(isEqual_I2(rg->rect.size, rg->glyph->rect[rg->hoff].size));
-                const iRect *glRect = &rg->glyph->rect[rg->hoff];
-                SDL_RenderCopy(activeText_->render,
-                               bufTex,
-                               (const SDL_Rect *) &rg->rect,
-                               (const SDL_Rect *) glRect);
-                setRasterized_Glyph_(rg->glyph, rg->hoff);
-//                printf(" - %u (hoff %d)\n", index_Glyph_(rg->glyph), rg->hoff);
+            SDL_Surface *surf = glyphSurface_(job->bmp, job->width, job->height);
+            job->bmp = NULL;
+            SDL_BlitSurface(surf, NULL, buf, &(SDL_Rect){ bufX, 0, job->width, job->height });
+            if (surf->flags & SDL_PREALLOC) {
+                free(surf->pixels);
             }
-            SDL_DestroyTexture(bufTex);
-            /* Resume with an empty buffer. */
-            clear_Array(rasters);
-            bufX = 0;
+            SDL_FreeSurface(surf);
+            bufX += job->width;
         }
+        SDL_Texture *bufTex = SDL_CreateTextureFromSurface(activeText_->render, buf);
+        SDL_SetTextureBlendMode(bufTex, SDL_BLENDMODE_NONE);
+        SDL_Texture *target = NULL;
+        bufX = 0;
+        for (size_t i = first; i < end; i++) {
+            iRasterJob *job = at_Array(&jobs, i);
+            SDL_Texture *pageTex = activeText_->cachePages[job->glyph->cachePage].texture;
+            if (pageTex != target) {
+                /* Glyphs of a batch are usually on the same page. */
+                setRenderTarget_Paint(activeText_->render, pageTex);
+                target = pageTex;
+            }
+            const iRect *glRect = &job->glyph->rect[job->hoff];
+            SDL_RenderCopy(activeText_->render,
+                           bufTex,
+                           &(SDL_Rect){ bufX, 0, job->width, job->height },
+                           (const SDL_Rect *) glRect);
+            setRasterized_Glyph_(job->glyph, job->hoff);
+            bufX += job->width;
+        }
+        SDL_DestroyTexture(bufTex);
+        first = end;
     }
-    if (rasters) {
-        delete_Array(rasters);
-    }
-    if (buf) {
-        SDL_FreeSurface(buf);
-    }
-    if (isTargetChanged) {
-        SDL_SetRenderTarget(activeText_->render, oldTarget);
-    }
+    setRenderTarget_Paint(activeText_->render, oldTarget);
+    SDL_FreeSurface(buf);
+    deinit_Array(&jobs);
 }
 
 static void cacheSingleGlyph_Font_(iFont *d, uint32_t glyphIndex) {
@@ -1257,33 +1707,130 @@ float horizKern_Font_(iFont *d, uint32_t glyph1, uint32_t glyph2) {
 iDeclareType(GlyphBuffer)
 
 struct Impl_GlyphBuffer {
-    hb_buffer_t *        hb;
     iFont *              font;
     const iChar *        logicalText;
-    hb_glyph_info_t *    glyphInfo;
+    iBool                isShaped;
+    iBool                isArabic;
+    int                  logicalStart; /* clusters are relative to this */
+    unsigned int         inputLen;
+    uint32_t *           input; /* visual codepoints followed by the clusters */
+    hb_glyph_info_t *    glyphInfo; /* own copy, may be adjusted */
     hb_glyph_position_t *glyphPos;
     unsigned int         glyphCount;
 };
 
 static void init_GlyphBuffer_(iGlyphBuffer *d, iFont *font, const iChar *logicalText) {
-    d->hb          = hb_buffer_create();
+    iZap(*d);
     d->font        = font;
     d->logicalText = logicalText;
-    d->glyphInfo   = NULL;
-    d->glyphPos    = NULL;
-    d->glyphCount  = 0;
 }
 
 static void deinit_GlyphBuffer_(iGlyphBuffer *d) {
-    hb_buffer_destroy(d->hb);
+    free(d->input);
+    free(d->glyphInfo);
+    free(d->glyphPos);
+}
+
+static void setInput_GlyphBuffer_(iGlyphBuffer *d, const iChar *visualText, const int *visToLog,
+                                  iRangei visRange, int logicalStart, iBool isArabic) {
+    d->isArabic     = isArabic;
+    d->logicalStart = logicalStart;
+    d->inputLen     = size_Range(&visRange);
+    d->input        = malloc(sizeof(uint32_t) * 2 * d->inputLen);
+    for (unsigned int i = 0; i < d->inputLen; i++) {
+        d->input[i]               = visualText[visRange.start + i];
+        d->input[d->inputLen + i] = visToLog[visRange.start + i] - logicalStart;
+    }
+}
+
+static uint32_t inputHash_GlyphBuffer_(const iGlyphBuffer *d) {
+    /* FNV-1a */
+    uint32_t hash = 0x811c9dc5;
+    const uint32_t key[2] = { (uint32_t) (intptr_t) d->font, d->isArabic };
+    const uint8_t *bytes[2] = { (const uint8_t *) key, (const uint8_t *) d->input };
+    const size_t   sizes[2] = { sizeof(key), sizeof(uint32_t) * 2 * d->inputLen };
+    for (size_t k = 0; k < 2; k++) {
+        for (size_t i = 0; i < sizes[k]; i++) {
+            hash = (hash ^ bytes[k][i]) * 0x01000193;
+        }
+    }
+    return hash;
+}
+
+static iBool isMatch_ShapedRun_(const iShapedRun *d, const iGlyphBuffer *buf, uint32_t hash) {
+    return d->input && d->hash == hash && d->font == buf->font && d->isArabic == buf->isArabic &&
+           d->inputLen == buf->inputLen &&
+           !memcmp(d->input, buf->input, sizeof(uint32_t) * 2 * buf->inputLen);
+}
+
+static void shapeUncached_GlyphBuffer_(iGlyphBuffer *d, iShapedRun *result) {
+    iTextState *state = state_Text_();
+    if (!state->hbBuf) {
+        state->hbBuf = hb_buffer_create();
+    }
+    hb_buffer_t *hb = state->hbBuf;
+    hb_buffer_clear_contents(hb);
+    /* The text is inserted in visual order (LTR). */
+    for (unsigned int i = 0; i < d->inputLen; i++) {
+        hb_buffer_add(hb, d->input[i], d->input[d->inputLen + i]);
+    }
+    hb_buffer_set_content_type(hb, HB_BUFFER_CONTENT_TYPE_UNICODE);
+    hb_buffer_set_direction(hb, HB_DIRECTION_LTR); /* visual */
+    if (d->isArabic) {
+        hb_buffer_set_script(hb, HB_SCRIPT_ARABIC);
+    }
+    hb_shape(d->font->fontFile->hbFont, hb, NULL, 0);
+    unsigned int count = 0;
+    const hb_glyph_info_t     *info = hb_buffer_get_glyph_infos(hb, &count);
+    const hb_glyph_position_t *pos  = hb_buffer_get_glyph_positions(hb, &count);
+    result->font       = d->font;
+    result->isArabic   = d->isArabic;
+    result->glyphCount = count;
+    result->glyphInfo  = malloc(sizeof(hb_glyph_info_t) * iMax(1u, count));
+    result->glyphPos   = malloc(sizeof(hb_glyph_position_t) * iMax(1u, count));
+    memcpy(result->glyphInfo, info, sizeof(hb_glyph_info_t) * count);
+    memcpy(result->glyphPos, pos, sizeof(hb_glyph_position_t) * count);
 }
 
 static void shape_GlyphBuffer_(iGlyphBuffer *d) {
-    if (!d->glyphInfo) {
-        hb_shape(d->font->fontFile->hbFont, d->hb, NULL, 0);
-        d->glyphInfo = hb_buffer_get_glyph_infos(d->hb, &d->glyphCount);
-        d->glyphPos  = hb_buffer_get_glyph_positions(d->hb, &d->glyphCount);
+    if (d->isShaped) {
+        return;
+    }
+    d->isShaped = iTrue;
+    iTextState *state = state_Text_();
+    iShapedRun  uncached;
+    iShapedRun *shaped = NULL;
+    iZap(uncached);
+    if (d->inputLen <= maxInput_ShapeCache) {
+        /* The same runs get shaped repeatedly during layout, measuring, and drawing. */
+        if (!state->shapeCache) {
+            state->shapeCache = calloc(size_ShapeCache, sizeof(iShapedRun));
+        }
+        const uint32_t hash = inputHash_GlyphBuffer_(d);
+        shaped = &state->shapeCache[hash % size_ShapeCache];
+        if (!isMatch_ShapedRun_(shaped, d, hash)) {
+            deinit_ShapedRun_(shaped);
+            shapeUncached_GlyphBuffer_(d, shaped);
+            shaped->hash     = hash;
+            shaped->inputLen = d->inputLen;
+            shaped->input    = malloc(sizeof(uint32_t) * 2 * d->inputLen);
+            memcpy(shaped->input, d->input, sizeof(uint32_t) * 2 * d->inputLen);
+        }
+    }
+    else {
+        shapeUncached_GlyphBuffer_(d, &uncached);
+        shaped = &uncached;
+    }
+    /* Make a copy for this run since the positions may be adjusted. */
+    d->glyphCount = shaped->glyphCount;
+    d->glyphInfo  = malloc(sizeof(hb_glyph_info_t) * iMax(1u, d->glyphCount));
+    d->glyphPos   = malloc(sizeof(hb_glyph_position_t) * iMax(1u, d->glyphCount));
+    memcpy(d->glyphInfo, shaped->glyphInfo, sizeof(hb_glyph_info_t) * d->glyphCount);
+    memcpy(d->glyphPos, shaped->glyphPos, sizeof(hb_glyph_position_t) * d->glyphCount);
+    for (unsigned int i = 0; i < d->glyphCount; i++) {
+        d->glyphInfo[i].cluster += d->logicalStart;
     }
+    deinit_ShapedRun_(&uncached);
 }
 
 static float nextTabStop_Font_(const iFont *d, float x) {
@@ -1337,14 +1884,17 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
     const iBool  isMonospaced = isMonospaced_Font(d);
     iWrapText *wrap = args->wrap;
     iAssert(args->text.end >= args->text.start);
+    if (mode & draw_RunMode) {
+        activeText_->cacheUseCount++; /* for finding the least recently used cache page */
+    }
     /* Split the text into a number of attributed runs that specify exactly which
        font is used and other attributes such as color. (HarfBuzz shaping is done
        with one specific font.) */
     iAttributedText attrText;
     init_AttributedText(&attrText, args->text, args->maxLen, d, args->color,
                         args->baseDir,
-                        activeText_->baseFontId >= 0 ? font_Text_(activeText_->baseFontId) : d,
-                        activeText_->baseFgColorId, 
+                        state_Text_()->baseFontId >= 0 ? font_Text_(state_Text_()->baseFontId) : d,
+                        state_Text_()->baseFgColorId, 
                         wrap ? wrap->overrideChar : 0);
     if (wrap) {
         wrap->baseDir = attrText.isBaseRTL ? -1 : +1;
@@ -1364,25 +1914,19 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
     iArray buffers;
     init_Array(&buffers, sizeof(iGlyphBuffer));
     resize_Array(&buffers, runCount);
-    /* Prepare the HarfBuzz buffers. They will be lazily shaped when needed. */
+    /* Prepare the glyph buffers. They will be lazily shaped when needed. */
     iConstForEach(Array, i, &attrText.runs) {
         const iAttributedRun *run = i.value;
         iGlyphBuffer *buf = at_Array(&buffers, index_ArrayConstIterator(&i));
         init_GlyphBuffer_(buf, run->font, logicalText);
-        /* Insert the text in visual order (LTR) in the HarfBuzz buffer for shaping.
+        /* The text is shaped in visual order (LTR).
            First we need to map the logical run to the corresponding visual run. */
         int v[2] = { logToVis[run->logical.start], logToVis[run->logical.end - 1] };
         if (v[0] > v[1]) {
             iSwap(int, v[0], v[1]); /* always LTR */
         }
-        for (int vis = v[0]; vis <= v[1]; vis++) {
-            hb_buffer_add(buf->hb, visualText[vis], visToLog[vis]);
-        }
-        hb_buffer_set_content_type(buf->hb, HB_BUFFER_CONTENT_TYPE_UNICODE);
-        hb_buffer_set_direction(buf->hb, HB_DIRECTION_LTR); /* visual */
-        if (run->flags.isArabic) {
-            hb_buffer_set_script(buf->hb, HB_SCRIPT_ARABIC);
-        }
+        setInput_GlyphBuffer_(buf, visualText, visToLog, (iRangei){ v[0], v[1] + 1 },
+                              run->logical.start, run->flags.isArabic);
     }
     if (isMonospaced) {
         /* Fit borrowed glyphs into the expected monospacing. */
@@ -1669,6 +2213,9 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
                 const float xAdvance = run->font->xScale * buf->glyphPos[i].x_advance;
                 const float yAdvance = run->font->yScale * buf->glyphPos[i].y_advance;
                 const iGlyph *glyph = glyphByIndex_Font_(run->font, glyphId);
+                if (state_Text_()->glyphCollector) {
+                    collectGlyph_Text_(run->font, glyphId);
+                }
                 if (logicalText[logPos] == '\t') {
 #if 0
                     if (mode & draw_RunMode) {
@@ -1716,12 +2263,14 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
                 if (mode & draw_RunMode && (isBgFilled || !isSpace)) {
                     /* Draw the glyph. */
                     if (!isSpace && !isRasterized_Glyph_(glyph, hoff)) {
-                        cacheSingleGlyph_Font_(run->font, glyphId); /* may cause cache reset */
+                        cacheSingleGlyph_Font_(run->font, glyphId); /* may evict a cache page */
                         glyph = glyphByIndex_Font_(run->font, glyphId);
                         iAssert(isRasterized_Glyph_(glyph, hoff));
                     }
+                    iGlyphCachePage *cachePage = &activeText_->cachePages[glyph->cachePage];
+                    cachePage->lastUsed = activeText_->cacheUseCount;
                     if (~mode & permanentColorFlag_RunMode) {
-                        SDL_SetTextureColorMod(activeText_->cache, fgClr.r, fgClr.g, fgClr.b);
+                        SDL_SetTextureColorMod(cachePage->texture, fgClr.r, fgClr.g, fgClr.b);
                     }
                     dst.x += origin_Paint.x;
                     dst.y += origin_Paint.y;
@@ -1747,7 +2296,7 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
                     if (!isSpace) {
                         SDL_Rect src;
                         memcpy(&src, &glyph->rect[hoff], sizeof(SDL_Rect));
-                        SDL_RenderCopy(activeText_->render, activeText_->cache, &src, &dst);
+                        SDL_RenderCopy(activeText_->render, cachePage->texture, &src, &dst);
                     }
 #if 0
                     /* Show spaces and direction. */
@@ -1812,12 +2361,18 @@ static iRect run_Font_(iFont *d, const iRunArgs *args) {
 #endif /* defined (LAGRANGE_ENABLE_HARFBUZZ) */
 
 int lineHeight_Text(int fontId) {
-    return font_Text_(fontId)->height;
+    lockFonts_Text_();
+    const int height = font_Text_(fontId)->height;
+    unlockFonts_Text_();
+    return height;
 }
 
 float emRatio_Text(int fontId) {
-    const iFont *font = font_Text_(fontId);
-    return font->emAdvance / font->height;
+    lockFonts_Text_();
+    const iFont *font  = font_Text_(fontId);
+    const float  ratio = font->emAdvance / font->height;
+    unlockFonts_Text_();
+    return ratio;
 }
 
 iTextMetrics measureRange_Text(int fontId, iRangecc text) {
@@ -1825,26 +2380,79 @@ iTextMetrics measureRange_Text(int fontId, iRangecc text) {
         return (iTextMetrics){ init_Rect(0, 0, 0, lineHeight_Text(fontId)), zero_I2() };
     }
     iTextMetrics tm;
+    lockFonts_Text_();
     tm.bounds = run_Font_(font_Text_(fontId), &(iRunArgs){
         .mode = measure_RunMode,
         .text = text,
         .cursorAdvance_out = &tm.advance
     });
+    unlockFonts_Text_();
     return tm;
 }
 
 iRect visualBounds_Text(int fontId, iRangecc text) {
-    return run_Font_(font_Text_(fontId),
-                     &(iRunArgs){
-                         .mode = measure_RunMode | visualFlag_RunMode,
-                         .text = text,
-                     });
+    lockFonts_Text_();
+    const iRect bounds = run_Font_(font_Text_(fontId),
+                                   &(iRunArgs){
+                                       .mode = measure_RunMode | visualFlag_RunMode,
+                                       .text = text,
+                                   });
+    unlockFonts_Text_();
+    return bounds;
 }
 
 void cache_Text(int fontId, iRangecc text) {
+    if (isMeasureOnly_) {
+        return;
+    }
     cacheTextGlyphs_Font_(font_Text_(fontId), text);
 }
 
+static int cmpGlyphSetKey_(const void *a, const void *b) {
+    const uint64_t x = *(const uint64_t *) a, y = *(const uint64_t *) b;
+    return x < y ? -1 : x > y ? 1 : 0;
+}
+
+void initGlyphSet_Text(iSortedArray *glyphs) {
+    init_SortedArray(glyphs, sizeof(uint64_t), cmpGlyphSetKey_);
+}
+
+void setGlyphCollector_Text(iSortedArray *glyphs) {
+    state_Text_()->glyphCollector = glyphs;
+}
+
+size_t cacheGlyphSet_Text(const iSortedArray *glyphs, size_t pos, size_t maxCount) {
+    if (isMeasureOnly_) {
+        return size_SortedArray(glyphs);
+    }
+    /* The collector has already limited the set to what fits in one cache page. */
+    enum { batchSize_ = 128 };
+    iArray indices;
+    init_Array(&indices, sizeof(uint32_t));
+    int batchFont = -1;
+    const size_t count = iMin(size_SortedArray(glyphs), pos + maxCount);
+    for (size_t i = pos; i <= count; i++) {
+        const uint64_t key    = (i < count ? *(const uint64_t *) constAt_SortedArray(glyphs, i) : 0);
+        const int      fontId = (i < count ? (int) (key >> 32) : -1);
+        if (!isEmpty_Array(&indices) &&
+            (fontId != batchFont || size_Array(&indices) == batchSize_)) {
+            cacheGlyphs_Font_(font_Text_(batchFont), &indices);
+            clear_Array(&indices);
+        }
+        if (fontId >= 0 && (size_t) fontId < size_Array(&activeText_->fonts)) {
+            const uint32_t glyphIndex = (uint32_t) key;
+            batchFont = fontId;
+            pushBack_Array(&indices, &glyphIndex);
+        }
+    }
+    deinit_Array(&indices);
+    return count;
+}
+
+void clearShapeCache_Text(void) {
+    clearShapeCache_TextState_(state_Text_());
+}
+
 static int runFlagsFromId_(enum iFontId fontId) {
     int runFlags = 0;
     if (fontId & alwaysVariableFlag_FontId) {
@@ -1891,11 +2499,13 @@ iTextMetrics measureN_Text(int fontId, const char *text, size_t n) {
                                zero_I2() };
     }
     iTextMetrics tm;
+    lockFonts_Text_();
     tm.bounds = run_Font_(font_Text_(fontId),
               &(iRunArgs){ .mode              = measure_RunMode | runFlagsFromId_(fontId),
                            .text              = range_CStr(text),
                            .maxLen            = n,
                            .cursorAdvance_out = &tm.advance });
+    unlockFonts_Text_();
     return tm;
 }
 
@@ -1903,7 +2513,7 @@ static void drawBoundedN_Text_(int fontId, iInt2 pos, int xposBound, int color,
     iText *      d    = activeText_;
     iFont *      font = font_Text_(fontId);
     const iColor clr  = get_Color(color & mask_ColorId);
-    SDL_SetTextureColorMod(d->cache, clr.r, clr.g, clr.b);
+    setCacheColorMod_Text_(d, clr);
     run_Font_(font,
               &(iRunArgs){ .mode = draw_RunMode |
                                    (color & permanent_ColorId ? permanentColorFlag_RunMode : 0) |
@@ -2048,11 +2658,13 @@ void drawCenteredRange_Text(int fontId, iRect rect, iBool alignVisual, int color
 
 iTextMetrics measure_WrapText(iWrapText *d, int fontId) {
     iTextMetrics tm;
+    lockFonts_Text_(); /* also held during wrap callbacks */
     tm.bounds = run_Font_(font_Text_(fontId),
                           &(iRunArgs){ .mode = measure_RunMode | runFlagsFromId_(fontId),
                                        .text = d->text,
                                        .wrap = d,
                                        .cursorAdvance_out = &tm.advance });
+    unlockFonts_Text_();
     return tm;
 }
 
@@ -2094,14 +2706,14 @@ iTextMetrics draw_WrapText(iWrapText *d, int fontId, iInt2 pos, int color) {
 }
 
 iBool checkMissing_Text(void) {
-    iText *d = activeText_;
+    iTextState *d = state_Text_();
     const iBool missing = d->missingGlyphs;
     d->missingGlyphs = iFalse;
     return missing;
 }
 
 SDL_Texture *glyphCache_Text(void) {
-    return activeText_->cache;
+    return activeText_->cachePages[activeText_->cachePage].texture;
 }
 
 static void freeBitmap_(void *ptr) {
@@ -2231,14 +2843,14 @@ void init_TextBuf(iTextBuf *d, iWrapText *wrapText, int font, int color) {
         SDL_Texture *oldTarget = SDL_GetRenderTarget(render);
         const iInt2 oldOrigin = origin_Paint;
         origin_Paint = zero_I2();
-        SDL_SetRenderTarget(render, d->texture);
+        setRenderTarget_Paint(render, d->texture);
         SDL_SetRenderDrawBlendMode(render, SDL_BLENDMODE_NONE);
         SDL_SetRenderDrawColor(render, 255, 255, 255, 0);
         SDL_RenderClear(render);
-        SDL_SetTextureBlendMode(activeText_->cache, SDL_BLENDMODE_NONE); /* blended when TextBuf is drawn */
+        setCacheBlendMode_Text_(activeText_, SDL_BLENDMODE_NONE); /* blended when TextBuf is drawn */
         draw_WrapText(wrapText, font, zero_I2(), color | fillBackground_ColorId);
-        SDL_SetTextureBlendMode(activeText_->cache, SDL_BLENDMODE_BLEND);
-        SDL_SetRenderTarget(render, oldTarget);
+        setCacheBlendMode_Text_(activeText_, SDL_BLENDMODE_BLEND);
+        setRenderTarget_Paint(render, oldTarget);
         origin_Paint = oldOrigin;
         SDL_SetTextureBlendMode(d->texture, SDL_BLENDMODE_BLEND);
     }
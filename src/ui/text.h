@@ -23,6 +23,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 #pragma once
 
 #include <the_Foundation/rect.h>
+#include <the_Foundation/sortedarray.h>
 #include <the_Foundation/string.h>
 #include <the_Foundation/vec2.h>
 #include <SDL_render.h>
@@ -109,7 +110,8 @@ iDeclareTypeConstructionArgs(Text, SDL_Renderer *)
 void    init_Text               (iText *, SDL_Renderer *);
 void    deinit_Text             (iText *);
 
-void    setCurrent_Text         (iText *);
+void    setCurrent_Text         (iText *); /* on other threads, text can only be measured */
+iText * current_Text            (void);
 
 void    setDocumentFontSize_Text(iText *, float fontSizeFactor); /* affects all except `default*` fonts */
 void    resetFonts_Text         (iText *);
@@ -161,6 +163,10 @@ void    setBaseAttributes_Text  (int fontId, int fgColorId); /* current "normal"
 void    setAnsiFlags_Text       (int ansiFlags);
 
 void    cache_Text              (int fontId, iRangecc text); /* pre-render glyphs */
+void    initGlyphSet_Text       (iSortedArray *glyphs);
+void    setGlyphCollector_Text  (iSortedArray *glyphs); /* NULL to stop collecting */
+size_t  cacheGlyphSet_Text      (const iSortedArray *glyphs, size_t pos, size_t maxCount); /* pre-render collected glyphs; returns next pos */
+void    clearShapeCache_Text    (void); /* forget previously shaped runs */
 
 void    draw_Text               (int fontId, iInt2 pos, int color, const char *text, ...);
 void    drawAlign_Text          (int fontId, iInt2 pos, int color, enum iAlignment align, const char *text, ...);
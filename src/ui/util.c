@@ -622,6 +622,7 @@ static iBool isCommandIgnoredByMenus_(const char *cmd) {
     /* TODO: Perhaps a common way of indicating which commands are notifications and should not
        be reacted to by menus? */
     return equal_Command(cmd, "media.updated") ||
+           equal_Command(cmd, "media.decoded") ||
            equal_Command(cmd, "media.player.update") ||
            startsWith_CStr(cmd, "feeds.update.") ||
            equal_Command(cmd, "bookmarks.request.started") ||
@@ -1803,6 +1804,7 @@ static iBool messageHandler_(iWidget *msg, const char *cmd) {
     /* Almost any command dismisses the sheet. */
     /* TODO: Add a "notification" type of user events to separate them from user actions. */
     if (!(equal_Command(cmd, "media.updated") ||
+          equal_Command(cmd, "media.decoded") ||
           equal_Command(cmd, "media.player.update") ||
           equal_Command(cmd, "bookmarks.request.finished") ||
           equal_Command(cmd, "bookmarks.changed") ||
@@ -2996,6 +2998,7 @@ static iBool handleFeedSettingCommands_(iWidget *dlg, const char *cmd) {
         addOrRemoveTag_Bookmark(bm, subscribed_BookmarkTag, iTrue);
         addOrRemoveTag_Bookmark(bm, headings_BookmarkTag, headings);
         addOrRemoveTag_Bookmark(bm, ignoreWeb_BookmarkTag, ignoreWeb);
+        reindex_Bookmarks(bookmarks_App(), id);
         postCommand_App("bookmarks.changed");
         setupSheetTransition_Mobile(dlg, iFalse);
         destroy_Widget(dlg);
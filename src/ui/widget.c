@@ -95,6 +95,21 @@ static iRect boundsForDraw_Widget_(const iWidget *d) {
     return bounds;
 }
 
+static iRect drawExtent_Widget_(const iWidget *d) {
+    /* Area that drawing the widget may affect, including layer effects. */
+    if (d->flags & mouseModal_WidgetFlag) {
+        return rect_Root(d->root); /* background fade */
+    }
+    const int margin = (d->flags & keepOnTop_WidgetFlag ? 12 : 1) * gap_UI; /* soft shadow */
+    return expanded_Rect(boundsForDraw_Widget_(d), init1_I2(margin));
+}
+
+static void damage_Widget_(const iWidget *d) {
+    if (d->root && d->root->window) {
+        addDamage_Window(d->root->window, drawExtent_Widget_(d));
+    }
+}
+
 static iBool checkDrawBuffer_Widget_(const iWidget *d) {
     return d->drawBuf && d->drawBuf->isValid &&
            isEqual_I2(d->drawBuf->size, boundsForDraw_Widget_(d).size);
@@ -154,6 +169,7 @@ void deinit_Widget(iWidget *d) {
     printf("widget %p (%s) deleted (on top:%d)\n", d, cstr_String(&d->id),
            d->flags & keepOnTop_WidgetFlag ? 1 : 0);
 #endif
+    unregisterId_Root(d->root, d);
     deinit_String(&d->id);
     if (d->flags & keepOnTop_WidgetFlag) {
         removeAll_PtrArray(onTop_Root(d->root), d);
@@ -207,7 +223,9 @@ void destroy_Widget(iWidget *d) {
 }
 
 void setId_Widget(iWidget *d, const char *id) {
+    unregisterId_Root(d->root, d);
     setCStr_String(&d->id, id);
+    registerId_Root(d->root, d);
 }
 
 const iString *id_Widget(const iWidget *d) {
@@ -224,6 +242,11 @@ void setFlags_Widget(iWidget *d, int64_t flags, iBool set) {
             /* TODO: Tablets should detect if a hardware keyboard is available. */
             flags &= ~drawKey_WidgetFlag;
         }
+        const int64_t visualFlags = hidden_WidgetFlag | disabled_WidgetFlag |
+                                    selected_WidgetFlag | pressed_WidgetFlag;
+        if ((d->flags & flags & visualFlags) != (set ? flags & visualFlags : 0)) {
+            damage_Widget_(d); /* appearance changes */
+        }
         iChangeFlags(d->flags, flags, set);
         if (flags & keepOnTop_WidgetFlag) {
             iPtrArray *onTop = onTop_Root(d->root);
@@ -296,7 +319,9 @@ void showCollapsed_Widget(iWidget *d, iBool show) {
 void setVisualOffset_Widget(iWidget *d, int value, uint32_t span, int animFlags) {
     setFlags_Widget(d, visualOffset_WidgetFlag, iTrue);
     if (span == 0) {
+        damage_Widget_(d); /* old position */
         init_Anim(&d->visualOffset, value);
+        damage_Widget_(d);
         if (value == 0) {
             setFlags_Widget(d, visualOffset_WidgetFlag, iFalse); /* offset is being reset */
         }
@@ -330,6 +355,10 @@ void setRoot_Widget(iWidget *d, iRoot *root) {
         iAssert(indexOf_PtrArray(onTop_Root(d->root), d) == iInvalidPos);
         pushBack_PtrArray(onTop_Root(root), d);
     }
+    if (root != d->root) {
+        unregisterId_Root(d->root, d);
+        registerId_Root(root, d);
+    }
     d->root = root;
     iForEach(ObjectList, i, d->children) {
         setRoot_Widget(i.object, root);
@@ -865,8 +894,10 @@ void arrange_Widget(iWidget *d) {
             puts("\n==== NEW WIDGET ARRANGEMENT ====\n");
         }
 #endif
+        damage_Widget_(d); /* old position */
         resetArrangement_Widget_(d); /* back to initial default sizes */
         arrange_Widget_(d);
+        damage_Widget_(d);
     }
 }
 
@@ -1566,7 +1597,8 @@ void drawChildren_Widget(const iWidget *d) {
     }
     iConstForEach(ObjectList, i, d->children) {
         const iWidget *child = constAs_Widget(i.object);
-        if (~child->flags & keepOnTop_WidgetFlag && isDrawn_Widget_(child)) {
+        if (~child->flags & keepOnTop_WidgetFlag && isDrawn_Widget_(child) &&
+            isInDrawArea_Window(window_Widget(child), drawExtent_Widget_(child))) {
             incrementDrawCount_(child);
             class_Widget(child)->draw(child);
         }
@@ -1611,7 +1643,7 @@ static void beginBufferDraw_Widget_(const iWidget *d) {
         d->drawBuf->oldTarget = SDL_GetRenderTarget(render);
         d->drawBuf->oldOrigin = origin_Paint;
         realloc_WidgetDrawBuffer(d->drawBuf, render, boundsForDraw_Widget_(d).size);
-        SDL_SetRenderTarget(render, d->drawBuf->texture);
+        setRenderTarget_Paint(render, d->drawBuf->texture);
 //        SDL_SetRenderDrawColor(render, 255, 0, 0, 128);
         SDL_SetRenderDrawColor(render, 0, 0, 0, 0);
         SDL_RenderClear(render);
@@ -1624,7 +1656,7 @@ static void beginBufferDraw_Widget_(const iWidget *d) {
 static void endBufferDraw_Widget_(const iWidget *d) {
     if (d->drawBuf) {
         d->drawBuf->isValid = iTrue;
-        SDL_SetRenderTarget(renderer_Window(get_Window()), d->drawBuf->oldTarget);
+        setRenderTarget_Paint(renderer_Window(get_Window()), d->drawBuf->oldTarget);
         origin_Paint = d->drawBuf->oldOrigin;
 //        printf("endBufferDraw: origin %d,%d\n", origin_Paint.x, origin_Paint.y);
 //        fflush(stdout);
@@ -1701,6 +1733,9 @@ iAny *addChildPosFlags_Widget(iWidget *d, iAnyObject *child, enum iWidgetAddPos
         pushFront_ObjectList(d->children, widget); /* ref */
     }
     widget->parent = d;
+    if (widget->root != d->root) {
+        setRoot_Widget(widget, d->root); /* keeps the ID registry consistent */
+    }
     if (flags) {
         setFlags_Widget(child, flags, iTrue);
     }
@@ -1727,6 +1762,9 @@ iAny *insertChildAfter_Widget(iWidget *d, iAnyObject *child, size_t afterIndex)
         pushBack_ObjectList(d->children, child);
     }
     widget->parent = d;
+    if (widget->root != d->root) {
+        setRoot_Widget(widget, d->root);
+    }
     return child;
 }
 
@@ -1814,18 +1852,31 @@ iAny *hitChild_Widget(const iWidget *d, iInt2 coord) {
     return NULL;
 }
 
-iAny *findChild_Widget(const iWidget *d, const char *id) {
-    if (!d) return NULL;
+static iAny *searchChild_Widget_(const iWidget *d, const char *id) {
     if (cmp_String(id_Widget(d), id) == 0) {
         return iConstCast(iAny *, d);
     }
     iConstForEach(ObjectList, i, d->children) {
-        iAny *found = findChild_Widget(constAs_Widget(i.object), id);
+        iAny *found = searchChild_Widget_(constAs_Widget(i.object), id);
         if (found) return found;
     }
     return NULL;
 }
 
+iAny *findChild_Widget(const iWidget *d, const char *id) {
+    if (!d) return NULL;
+    if (*id) {
+        /* Widgets with an ID are registered in their Root. Only if there are multiple
+           matches do we need to walk the tree to see which one comes first. */
+        iBool isAmbiguous;
+        iAny *found = findRegistered_Root(d->root, d, id, &isAmbiguous);
+        if (!isAmbiguous) {
+            return found;
+        }
+    }
+    return searchChild_Widget_(d, id);
+}
+
 static void addMatchingToArray_Widget_(const iWidget *d, const char *id, iPtrArray *found) {
     if (cmp_String(id_Widget(d), id) == 0) {
         pushBack_PtrArray(found, d);
@@ -2084,7 +2135,6 @@ void postCommand_Widget(const iAnyObject *d, const char *cmd, ...) {
 
 void refresh_Widget(const iAnyObject *d) {
     if (!d) return;
-    /* TODO: Could be widget specific, if parts of the tree are cached. */
     /* TODO: The visbuffer in DocumentWidget and ListWidget could be moved to be a general
        purpose feature of Widget. */
     iAssert(isInstance_Object(d, &Class_Widget));
@@ -2097,7 +2147,9 @@ void refresh_Widget(const iAnyObject *d) {
             w->drawBuf->isValid = iFalse;
         }
     }
-    postRefresh_App();
+    /* Only the widget's area of the window needs to be redrawn. */
+    damage_Widget_(d);
+    postPartialRefresh_App();
 }
 
 void raise_Widget(iWidget *d) {
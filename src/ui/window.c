@@ -467,6 +467,11 @@ void init_Window(iWindow *d, enum iWindowType type, iRect rect, uint32_t flags)
     d->frameTime     = SDL_GetTicks();
     d->keyRoot       = NULL;
     d->borderShadow  = NULL;
+    d->frameBuffer   = NULL;
+    d->damage        = zero_Rect();
+    d->isFullyDamaged = iTrue;
+    d->drawArea      = zero_Rect();
+    iZap(d->frameClip);
     iZap(d->roots);
     iZap(d->cursors);
     create_Window_(d, rect, flags);
@@ -521,6 +526,9 @@ void deinit_Window(iWindow *d) {
     }
     deinitRoots_Window_(d);
     delete_Text(d->text);
+    if (d->frameBuffer) {
+        SDL_DestroyTexture(d->frameBuffer);
+    }
     SDL_DestroyRenderer(d->render);
     SDL_DestroyWindow(d->win);
     iForIndices(i, d->cursors) {
@@ -685,6 +693,53 @@ void invalidate_Window(iAnyWindow *d) {
     }
 }
 
+void addDamage_Window(iAnyWindow *any, iRect rect) {
+    iWindow *d = any;
+    if (d->isFullyDamaged || isEmpty_Rect(rect)) {
+        return;
+    }
+    d->damage = isEmpty_Rect(d->damage) ? rect : union_Rect(d->damage, rect);
+}
+
+void damageAll_Window(iAnyWindow *any) {
+    iWindow *d = any;
+    d->isFullyDamaged = iTrue;
+    d->damage         = zero_Rect();
+}
+
+iBool isInDrawArea_Window(const iWindow *d, iRect rect) {
+    /* Only applies when drawing directly to the frame buffer. Draw buffers of widgets
+       are always drawn completely. */
+    if (!d->frameBuffer || SDL_GetRenderTarget(d->render) != d->frameBuffer) {
+        return iTrue;
+    }
+    return !isEmpty_Rect(intersect_Rect(rect, d->drawArea));
+}
+
+static iBool updateFrameBuffer_Window_(iWindow *d) {
+#if defined (iPlatformMobile)
+    /* Widgets may draw into the safe areas outside their bounds. */
+    return iFalse;
+#else
+    if (d->frameBuffer && !isEqual_I2(size_SDLTexture(d->frameBuffer), d->size)) {
+        SDL_DestroyTexture(d->frameBuffer);
+        d->frameBuffer = NULL;
+    }
+    if (!d->frameBuffer && d->size.x > 0 && d->size.y > 0 && SDL_RenderTargetSupported(d->render)) {
+        d->frameBuffer = SDL_CreateTexture(d->render,
+                                           SDL_PIXELFORMAT_RGBA8888,
+                                           SDL_TEXTUREACCESS_TARGET,
+                                           d->size.x,
+                                           d->size.y);
+        if (d->frameBuffer) {
+            SDL_SetTextureBlendMode(d->frameBuffer, SDL_BLENDMODE_NONE);
+        }
+        damageAll_Window(d);
+    }
+    return d->frameBuffer != NULL;
+#endif
+}
+
 static iBool isNormalPlacement_MainWindow_(const iMainWindow *d) {
     if (d->isDrawFrozen) return iFalse;
 #if defined (iPlatformApple)
@@ -982,6 +1037,10 @@ iBool processEvent_Window(iWindow *d, const SDL_Event *ev) {
         }
         case SDL_RENDER_TARGETS_RESET:
         case SDL_RENDER_DEVICE_RESET: {
+            if (d->frameBuffer) {
+                SDL_DestroyTexture(d->frameBuffer);
+                d->frameBuffer = NULL;
+            }
             if (mw) {
                 invalidate_MainWindow_(mw, iTrue /* force full reset */);
             }
@@ -1237,30 +1296,48 @@ void draw_MainWindow(iMainWindow *d) {
     }
     const int   winFlags = SDL_GetWindowFlags(d->base.win);
     const iBool gotFocus = (winFlags & SDL_WINDOW_INPUT_FOCUS) != 0;
+    /* The frame buffer retains the previous frame, so only the damaged area needs to be
+       redrawn. Without a frame buffer, everything is drawn directly to the window. */
+    const iBool isPartial = updateFrameBuffer_Window_(w) && !w->isFullyDamaged;
+    w->drawArea = (iRect){ zero_I2(), w->size };
+    if (isPartial) {
+        w->drawArea = intersect_Rect(w->damage, w->drawArea);
+    }
+    w->damage         = zero_Rect();
+    w->isFullyDamaged = iFalse;
+    if (w->frameBuffer) {
+        SDL_SetRenderTarget(w->render, w->frameBuffer);
+    }
     iPaint p;
     init_Paint(&p);
+    iColor back;
     /* Clear the window. The clear color is visible as a border around the window
        when the custom frame is being used. */ {
         setCurrent_Root(w->roots[0]);
 #if defined (iPlatformMobile)
-        iColor back = get_Color(uiBackground_ColorId);
+        back = get_Color(uiBackground_ColorId);
         if (deviceType_App() == phone_AppDeviceType) {
             /* Page background extends to safe area, so fill it completely. */
             back = get_Color(tmBackground_ColorId);
         }
 #else
-        const iColor back = get_Color(gotFocus && d->place.snap != maximized_WindowSnap &&
-                                              ~winFlags & SDL_WINDOW_FULLSCREEN_DESKTOP
-                                          ? uiAnnotation_ColorId
-                                          : uiSeparator_ColorId);
+        back = get_Color(gotFocus && d->place.snap != maximized_WindowSnap &&
+                                 ~winFlags & SDL_WINDOW_FULLSCREEN_DESKTOP
+                             ? uiAnnotation_ColorId
+                             : uiSeparator_ColorId);
 #endif
         unsetClip_Paint(&p); /* update clip to full window */
         SDL_SetRenderDrawColor(w->render, back.r, back.g, back.b, 255);
-        SDL_RenderClear(w->render);
+        if (isPartial) {
+            SDL_RenderFillRect(w->render, (const SDL_Rect *) &w->drawArea);
+        }
+        else {
+            SDL_RenderClear(w->render);
+        }
     }
     /* Draw widgets. */
     w->frameTime = SDL_GetTicks();
-    if (isExposed_Window(w)) {
+    if (isExposed_Window(w) && !isEmpty_Rect(w->drawArea)) {
         w->isInvalidated = iFalse;
         extern int drawCount_;
         iForIndices(i, w->roots) {
@@ -1321,6 +1398,14 @@ void draw_MainWindow(iMainWindow *d) {
         SDL_RenderCopy(d->render, glyphCache_Text(), NULL, &rect);
     }
 #endif
+    if (w->frameBuffer) {
+        /* Show the updated frame. */
+        SDL_SetRenderTarget(w->render, NULL);
+        SDL_RenderSetClipRect(w->render, NULL);
+        SDL_SetRenderDrawColor(w->render, back.r, back.g, back.b, 255);
+        SDL_RenderClear(w->render);
+        SDL_RenderCopy(w->render, w->frameBuffer, NULL, &(SDL_Rect){ 0, 0, w->size.x, w->size.y });
+    }
     SDL_RenderPresent(w->render);
     isDrawing_ = iFalse;
 }
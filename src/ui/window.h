@@ -105,6 +105,11 @@ struct Impl_Window {
     iRoot *       keyRoot;      /* root that has the current keyboard input focus */
     SDL_Texture * borderShadow;
     iText *       text;
+    SDL_Texture * frameBuffer;  /* contents of the previous frame, for partial redraws */
+    iRect         damage;       /* area of `frameBuffer` to redraw in the next frame */
+    iBool         isFullyDamaged;
+    iRect         drawArea;     /* area being redrawn in the current frame */
+    SDL_Rect      frameClip;    /* clip of `frameBuffer` while drawing to another target */
 };
 
 struct Impl_MainWindow {
@@ -141,6 +146,9 @@ iRoot *         otherRoot_Window        (const iWindow *, iRoot *root);
 iBool       processEvent_Window     (iWindow *, const SDL_Event *);
 iBool       dispatchEvent_Window    (iWindow *, const SDL_Event *);
 void        invalidate_Window       (iAnyWindow *); /* discard all cached graphics */
+void        addDamage_Window        (iAnyWindow *, iRect rect); /* area needs to be redrawn */
+void        damageAll_Window        (iAnyWindow *);
+iBool       isInDrawArea_Window     (const iWindow *, iRect rect);
 void        draw_Window             (iWindow *);
 void        setUiScale_Window       (iWindow *, float uiScale);
 void        setCursor_Window        (iWindow *, int cursor);
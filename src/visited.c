@@ -22,15 +22,24 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include "visited.h"
 #include "app.h"
+#include "searchindex.h"
 
 #include <the_Foundation/file.h>
+#include <the_Foundation/fileinfo.h>
 #include <the_Foundation/mutex.h>
 #include <the_Foundation/path.h>
 #include <the_Foundation/ptrarray.h>
-#include <the_Foundation/sortedarray.h>
+#include <the_Foundation/stringset.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 const int maxAge_Visited = 6 * 3600 * 24 * 30; /* six months */
 
+static const char *fileName_Visited_    = "visited.2.txt";
+static const char *journalName_Visited_ = "visited.2.log"; /* changes since the last full save */
+
+iDefineTypeConstruction(VisitedUrl)
+
 void init_VisitedUrl(iVisitedUrl *d) {
     initCurrent_Time(&d->when);
     init_String(&d->url);
@@ -41,107 +50,288 @@ void deinit_VisitedUrl(iVisitedUrl *d) {
     deinit_String(&d->url);
 }
 
-static int cmpUrl_VisitedUrl_(const void *a, const void *b) {
-    return cmpString_String(&((const iVisitedUrl *) a)->url, &((const iVisitedUrl *) b)->url);
-}
-
 static int cmpNewer_VisitedUrl_(const void *insert, const void *existing) {
     return seconds_Time(&((const iVisitedUrl *) insert  )->when) >=
            seconds_Time(&((const iVisitedUrl *) existing)->when);
 }
 
+static void writeRecord_VisitedUrl_(const iVisitedUrl *d, iString *line, iFile *f) {
+    format_String(line,
+                  "%llu %04x %s\n",
+                  (unsigned long long) integralSeconds_Time(&d->when),
+                  d->flags,
+                  cstr_String(&d->url));
+    writeData_File(f, cstr_String(line), size_String(line));
+}
+
 /*----------------------------------------------------------------------------------------------*/
 
+/* URLs are kept in an open-addressing hash table so that checking the visited status of
+   links is independent of the number of visited URLs. Slots are never reordered, so the
+   VisitedUrl pointers remain valid until the URL is removed. */
+
+iDeclareType(VisitedSlot)
+
+struct Impl_VisitedSlot {
+    uint32_t     hash;
+    iVisitedUrl *item; /* NULL if empty */
+};
+
+static iVisitedUrl removed_VisitedSlot_; /* marks a slot as reusable; lookups skip over it */
+
+static iBool isUsed_VisitedSlot_(const iVisitedSlot *d) {
+    return d->item && d->item != &removed_VisitedSlot_;
+}
+
 struct Impl_Visited {
-    iMutex *mtx;
-    iSortedArray visited;
+    iMutex *      mtx;
+    iVisitedSlot *slots;
+    size_t        numSlots; /* power of two */
+    size_t        count;
+    size_t        numRemoved;
+    iStringSet *  changed;     /* URLs modified since the last save */
+    size_t        journalSize; /* number of records in the journal file */
+    iBool         needCompact; /* rewrite everything on next save */
 };
 
+static uint32_t hash_Visited_(const iString *url) {
+    const uint8_t *bytes = constData_Block(&url->chars);
+    uint32_t        hash  = 2166136261u; /* FNV-1a */
+    for (size_t i = 0; i < size_Block(&url->chars); i++) {
+        hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static iVisitedSlot *find_Visited_(const iVisited *d, const iString *url, uint32_t hash) {
+    if (!d->numSlots) {
+        return NULL;
+    }
+    const size_t mask = d->numSlots - 1;
+    for (size_t i = hash & mask;; i = (i + 1) & mask) {
+        iVisitedSlot *slot = &d->slots[i];
+        if (!slot->item) {
+            return NULL;
+        }
+        if (slot->hash == hash && slot->item != &removed_VisitedSlot_ &&
+            equal_String(&slot->item->url, url)) {
+            return slot;
+        }
+    }
+}
+
+static void rehash_Visited_(iVisited *d, size_t numSlots) {
+    iVisitedSlot *old      = d->slots;
+    const size_t  oldCount = d->numSlots;
+    d->slots      = calloc(numSlots, sizeof(iVisitedSlot));
+    d->numSlots   = numSlots;
+    d->numRemoved = 0;
+    for (size_t i = 0; i < oldCount; i++) {
+        if (isUsed_VisitedSlot_(&old[i])) {
+            size_t j = old[i].hash & (numSlots - 1);
+            while (d->slots[j].item) {
+                j = (j + 1) & (numSlots - 1);
+            }
+            d->slots[j] = old[i];
+        }
+    }
+    free(old);
+}
+
+static void insert_Visited_(iVisited *d, iVisitedUrl *item, uint32_t hash) {
+    /* Keep the table at most 3/4 full, including removed slots. */
+    if ((d->count + d->numRemoved + 1) * 4 > d->numSlots * 3) {
+        size_t numSlots = iMax(d->numSlots, 256);
+        while ((d->count + 1) * 2 > numSlots) {
+            numSlots *= 2;
+        }
+        rehash_Visited_(d, numSlots);
+    }
+    const size_t mask = d->numSlots - 1;
+    size_t i = hash & mask;
+    while (d->slots[i].item && d->slots[i].item != &removed_VisitedSlot_) {
+        i = (i + 1) & mask;
+    }
+    if (d->slots[i].item == &removed_VisitedSlot_) {
+        d->numRemoved--;
+    }
+    d->slots[i] = (iVisitedSlot){ hash, item };
+    d->count++;
+}
+
+static void remove_Visited_(iVisited *d, iVisitedSlot *slot) {
+    delete_VisitedUrl(slot->item);
+    slot->item = &removed_VisitedSlot_;
+    d->count--;
+    d->numRemoved++;
+}
+
+static void set_Visited_(iVisited *d, const iVisitedUrl *visit) {
+    const uint32_t hash = hash_Visited_(&visit->url);
+    iVisitedSlot *slot = find_Visited_(d, &visit->url, hash);
+    if (slot) {
+        slot->item->when  = visit->when;
+        slot->item->flags = visit->flags;
+        return;
+    }
+    iVisitedUrl *item = new_VisitedUrl();
+    set_String(&item->url, &visit->url);
+    item->when  = visit->when;
+    item->flags = visit->flags;
+    insert_Visited_(d, item, hash);
+    set_SearchIndex(searchIndex_App(), visited_SearchIndexType, &item->url,
+                    range_String(&item->url));
+}
+
+static void markChanged_Visited_(iVisited *d, const iString *url) {
+    if (!d->needCompact) {
+        insert_StringSet(d->changed, url);
+    }
+}
+
 iDefineTypeConstruction(Visited)
 
 void init_Visited(iVisited *d) {
-    d->mtx = new_Mutex();
-    init_SortedArray(&d->visited, sizeof(iVisitedUrl), cmpUrl_VisitedUrl_);
+    d->mtx         = new_Mutex();
+    d->slots       = NULL;
+    d->numSlots    = 0;
+    d->count       = 0;
+    d->numRemoved  = 0;
+    d->changed     = new_StringSet();
+    d->journalSize = 0;
+    d->needCompact = iFalse;
 }
 
 void deinit_Visited(iVisited *d) {
     iGuardMutex(d->mtx, {
         clear_Visited(d);
-        deinit_SortedArray(&d->visited);
+        free(d->slots);
+        iRelease(d->changed);
     });
     delete_Mutex(d->mtx);
 }
 
-void save_Visited(const iVisited *d, const char *dirPath) {
+static iBool compact_Visited_(iVisited *d, const char *dirPath) {
+    iBool ok = iFalse;
     iString *line = new_String();
-    iFile *f = newCStr_File(concatPath_CStr(dirPath, "visited.2.txt"));
+    iFile *f = newCStr_File(concatPath_CStr(dirPath, fileName_Visited_));
     if (open_File(f, writeOnly_FileMode | text_FileMode)) {
-        lock_Mutex(d->mtx);
-        iConstForEach(Array, i, &d->visited.values) {
-            const iVisitedUrl *item = i.value;
-            format_String(line,
-                          "%llu %04x %s\n",
-                          (unsigned long long) integralSeconds_Time(&item->when),
-                          item->flags,
-                          cstr_String(&item->url));
-            writeData_File(f, cstr_String(line), size_String(line));
+        for (size_t i = 0; i < d->numSlots; i++) {
+            if (isUsed_VisitedSlot_(&d->slots[i])) {
+                writeRecord_VisitedUrl_(d->slots[i].item, line, f);
+            }
         }
-        unlock_Mutex(d->mtx);
+        close_File(f);
+        /* Everything in the journal is now included in the main file. */
+        remove(concatPath_CStr(dirPath, journalName_Visited_));
+        d->journalSize = 0;
+        d->needCompact = iFalse;
+        ok = iTrue;
     }
     iRelease(f);
     delete_String(line);
+    return ok;
 }
 
-void load_Visited(iVisited *d, const char *dirPath) {
-    iFile *f = newCStr_File(concatPath_CStr(dirPath, "visited.2.txt"));
+void save_Visited(iVisited *d, const char *dirPath) {
+    lock_Mutex(d->mtx);
+    /* Rewrite everything when the journal has grown large compared to the number of URLs. */
+    if (d->needCompact ||
+        d->journalSize + size_StringSet(d->changed) > iMax((size_t) 1000, d->count / 2)) {
+        if (compact_Visited_(d, dirPath)) {
+            clear_StringSet(d->changed);
+        }
+        /* Otherwise the changes are kept for the next attempt. */
+    }
+    else if (!isEmpty_StringSet(d->changed)) {
+        iString *line = new_String();
+        iFile *f = newCStr_File(concatPath_CStr(dirPath, journalName_Visited_));
+        if (open_File(f, append_FileMode | text_FileMode)) {
+            iConstForEach(StringSet, i, d->changed) {
+                const iVisitedSlot *slot = find_Visited_(d, i.value, hash_Visited_(i.value));
+                if (slot) {
+                    writeRecord_VisitedUrl_(slot->item, line, f);
+                }
+                else {
+                    format_String(line, "- %s\n", cstr_String(i.value));
+                    writeData_File(f, cstr_String(line), size_String(line));
+                }
+                d->journalSize++;
+            }
+            clear_StringSet(d->changed);
+        }
+        iRelease(f);
+        delete_String(line);
+    }
+    unlock_Mutex(d->mtx);
+}
+
+static size_t loadRecords_Visited_(iVisited *d, const char *path) {
+    size_t numRecords = 0;
+    iFile *f = newCStr_File(path);
     if (open_File(f, readOnly_FileMode | text_FileMode)) {
-        lock_Mutex(d->mtx);
         const iRangecc src  = range_Block(collect_Block(readAll_File(f)));
         iRangecc       line = iNullRange;
         iTime          now;
         initCurrent_Time(&now);
+        iVisitedUrl item;
+        init_VisitedUrl(&item);
         while (nextSplit_Rangecc(src, "\n", &line)) {
-            if (size_Range(&line) < 8) continue;
+            if (size_Range(&line) < 3) continue;
+            numRecords++;
+            if (*line.start == '-') {
+                /* Removed from the journal. */
+                setRange_String(&item.url, (iRangecc){ skipSpace_CStr(line.start + 1), line.end });
+                iVisitedSlot *slot = find_Visited_(d, &item.url, hash_Visited_(&item.url));
+                if (slot) {
+                    remove_SearchIndex(searchIndex_App(), visited_SearchIndexType, &item.url);
+                    remove_Visited_(d, slot);
+                }
+                continue;
+            }
             char *endp = NULL;
             const unsigned long long ts = strtoull(line.start, &endp, 10);
             if (ts == 0) break;
             const uint32_t flags = strtoul(skipSpace_CStr(endp), &endp, 16);
             const char *urlStart = skipSpace_CStr(endp);
-            iVisitedUrl item;
             item.when.ts = (struct timespec){ .tv_sec = ts };
             if (~flags & kept_VisitedUrlFlag &&
                 secondsSince_Time(&now, &item.when) > maxAge_Visited) {
-                continue; /* Too old. */
+                d->needCompact = iTrue; /* Too old; will be dropped from the file. */
+                continue;
             }
             item.flags = flags;
-            initRange_String(&item.url, (iRangecc){ urlStart, line.end });
-            set_String(&item.url, &item.url);
-            insert_SortedArray(&d->visited, &item);
+            setRange_String(&item.url, (iRangecc){ urlStart, line.end });
+            set_Visited_(d, &item);
         }
-        unlock_Mutex(d->mtx);
+        deinit_VisitedUrl(&item);
     }
     iRelease(f);
+    return numRecords;
 }
 
-void clear_Visited(iVisited *d) {
+void load_Visited(iVisited *d, const char *dirPath) {
     lock_Mutex(d->mtx);
-    iForEach(Array, v, &d->visited.values) {
-        deinit_VisitedUrl(v.value);
-    }
-    clear_SortedArray(&d->visited);
+    loadRecords_Visited_(d, concatPath_CStr(dirPath, fileName_Visited_));
+    d->journalSize = loadRecords_Visited_(d, concatPath_CStr(dirPath, journalName_Visited_));
     unlock_Mutex(d->mtx);
 }
 
-static size_t find_Visited_(const iVisited *d, const iString *url) {
-    iVisitedUrl visit;
-    init_VisitedUrl(&visit);
-    set_String(&visit.url, url);
-    size_t pos = iInvalidPos;
-    iGuardMutex(d->mtx, {
-        locate_SortedArray(&d->visited, &visit, &pos);
-        deinit_VisitedUrl(&visit);
-    });
-    return pos;
+void clear_Visited(iVisited *d) {
+    lock_Mutex(d->mtx);
+    for (size_t i = 0; i < d->numSlots; i++) {
+        iVisitedSlot *slot = &d->slots[i];
+        if (isUsed_VisitedSlot_(slot)) {
+            delete_VisitedUrl(slot->item);
+        }
+        slot->item = NULL;
+    }
+    d->count       = 0;
+    d->numRemoved  = 0;
+    d->needCompact = iTrue;
+    clear_StringSet(d->changed);
+    unlock_Mutex(d->mtx);
+    clear_SearchIndex(searchIndex_App(), visited_SearchIndexType);
 }
 
 void visitUrl_Visited(iVisited *d, const iString *url, uint16_t visitFlags) {
@@ -151,66 +341,58 @@ void visitUrl_Visited(iVisited *d, const iString *url, uint16_t visitFlags) {
     init_VisitedUrl(&visit);
     visit.flags = visitFlags;
     set_String(&visit.url, url);
-    size_t pos;
     lock_Mutex(d->mtx);
-    if (locate_SortedArray(&d->visited, &visit, &pos)) {
-        iVisitedUrl *old = at_SortedArray(&d->visited, pos);
-        if (old->flags & kept_VisitedUrlFlag) {
-            visitFlags |= kept_VisitedUrlFlag; /* must continue to be kept */
+    const iVisitedSlot *slot = find_Visited_(d, url, hash_Visited_(url));
+    if (slot) {
+        if (slot->item->flags & kept_VisitedUrlFlag) {
+            visit.flags |= kept_VisitedUrlFlag; /* must continue to be kept */
         }
-        if (cmpNewer_VisitedUrl_(&visit, old)) {
-            old->when = visit.when;
-            old->flags = visitFlags;
-            unlock_Mutex(d->mtx);
-            deinit_VisitedUrl(&visit);
-            return;
+        if (!cmpNewer_VisitedUrl_(&visit, slot->item)) {
+            visit.when = slot->item->when;
         }
     }
-    insert_SortedArray(&d->visited, &visit);
+    set_Visited_(d, &visit);
+    markChanged_Visited_(d, url);
     unlock_Mutex(d->mtx);
+    deinit_VisitedUrl(&visit);
 }
 
 void setUrlKept_Visited(iVisited *d, const iString *url, iBool isKept) {
     if (isEmpty_String(url)) return;
-    iVisitedUrl visit;
-    init_VisitedUrl(&visit);
-    set_String(&visit.url, canonicalUrl_String(url));
-    size_t pos;
+    url = canonicalUrl_String(url);
     lock_Mutex(d->mtx);
-    if (locate_SortedArray(&d->visited, &visit, &pos)) {
-        iVisitedUrl *vis = at_SortedArray(&d->visited, pos);
-        iChangeFlags(vis->flags, kept_VisitedUrlFlag, isKept);
+    iVisitedSlot *slot = find_Visited_(d, url, hash_Visited_(url));
+    if (slot) {
+        iChangeFlags(slot->item->flags, kept_VisitedUrlFlag, isKept);
+        markChanged_Visited_(d, url);
     }
     unlock_Mutex(d->mtx);
-    deinit_VisitedUrl(&visit);
 }
 
 void removeUrl_Visited(iVisited *d, const iString *url) {
     url = canonicalUrl_String(url);
     iGuardMutex(d->mtx, {
-        size_t pos = find_Visited_(d, url);
-        if (pos < size_SortedArray(&d->visited)) {
-            iVisitedUrl *visUrl = at_SortedArray(&d->visited, pos);
-            if (equal_String(&visUrl->url, url)) {
-                deinit_VisitedUrl(visUrl);
-                remove_Array(&d->visited.values, pos);
-            }
+        iVisitedSlot *slot = find_Visited_(d, url, hash_Visited_(url));
+        if (slot) {
+            remove_Visited_(d, slot);
+            markChanged_Visited_(d, url);
         }
     });
+    remove_SearchIndex(searchIndex_App(), visited_SearchIndexType, url);
 }
 
 iTime urlVisitTime_Visited(const iVisited *d, const iString *url) {
-    iVisitedUrl item;
-    size_t pos;
-    iZap(item);
-    initCopy_String(&item.url, canonicalUrl_String(url));
+    iTime when;
+    iZap(when);
+    url = canonicalUrl_String(url);
+    const uint32_t hash = hash_Visited_(url);
     lock_Mutex(d->mtx);
-    if (locate_SortedArray(&d->visited, &item, &pos)) {
-        item.when = ((const iVisitedUrl *) constAt_SortedArray(&d->visited, pos))->when;
+    const iVisitedSlot *slot = find_Visited_(d, url, hash);
+    if (slot) {
+        when = slot->item->when;
     }
     unlock_Mutex(d->mtx);
-    deinit_String(&item.url);
-    return item.when;
+    return when;
 }
 
 iBool containsUrl_Visited(const iVisited *d, const iString *url) {
@@ -226,10 +408,10 @@ static int cmpWhenDescending_VisitedUrlPtr_(const void *a, const void *b) {
 const iPtrArray *list_Visited(const iVisited *d, size_t count) {
     iPtrArray *urls = collectNew_PtrArray();
     iGuardMutex(d->mtx, {
-        iConstForEach(Array, i, &d->visited.values) {
-            const iVisitedUrl *vis = i.value;
-            if (~vis->flags & transient_VisitedUrlFlag) {
-                pushBack_PtrArray(urls, vis);
+        for (size_t i = 0; i < d->numSlots; i++) {
+            const iVisitedSlot *slot = &d->slots[i];
+            if (isUsed_VisitedSlot_(slot) && ~slot->item->flags & transient_VisitedUrlFlag) {
+                pushBack_PtrArray(urls, slot->item);
             }
         }
     });
@@ -240,13 +422,26 @@ const iPtrArray *list_Visited(const iVisited *d, size_t count) {
     return urls;
 }
 
+const iPtrArray *listUrls_Visited(const iVisited *d, const iStringSet *urls) {
+    iPtrArray *found = collectNew_PtrArray();
+    iGuardMutex(d->mtx, {
+        iConstForEach(StringSet, i, urls) {
+            const iVisitedSlot *slot = find_Visited_(d, i.value, hash_Visited_(i.value));
+            if (slot && ~slot->item->flags & transient_VisitedUrlFlag) {
+                pushBack_PtrArray(found, slot->item);
+            }
+        }
+    });
+    return found;
+}
+
 const iPtrArray *listKept_Visited(const iVisited *d) {
     iPtrArray *urls = collectNew_PtrArray();
     iGuardMutex(d->mtx, {
-        iConstForEach(Array, i, &d->visited.values) {
-            const iVisitedUrl *vis = i.value;
-            if (vis->flags & kept_VisitedUrlFlag) {
-                pushBack_PtrArray(urls, vis);
+        for (size_t i = 0; i < d->numSlots; i++) {
+            const iVisitedSlot *slot = &d->slots[i];
+            if (isUsed_VisitedSlot_(slot) && slot->item->flags & kept_VisitedUrlFlag) {
+                pushBack_PtrArray(urls, slot->item);
             }
         }
     });
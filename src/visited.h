@@ -26,6 +26,7 @@ SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE. */
 
 #include <the_Foundation/ptrarray.h>
 #include <the_Foundation/string.h>
+#include <the_Foundation/stringset.h>
 #include <the_Foundation/time.h>
 
 iDeclareType(VisitedUrl)
@@ -49,7 +50,7 @@ iDeclareTypeConstruction(Visited)
 
 void    clear_Visited           (iVisited *);
 void    load_Visited            (iVisited *, const char *dirPath);
-void    save_Visited            (const iVisited *, const char *dirPath);
+void    save_Visited            (iVisited *, const char *dirPath); /* only appends changes, usually */
 
 iTime   urlVisitTime_Visited    (const iVisited *, const iString *url);
 void    visitUrl_Visited        (iVisited *, const iString *url, uint16_t visitFlags); /* adds URL to the visited URLs set */
@@ -59,3 +60,4 @@ iBool   containsUrl_Visited     (const iVisited *, const iString *url);
 
 const iPtrArray *   list_Visited        (const iVisited *, size_t count); /* returns collected */
 const iPtrArray *   listKept_Visited    (const iVisited *);
+const iPtrArray *   listUrls_Visited    (const iVisited *, const iStringSet *urls); /* returns collected */